@@ -26,18 +26,26 @@ with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include "config.h"
 #endif
 
+#include <string.h>
 #include <libayatana-indicator/indicator-object.h>
 #include <libayatana-appindicator-glib/ayatana-appindicator.h>
 #include <libayatana-appindicator-glib/ayatana-appindicator-enum-types.h>
 #include "application-service-appstore.h"
 #include "ayatana-application-service-marshal.h"
 #include "dbus-shared.h"
+#include "application-service-recording.h"
+#include "application-service-stats.h"
+#include "application-service-clients.h"
+#include "application-service-calls.h"
+#include "application-service-overrides.h"
 #include "generate-id.h"
+#include "tracing.h"
 
 /* DBus Prototypes */
-static GVariant * get_applications (ApplicationServiceAppstore * appstore);
+static GVariant * get_applications (ApplicationServiceAppstore * appstore, const gchar * sender);
+static GVariant * get_applications_since (ApplicationServiceAppstore * appstore, const gchar * sender, guint64 since);
 static void bus_method_call (GDBusConnection * connection, const gchar * sender, const gchar * path, const gchar * interface, const gchar * method, GVariant * params, GDBusMethodInvocation * invocation, gpointer user_data);
-static void props_cb (GObject * object, GAsyncResult * res, gpointer user_data);
+static void stats_method_call (GDBusConnection * connection, const gchar * sender, const gchar * path, const gchar * interface, const gchar * method, GVariant * params, GDBusMethodInvocation * invocation, gpointer user_data);
 
 #include "gen-ayatana-application-service.xml.h"
 
@@ -56,6 +64,30 @@ static void props_cb (GObject * object, GAsyncResult * res, gpointer user_data);
 #define NOTIFICATION_ITEM_PROP_ORDERING_INDEX        "XAyatanaOrderingIndex"
 #define NOTIFICATION_ITEM_PROP_TOOLTIP               "ToolTip"
 
+/* Properties that signals can invalidate, so that only those
+   need to be fetched again */
+typedef enum {
+    PROPERTY_ICON_NAME  = 1 << 0,
+    PROPERTY_ICON_DESC  = 1 << 1,
+    PROPERTY_AICON_NAME = 1 << 2,
+    PROPERTY_AICON_DESC = 1 << 3,
+    PROPERTY_TITLE      = 1 << 4,
+    PROPERTY_TOOLTIP    = 1 << 5,
+    PROPERTY_ALL        = (1 << 6) - 1
+} property_mask_t;
+
+static const struct {
+    property_mask_t property;
+    const gchar * name;
+} refreshable_properties[] = {
+    { PROPERTY_ICON_NAME,  NOTIFICATION_ITEM_PROP_ICON_NAME },
+    { PROPERTY_ICON_DESC,  NOTIFICATION_ITEM_PROP_ICON_DESC },
+    { PROPERTY_AICON_NAME, NOTIFICATION_ITEM_PROP_AICON_NAME },
+    { PROPERTY_AICON_DESC, NOTIFICATION_ITEM_PROP_AICON_DESC },
+    { PROPERTY_TITLE,      NOTIFICATION_ITEM_PROP_TITLE },
+    { PROPERTY_TOOLTIP,    NOTIFICATION_ITEM_PROP_TOOLTIP }
+};
+
 #define NOTIFICATION_ITEM_SIG_NEW_ICON               "NewIcon"
 #define NOTIFICATION_ITEM_SIG_NEW_AICON              "NewAttentionIcon"
 #define NOTIFICATION_ITEM_SIG_NEW_STATUS             "NewStatus"
@@ -64,18 +96,116 @@ static void props_cb (GObject * object, GAsyncResult * res, gpointer user_data);
 #define NOTIFICATION_ITEM_SIG_NEW_TITLE              "NewTitle"
 #define NOTIFICATION_ITEM_SIG_NEW_TOOLTIP            "NewToolTip"
 
-#define OVERRIDE_GROUP_NAME                          "Ordering Index Overrides"
 #define OVERRIDE_FILE_NAME                           "ordering-override.keyfile"
 
+/* Edits to the override files get picked up once they settle */
+#define OVERRIDE_RELOAD_DELAY                        250
+
+/* Set to 1 to keep the merged overrides in a cache file that is
+   mapped at startup instead of parsing the keyfiles */
+#define OVERRIDE_CACHE_ENV                           "AYATANA_INDICATOR_APPLICATION_OVERRIDE_CACHE"
+
+/* Property refreshes requested within this many milliseconds of
+   each other are merged into a single GetAll, but no refresh is
+   held back for longer than the maximum latency. */
+#define REFRESH_WINDOW_ENV                           "AYATANA_INDICATOR_APPLICATION_REFRESH_WINDOW"
+#define REFRESH_WINDOW_DEFAULT                       16
+#define REFRESH_MAX_LATENCY_ENV                      "AYATANA_INDICATOR_APPLICATION_REFRESH_MAX_LATENCY"
+#define REFRESH_MAX_LATENCY_DEFAULT                  100
+
+/* How many items may be validated at the same time, the others
+   wait their turn so a login burst doesn't flood the bus. */
+#define MAX_VALIDATIONS_ENV                          "AYATANA_INDICATOR_APPLICATION_MAX_VALIDATIONS"
+#define MAX_VALIDATIONS_DEFAULT                      4
+
+/* How many changes we remember so that panels can catch up
+   without getting the whole list again. */
+#define HISTORY_SIZE_ENV                             "AYATANA_INDICATOR_APPLICATION_HISTORY_SIZE"
+#define HISTORY_SIZE_DEFAULT                         256
+
+/* Each kind of item signal gets its own budget of this many per
+   second with bursts up to the given size, whatever goes over
+   waits and only the latest one gets through.  Zero turns it off. */
+#define RATE_LIMIT_ENV                               "AYATANA_INDICATOR_APPLICATION_RATE_LIMIT"
+#define RATE_LIMIT_DEFAULT                           20
+#define RATE_BURST_ENV                               "AYATANA_INDICATOR_APPLICATION_RATE_BURST"
+#define RATE_BURST_DEFAULT                           10
+
+/* Calls to an item time out after its smoothed latency plus four
+   times the smoothed variation, within these bounds in milliseconds.
+   Until it answered once it gets the D-Bus default. */
+#define CALL_TIMEOUT_MIN_ENV                         "AYATANA_INDICATOR_APPLICATION_CALL_TIMEOUT_MIN"
+#define CALL_TIMEOUT_MIN_DEFAULT                     250
+#define CALL_TIMEOUT_MAX_ENV                         "AYATANA_INDICATOR_APPLICATION_CALL_TIMEOUT_MAX"
+#define CALL_TIMEOUT_MAX_DEFAULT                     5000
+
+/* An item whose calls fail this many times in a row is left alone
+   for a while.  Each time it fails again right after, the while is
+   twice as long, up to the maximum in milliseconds.  Zero turns it
+   off. */
+#define QUARANTINE_FAILURES_ENV                      "AYATANA_INDICATOR_APPLICATION_QUARANTINE_FAILURES"
+#define QUARANTINE_FAILURES_DEFAULT                  3
+
+/* Set to a file name to record what the items tell us, so that
+   it can be played back with ayatana-indicator-application-replay */
+#define RECORD_ENV                                   "AYATANA_INDICATOR_APPLICATION_RECORD"
+
+/* We only care about names going away, so that's all the bus
+   needs to send us. */
+#define NAME_LOST_MATCH_RULE                         "type='signal',sender='org.freedesktop.DBus',interface='org.freedesktop.DBus',member='NameOwnerChanged',path='/org/freedesktop/DBus',arg2=''"
+
 /* Private Stuff */
 typedef struct {
     GCancellable * bus_cancel;
     GDBusConnection * bus;
     guint dbus_registration;
-    GList * applications;
+    guint stats_registration;
+    guint subscription_registration;
+    GSequence * applications;
+    GSequence * visible_applications;
+    GHashTable * apps_by_object;
+    GHashTable * apps_by_menu;
     GHashTable * ordering_overrides;
+    gchar * override_files[2];
+    GFileMonitor * override_monitors[2];
+    guint override_reload;
+    gboolean override_cache;
+    GHashTable * apps_by_name;
+    GDBusConnection * watch_bus;
+    guint name_watch;
+    GHashTable * apps_by_sender;
+    guint item_signals_watch;
+    guint refresh_window;
+    guint refresh_max_latency;
+    GQueue * priority_validations;
+    GQueue * pending_validations;
+    guint validations_in_flight;
+    guint max_validations;
+    gint64 burst_start;
+    gboolean burst_first_item;
+    guint rate_limit;
+    guint rate_burst;
+    CallPolicy calls;
+    Statistics stats;
+    Recording * recording;
+    Clients * clients;
+    GQueue * pending_updates;
+    guint flush_updates_idle;
+    guint64 generation;
+    GQueue * history;
+    guint history_size;
+    GVariant * snapshot; /* the visible applications, as GetApplications sends them */
+    GPtrArray * item_names; /* "busname/path" of every validated application, NULL terminated */
 } ApplicationServiceAppstorePrivate;
 
+/* A change to the list the panels see, along with the signal
+   that told them about it */
+typedef struct {
+    guint64 generation;
+    const gchar * name;
+    GVariant * params;
+} HistoryEntry;
+
 typedef enum {
     VISIBLE_STATE_HIDDEN,
     VISIBLE_STATE_SHOWN
@@ -83,18 +213,61 @@ typedef enum {
 
 #define STATE2STRING(x)  ((x) == VISIBLE_STATE_HIDDEN ? "hidden" : "visible")
 
+/* The kinds of item signals, each one is rate limited on its own */
+typedef enum {
+    SIGNAL_CLASS_ICON,
+    SIGNAL_CLASS_AICON,
+    SIGNAL_CLASS_TITLE,
+    SIGNAL_CLASS_STATUS,
+    SIGNAL_CLASS_ICON_THEME_PATH,
+    SIGNAL_CLASS_LABEL,
+    SIGNAL_CLASS_TOOLTIP,
+    SIGNAL_CLASS_COUNT
+} signal_class_t;
+
 typedef struct _Application Application;
+
+/* Token bucket for one kind of signal of an item, along with
+   the latest signal that had to wait */
+typedef struct {
+    Application * app; /* not ref'd */
+    gdouble tokens;
+    gint64 refilled_at;
+    guint timer;
+    guint handler;
+    GVariant * pending;
+    guint throttled;
+    guint received;
+} SignalBucket;
+
 struct _Application {
     gchar * id;
-    gchar * category;
+    AppIndicatorCategory category;
     gchar * dbus_name;
     gchar * dbus_object;
+    gchar * owner; /* unique name the signals come from */
     ApplicationServiceAppstore * appstore; /* not ref'd */
     GCancellable * dbus_proxy_cancel;
     GDBusProxy * dbus_proxy;
     GCancellable * props_cancel;
     gboolean queued_props;
-    GDBusProxy * props;
+    guint dirty_props;
+    gint64 registered_at;
+    gint64 props_requested_at;
+    GQueue * pending_queue;
+    GList * pending_link;
+    gboolean validating;
+    GList * menu_link;    /* in the chain of its menu in the menu index */
+    /* What the panels have been told last */
+    gchar * sent_icon;
+    gchar * sent_icon_desc;
+    gchar * sent_label;
+    gchar * sent_guide;
+    gchar * sent_title;
+    gchar * sent_tooltip_icon;
+    gchar * sent_tooltip_title;
+    gchar * sent_tooltip_description;
+    guint pending_fields;
     gboolean validated; /* Whether we've gotten all the parameters and they look good. */
     AppIndicatorStatus status;
     gchar * icon;
@@ -108,8 +281,18 @@ struct _Application {
     gchar * title;
     gboolean currently_free;
     guint ordering_index;
+    guint item_ordering_index; /* what the item asked for, zero if nothing */
     visible_state_t visible_state;
-    guint name_watcher;
+    gboolean name_watched;
+    GSequenceIter * iter;
+    GSequenceIter * visible_iter;
+    gchar * item_name; /* not owned, it's in the item names */
+    CallState calls;
+    guint refresh_timer;
+    gint64 refresh_dirty_since;
+    guint refreshes_requested;
+    guint refreshes_merged;
+    SignalBucket buckets[SIGNAL_CLASS_COUNT];
     gchar *sTooltipIcon;
     gchar *sTooltipTitle;
     gchar *sTooltipDescription;
@@ -123,6 +306,13 @@ static GDBusInterfaceVTable interface_table = {
        get_property:   NULL, /* No properties */
        set_property:   NULL  /* No properties */
 };
+static GDBusInterfaceInfo * stats_interface_info = NULL;
+static GDBusInterfaceInfo * subscription_interface_info = NULL;
+static GDBusInterfaceVTable stats_interface_table = {
+       method_call:    stats_method_call,
+       get_property:   NULL, /* No properties */
+       set_property:   NULL  /* No properties */
+};
 
 /* GObject stuff */
 static void application_service_appstore_class_init (ApplicationServiceAppstoreClass *klass);
@@ -130,17 +320,55 @@ static void application_service_appstore_init       (ApplicationServiceAppstore
 static void application_service_appstore_dispose    (GObject *object);
 static void application_service_appstore_finalize   (GObject *object);
 static gint app_sort_func (gconstpointer a, gconstpointer b, gpointer userdata);
-static void load_override_file (GHashTable * hash, const gchar * filename);
+static guint compute_ordering_index (Application * app);
+static void override_file_changed (GFileMonitor * monitor, GFile * file, GFile * other, GFileMonitorEvent event, gpointer user_data);
 static AppIndicatorStatus string_to_status(const gchar * status_string);
 static void apply_status (Application * app);
+static void set_ordering_index (Application * app, guint ordering_index);
 static AppIndicatorCategory string_to_cat(const gchar * cat_string);
+static void build_enum_tables (void);
 static Application * find_application (ApplicationServiceAppstore * appstore, const gchar * address, const gchar * object);
 static Application * find_application_by_menu (ApplicationServiceAppstore * appstore, const gchar * address, const gchar * menuobject);
 static void bus_get_cb (GObject * object, GAsyncResult * res, gpointer user_data);
 static void dbus_proxy_cb (GObject * object, GAsyncResult * res, gpointer user_data);
-static void app_receive_signal (GDBusProxy * proxy, gchar * sender_name, gchar * signal_name, GVariant * parameters, gpointer user_data);
+static void build_item_signal_index (void);
+static void throttle_clear (SignalBucket * bucket);
+static void item_signal (GDBusConnection * connection, const gchar * sender, const gchar * path, const gchar * interface, const gchar * signal, GVariant * params, gpointer user_data);
 static void get_all_properties (Application * app);
+static void schedule_refresh (Application * app, guint properties);
+static void refresh_properties (Application * app);
+static void refresh_pending (Application * app);
+static void call_done (Application * app, gint64 requested_at, const GError * error);
+static void queue_validation (Application * app);
+static void validation_done (Application * app);
+static void forget_sent_values (Application * app);
+static void snapshot_invalidate (ApplicationServiceAppstore * appstore);
+static void snapshot_changed (Application * app);
+static gboolean set_tooltip (Application * app, GVariant * value);
+static void flush_updates (ApplicationServiceAppstore * appstore);
+static void flush_updates_cb (gpointer user_data);
+static void subscribe_client (ApplicationServiceAppstore * appstore, const gchar * sender, GVariant * options);
+static void history_entry_free (gpointer data);
 static void application_free (Application * app);
+static guint app_object_hash (gconstpointer key);
+static gboolean app_object_equal (gconstpointer a, gconstpointer b);
+static guint app_menu_hash (gconstpointer key);
+static gboolean app_menu_equal (gconstpointer a, gconstpointer b);
+static void menu_index_add (Application * app);
+static void menu_index_remove (Application * app);
+static guint app_sender_hash (gconstpointer key);
+static gboolean app_sender_equal (gconstpointer a, gconstpointer b);
+static void sender_index_remove (Application * app);
+static void unwatch_app_name (Application * app);
+
+/* Signals Stuff */
+enum {
+    ITEM_REGISTERED,
+    ITEM_UNREGISTERED,
+    LAST_SIGNAL
+};
+
+static guint signals[LAST_SIGNAL] = { 0 };
 
 G_DEFINE_TYPE_WITH_PRIVATE (ApplicationServiceAppstore, application_service_appstore, G_TYPE_OBJECT);
 
@@ -152,6 +380,25 @@ application_service_appstore_class_init (ApplicationServiceAppstoreClass *klass)
     object_class->dispose = application_service_appstore_dispose;
     object_class->finalize = application_service_appstore_finalize;
 
+    build_item_signal_index();
+    build_enum_tables();
+
+    /* Signals */
+    signals[ITEM_REGISTERED] = g_signal_new ("item-registered",
+                                             G_TYPE_FROM_CLASS(klass),
+                                             G_SIGNAL_RUN_LAST,
+                                             0,
+                                             NULL, NULL,
+                                             g_cclosure_marshal_VOID__STRING,
+                                             G_TYPE_NONE, 1, G_TYPE_STRING);
+    signals[ITEM_UNREGISTERED] = g_signal_new ("item-unregistered",
+                                               G_TYPE_FROM_CLASS(klass),
+                                               G_SIGNAL_RUN_LAST,
+                                               0,
+                                               NULL, NULL,
+                                               g_cclosure_marshal_VOID__STRING,
+                                               G_TYPE_NONE, 1, G_TYPE_STRING);
+
     /* Setting up the DBus interfaces */
     if (node_info == NULL) {
         GError * error = NULL;
@@ -171,24 +418,187 @@ application_service_appstore_class_init (ApplicationServiceAppstoreClass *klass)
         }
     }
 
+    if (stats_interface_info == NULL) {
+        stats_interface_info = g_dbus_node_info_lookup_interface(node_info, INDICATOR_APPLICATION_STATS_DBUS_IFACE);
+
+        if (stats_interface_info == NULL) {
+            g_critical("Unable to find interface '" INDICATOR_APPLICATION_STATS_DBUS_IFACE "'");
+        }
+    }
+
+    if (subscription_interface_info == NULL) {
+        subscription_interface_info = g_dbus_node_info_lookup_interface(node_info, INDICATOR_APPLICATION_SUBSCRIPTION_DBUS_IFACE);
+
+        if (subscription_interface_info == NULL) {
+            g_critical("Unable to find interface '" INDICATOR_APPLICATION_SUBSCRIPTION_DBUS_IFACE "'");
+        }
+    }
+
+    return;
+}
+
+/* Adds what an item told us to the recording, if there is one */
+static void
+record_item (ApplicationServiceAppstore * appstore, const gchar * event,
+             const gchar * dbus_name, const gchar * dbus_object, GVariant * payload)
+{
+    ApplicationServiceAppstorePrivate * priv = application_service_appstore_get_instance_private(appstore);
+
+    if (priv->recording == NULL) {
+        if (payload != NULL) {
+            g_variant_unref(g_variant_ref_sink(payload));
+        }
+        return;
+    }
+
+    recording_add(priv->recording, event, dbus_name, dbus_object, payload);
+
     return;
 }
 
+/* Reads a number from the environment, falling back to the
+   default if it isn't set or doesn't parse. */
+static guint
+get_env_uint (const gchar * name, guint fallback)
+{
+    const gchar * value = g_getenv(name);
+    guint64 milliseconds = 0;
+
+    if (value == NULL) {
+        return fallback;
+    }
+
+    if (!g_ascii_string_to_unsigned(value, 10, 0, G_MAXUINT, &milliseconds, NULL)) {
+        g_warning("Ignoring invalid value '%s' for %s", value, name);
+        return fallback;
+    }
+
+    return (guint)milliseconds;
+}
+
+/* The strings of the items are interned and refcounted, as the
+   same icon names, theme paths and menus show up again and again,
+   across refreshes and across items.  Setting a field to the value
+   it already has doesn't copy anything. */
+static gboolean
+set_string (gchar ** field, const gchar * value)
+{
+    if (*field == value || (*field != NULL && value != NULL && g_strcmp0(*field, value) == 0)) {
+        return FALSE;
+    }
+
+    gchar * old = *field;
+    *field = (value != NULL) ? g_ref_string_new_intern(value) : NULL;
+
+    if (old != NULL) {
+        g_ref_string_release(old);
+    }
+
+    return TRUE;
+}
+
+static void
+clear_string (gchar ** field)
+{
+    g_clear_pointer(field, g_ref_string_release);
+}
+
 static void
 application_service_appstore_init (ApplicationServiceAppstore *self)
 {
     ApplicationServiceAppstorePrivate * priv = application_service_appstore_get_instance_private(self);
 
-    priv->applications = NULL;
+    /* Both are kept sorted by ordering index, the visible one only
+       holds the applications that are on the panel so that an
+       application's position is its rank in that sequence. */
+    priv->applications = g_sequence_new(NULL);
+    priv->visible_applications = g_sequence_new(NULL);
+    priv->item_names = g_ptr_array_new_with_free_func(g_free);
+    g_ptr_array_add(priv->item_names, NULL);
     priv->bus_cancel = NULL;
     priv->dbus_registration = 0;
+    priv->stats_registration = 0;
+    priv->subscription_registration = 0;
+
+    /* Both indexes use the Application as key and value, so
+       lookups don't need to allocate a key */
+    priv->apps_by_object = g_hash_table_new(app_object_hash, app_object_equal);
+    priv->apps_by_menu = g_hash_table_new_full(app_menu_hash, app_menu_equal, NULL, (GDestroyNotify)g_queue_free);
+
+    /* Bus name to the list of apps on it, all watched through
+       one subscription */
+    priv->apps_by_name = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+    priv->watch_bus = NULL;
+    priv->name_watch = 0;
+
+    /* Item signals come in through one subscription and get
+       routed by their sender and path */
+    priv->apps_by_sender = g_hash_table_new(app_sender_hash, app_sender_equal);
+    priv->item_signals_watch = 0;
+
+    priv->refresh_window = get_env_uint(REFRESH_WINDOW_ENV, REFRESH_WINDOW_DEFAULT);
+    priv->refresh_max_latency = get_env_uint(REFRESH_MAX_LATENCY_ENV, REFRESH_MAX_LATENCY_DEFAULT);
+
+    priv->priority_validations = g_queue_new();
+    priv->pending_validations = g_queue_new();
+    priv->validations_in_flight = 0;
+    priv->max_validations = MAX(get_env_uint(MAX_VALIDATIONS_ENV, MAX_VALIDATIONS_DEFAULT), 1);
+    priv->burst_start = 0;
+    priv->burst_first_item = FALSE;
+    priv->rate_limit = get_env_uint(RATE_LIMIT_ENV, RATE_LIMIT_DEFAULT);
+    priv->rate_burst = MAX(get_env_uint(RATE_BURST_ENV, RATE_BURST_DEFAULT), 1);
+    call_policy_init(&priv->calls,
+                     get_env_uint(CALL_TIMEOUT_MIN_ENV, CALL_TIMEOUT_MIN_DEFAULT),
+                     get_env_uint(CALL_TIMEOUT_MAX_ENV, CALL_TIMEOUT_MAX_DEFAULT),
+                     get_env_uint(QUARANTINE_FAILURES_ENV, QUARANTINE_FAILURES_DEFAULT));
+
+    statistics_init(&priv->stats);
+
+    priv->recording = NULL;
+    const gchar * record = g_getenv(RECORD_ENV);
+    if (record != NULL && record[0] != '\0') {
+        GError * error = NULL;
+
+        priv->recording = recording_new(record, &error);
+        if (error != NULL) {
+            g_warning("Unable to record items: %s", error->message);
+            g_error_free(error);
+        }
+    }
+
+    priv->clients = clients_new(flush_updates_cb, self);
+    priv->pending_updates = g_queue_new();
+    priv->flush_updates_idle = 0;
 
-    priv->ordering_overrides = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+    priv->generation = 0;
+    priv->history = g_queue_new();
+    priv->history_size = get_env_uint(HISTORY_SIZE_ENV, HISTORY_SIZE_DEFAULT);
 
-    load_override_file(priv->ordering_overrides, DATADIR "/" OVERRIDE_FILE_NAME);
-    gchar * userfile = g_build_filename(g_get_user_data_dir(), "indicators", "application", OVERRIDE_FILE_NAME, NULL);
-    load_override_file(priv->ordering_overrides, userfile);
-    g_free(userfile);
+    priv->snapshot = NULL;
+
+    /* The user's file comes last so that it wins */
+    priv->override_files[0] = g_strdup(DATADIR "/" OVERRIDE_FILE_NAME);
+    priv->override_files[1] = g_build_filename(g_get_user_data_dir(), "indicators", "application", OVERRIDE_FILE_NAME, NULL);
+    priv->override_cache = (get_env_uint(OVERRIDE_CACHE_ENV, 0) != 0);
+    priv->override_reload = 0;
+
+    priv->ordering_overrides = overrides_load(priv->override_files, G_N_ELEMENTS(priv->override_files), priv->override_cache);
+
+    guint i;
+    for (i = 0; i < G_N_ELEMENTS(priv->override_files); i++) {
+        GFile * file = g_file_new_for_path(priv->override_files[i]);
+        GError * error = NULL;
+
+        priv->override_monitors[i] = g_file_monitor_file(file, G_FILE_MONITOR_WATCH_MOVES, NULL, &error);
+        if (error != NULL) {
+            g_debug("Unable to watch override file '%s': %s", priv->override_files[i], error->message);
+            g_error_free(error);
+        } else {
+            g_signal_connect(priv->override_monitors[i], "changed", G_CALLBACK(override_file_changed), self);
+        }
+
+        g_object_unref(file);
+    }
 
     priv->bus_cancel = g_cancellable_new();
     g_bus_get(G_BUS_TYPE_SESSION,
@@ -236,6 +646,35 @@ bus_get_cb (GObject * object, GAsyncResult * res, gpointer user_data)
         return;
     }
 
+    priv->stats_registration = g_dbus_connection_register_object(priv->bus,
+                                                                 INDICATOR_APPLICATION_DBUS_OBJ,
+                                                                 stats_interface_info,
+                                                                 &stats_interface_table,
+                                                                 user_data,
+                                                                 NULL,
+                                                                 &error);
+
+    if (error != NULL) {
+        g_warning("Unable to register the statistics to DBus: %s", error->message);
+        g_error_free(error);
+        return;
+    }
+
+    /* Only signals on this one, it's there so they can be introspected */
+    priv->subscription_registration = g_dbus_connection_register_object(priv->bus,
+                                                                        INDICATOR_APPLICATION_DBUS_OBJ,
+                                                                        subscription_interface_info,
+                                                                        NULL,
+                                                                        user_data,
+                                                                        NULL,
+                                                                        &error);
+
+    if (error != NULL) {
+        g_warning("Unable to register the subscription signals to DBus: %s", error->message);
+        g_error_free(error);
+        return;
+    }
+
     return;
 }
 
@@ -248,13 +687,35 @@ bus_method_call (GDBusConnection * connection, const gchar * sender,
                  GDBusMethodInvocation * invocation, gpointer user_data)
 {
     ApplicationServiceAppstore * service = APPLICATION_SERVICE_APPSTORE(user_data);
+    ApplicationServiceAppstorePrivate * priv = application_service_appstore_get_instance_private(service);
     GVariant * retval = NULL;
     Application *app = NULL;
     gchar *dbusaddress = NULL;
     gchar *dbusmenuobject = NULL;
 
     if (g_strcmp0(method, "GetApplications") == 0) {
-        retval = get_applications(service);
+        /* Clients that don't tell us otherwise get the old signals */
+        clients_register(priv->clients, priv->bus, sender, 0);
+        retval = get_applications(service, sender);
+    } else if (g_strcmp0(method, "GetApplicationsSince") == 0) {
+        guint64 since = 0;
+
+        g_variant_get (params, "(t)", &since);
+        clients_register(priv->clients, priv->bus, sender, 0);
+        retval = get_applications_since(service, sender, since);
+    } else if (g_strcmp0(method, "Subscribe") == 0) {
+        GVariant * options = NULL;
+
+        g_variant_get (params, "(@a{sv})", &options);
+        clients_register(priv->clients, priv->bus, sender, 0);
+        subscribe_client(service, sender, options);
+        g_variant_unref(options);
+    } else if (g_strcmp0(method, "SetProtocolVersion") == 0) {
+        gint version = 0;
+
+        g_variant_get (params, "(i)", &version);
+        clients_register(priv->clients, priv->bus, sender, version);
+        retval = g_variant_new("(i)", INDICATOR_APPLICATION_SERVICE_VERSION);
     } else if (g_strcmp0(method, "ApplicationScrollEvent") == 0) {
         gchar *orientation = NULL;
         gint delta;
@@ -287,10 +748,13 @@ bus_method_call (GDBusConnection * connection, const gchar * sender,
 
         app = find_application_by_menu(service, dbusaddress, dbusmenuobject);
 
-        if (app != NULL && app->dbus_proxy != NULL && orientation != NULL) {
+        /* No point in piling up events on an item that doesn't answer */
+        if (app != NULL && call_state_quarantined(&app->calls)) {
+            g_debug("Dropping scroll event for %s%s, it isn't answering", app->dbus_name, app->dbus_object);
+        } else if (app != NULL && app->dbus_proxy != NULL && orientation != NULL) {
             g_dbus_proxy_call(app->dbus_proxy, "Scroll",
                               g_variant_new("(is)", delta, orientation),
-                              G_DBUS_CALL_FLAGS_NONE, -1, NULL, NULL, NULL);
+                              G_DBUS_CALL_FLAGS_NONE, call_state_timeout(&app->calls), NULL, NULL, NULL);
         }
     } else if (g_strcmp0(method, "ApplicationSecondaryActivateEvent") == 0) {
         guint time;
@@ -298,10 +762,12 @@ bus_method_call (GDBusConnection * connection, const gchar * sender,
         g_variant_get (params, "(ssu)", &dbusaddress, &dbusmenuobject, &time);
         app = find_application_by_menu(service, dbusaddress, dbusmenuobject);
 
-        if (app != NULL && app->dbus_proxy != NULL) {
+        if (app != NULL && call_state_quarantined(&app->calls)) {
+            g_debug("Dropping secondary activate event for %s%s, it isn't answering", app->dbus_name, app->dbus_object);
+        } else if (app != NULL && app->dbus_proxy != NULL) {
             g_dbus_proxy_call(app->dbus_proxy, "XAyatanaSecondaryActivate",
                               g_variant_new("(u)", time),
-                              G_DBUS_CALL_FLAGS_NONE, -1, NULL, NULL, NULL);
+                              G_DBUS_CALL_FLAGS_NONE, call_state_timeout(&app->calls), NULL, NULL, NULL);
         }
     } else {
         g_warning("Calling method '%s' on the indicator service and it's unknown", method);
@@ -314,15 +780,170 @@ bus_method_call (GDBusConnection * connection, const gchar * sender,
     return;
 }
 
+/* Roughly what an item costs us.  Interned strings are shared
+   with other items, but they're counted in full. */
+static guint64
+application_memory (Application * app)
+{
+    gchar * strings[] = {
+        app->id, app->dbus_name, app->dbus_object, app->owner,
+        app->icon, app->icon_desc, app->aicon, app->aicon_desc,
+        app->menu, app->icon_theme_path, app->label, app->guide, app->title,
+        app->sTooltipIcon, app->sTooltipTitle, app->sTooltipDescription
+    };
+    guint64 size = sizeof(Application);
+    guint i;
+
+    for (i = 0; i < G_N_ELEMENTS(strings); i++) {
+        if (strings[i] != NULL) {
+            size += strlen(strings[i]) + 1;
+        }
+    }
+
+    for (i = 0; i < SIGNAL_CLASS_COUNT; i++) {
+        if (app->buckets[i].pending != NULL) {
+            size += g_variant_get_size(app->buckets[i].pending);
+        }
+    }
+
+    return size;
+}
+
+/* Puts everything we count together, only done when asked
+   so keeping the counts costs no more than the increments */
+static GVariant *
+get_statistics (ApplicationServiceAppstore * appstore)
+{
+    ApplicationServiceAppstorePrivate * priv = application_service_appstore_get_instance_private(appstore);
+    GVariantBuilder counters;
+    GVariantBuilder histograms;
+    GVariantBuilder items;
+
+    g_variant_builder_init(&counters, G_VARIANT_TYPE("a{st}"));
+    statistics_add_counters(&priv->stats, &counters);
+    call_policy_add_counters(&priv->calls, &counters);
+    g_variant_builder_add(&counters, "{st}", "generation", priv->generation);
+    g_variant_builder_add(&counters, "{st}", "applications", (guint64)g_sequence_get_length(priv->applications));
+    g_variant_builder_add(&counters, "{st}", "visible-applications", (guint64)g_sequence_get_length(priv->visible_applications));
+    g_variant_builder_add(&counters, "{st}", "clients", (guint64)clients_count(priv->clients));
+    g_variant_builder_add(&counters, "{st}", "subscribed-clients", (guint64)clients_subscribed(priv->clients));
+    g_variant_builder_add(&counters, "{st}", "history", (guint64)g_queue_get_length(priv->history));
+    g_variant_builder_add(&counters, "{st}", "pending-updates", (guint64)g_queue_get_length(priv->pending_updates));
+    g_variant_builder_add(&counters, "{st}", "validations-in-flight", (guint64)priv->validations_in_flight);
+    g_variant_builder_add(&counters, "{st}", "validations-waiting",
+                          (guint64)(g_queue_get_length(priv->priority_validations) + g_queue_get_length(priv->pending_validations)));
+
+    g_variant_builder_init(&histograms, G_VARIANT_TYPE("a{s(atat)}"));
+    statistics_add_histograms(&priv->stats, &histograms);
+
+    g_variant_builder_init(&items, G_VARIANT_TYPE("a(ssa{st})"));
+
+    guint64 quarantined = 0;
+    GSequenceIter * iter;
+    for (iter = g_sequence_get_begin_iter(priv->applications); !g_sequence_iter_is_end(iter); iter = g_sequence_iter_next(iter)) {
+        Application * app = (Application *)g_sequence_get(iter);
+        GVariantBuilder item;
+        guint64 received = 0, throttled = 0;
+        guint i;
+
+        for (i = 0; i < SIGNAL_CLASS_COUNT; i++) {
+            received += app->buckets[i].received;
+            throttled += app->buckets[i].throttled;
+        }
+
+        g_variant_builder_init(&item, G_VARIANT_TYPE("a{st}"));
+        g_variant_builder_add(&item, "{st}", "signals-received", received);
+        g_variant_builder_add(&item, "{st}", "signals-throttled", throttled);
+        g_variant_builder_add(&item, "{st}", "refreshes-requested", (guint64)app->refreshes_requested);
+        g_variant_builder_add(&item, "{st}", "refreshes-merged", (guint64)app->refreshes_merged);
+        g_variant_builder_add(&item, "{st}", "memory", application_memory(app));
+        call_state_add_counters(&app->calls, &item);
+
+        if (call_state_quarantined(&app->calls)) {
+            quarantined++;
+        }
+
+        g_variant_builder_add(&items, "(ssa{st})", app->dbus_name, app->dbus_object, &item);
+    }
+
+    g_variant_builder_add(&counters, "{st}", "quarantined", quarantined);
+
+    return g_variant_new("(a{st}a{s(atat)}a(ssa{st}))", &counters, &histograms, &items);
+}
+
+static void
+stats_method_call (GDBusConnection * connection, const gchar * sender,
+                   const gchar * path, const gchar * interface,
+                   const gchar * method, GVariant * params,
+                   GDBusMethodInvocation * invocation, gpointer user_data)
+{
+    if (g_strcmp0(method, "GetStatistics") == 0) {
+        g_dbus_method_invocation_return_value(invocation, get_statistics(APPLICATION_SERVICE_APPSTORE(user_data)));
+        return;
+    }
+
+    g_dbus_method_invocation_return_error(invocation, G_DBUS_ERROR, G_DBUS_ERROR_UNKNOWN_METHOD,
+                                          "Unknown method '%s'", method);
+
+    return;
+}
+
 static void
 application_service_appstore_dispose (GObject *object)
 {
     ApplicationServiceAppstorePrivate * priv = application_service_appstore_get_instance_private(APPLICATION_SERVICE_APPSTORE(object));
 
-    while (priv->applications != NULL) {
+    while (priv->applications != NULL && !g_sequence_is_empty(priv->applications)) {
+        Application * app = (Application *)g_sequence_get(g_sequence_get_begin_iter(priv->applications));
         application_service_appstore_application_remove(APPLICATION_SERVICE_APPSTORE(object),
-                                                   ((Application *)priv->applications->data)->dbus_name,
-                                                   ((Application *)priv->applications->data)->dbus_object);
+                                                   app->dbus_name,
+                                                   app->dbus_object);
+    }
+
+    if (priv->flush_updates_idle != 0) {
+        g_source_remove(priv->flush_updates_idle);
+        priv->flush_updates_idle = 0;
+    }
+
+    if (priv->clients != NULL) {
+        clients_clear(priv->clients);
+    }
+
+    if (priv->name_watch != 0) {
+        g_dbus_connection_signal_unsubscribe(priv->watch_bus, priv->name_watch);
+        g_dbus_connection_call(priv->watch_bus,
+                               "org.freedesktop.DBus",
+                               "/org/freedesktop/DBus",
+                               "org.freedesktop.DBus",
+                               "RemoveMatch",
+                               g_variant_new("(s)", NAME_LOST_MATCH_RULE),
+                               NULL, G_DBUS_CALL_FLAGS_NONE, -1,
+                               NULL, NULL, NULL);
+        priv->name_watch = 0;
+    }
+
+    if (priv->item_signals_watch != 0) {
+        g_dbus_connection_signal_unsubscribe(priv->watch_bus, priv->item_signals_watch);
+        priv->item_signals_watch = 0;
+    }
+
+    if (priv->watch_bus != NULL) {
+        g_object_unref(priv->watch_bus);
+        priv->watch_bus = NULL;
+    }
+
+    if (priv->override_reload != 0) {
+        g_source_remove(priv->override_reload);
+        priv->override_reload = 0;
+    }
+
+    guint i;
+    for (i = 0; i < G_N_ELEMENTS(priv->override_monitors); i++) {
+        if (priv->override_monitors[i] != NULL) {
+            g_signal_handlers_disconnect_by_data(priv->override_monitors[i], object);
+            g_file_monitor_cancel(priv->override_monitors[i]);
+            g_clear_object(&priv->override_monitors[i]);
+        }
     }
 
     if (priv->dbus_registration != 0) {
@@ -331,6 +952,16 @@ application_service_appstore_dispose (GObject *object)
         priv->dbus_registration = 0;
     }
 
+    if (priv->stats_registration != 0) {
+        g_dbus_connection_unregister_object(priv->bus, priv->stats_registration);
+        priv->stats_registration = 0;
+    }
+
+    if (priv->subscription_registration != 0) {
+        g_dbus_connection_unregister_object(priv->bus, priv->subscription_registration);
+        priv->subscription_registration = 0;
+    }
+
     if (priv->bus != NULL) {
         g_object_unref(priv->bus);
         priv->bus = NULL;
@@ -356,62 +987,148 @@ application_service_appstore_finalize (GObject *object)
         priv->ordering_overrides = NULL;
     }
 
+    g_clear_pointer(&priv->override_files[0], g_free);
+    g_clear_pointer(&priv->override_files[1], g_free);
+
+    statistics_clear(&priv->stats);
+
+    g_clear_pointer(&priv->recording, recording_free);
+    g_clear_pointer(&priv->snapshot, g_variant_unref);
+    g_clear_pointer(&priv->item_names, g_ptr_array_unref);
+
+    g_clear_pointer(&priv->clients, clients_free);
+
+    if (priv->pending_updates != NULL) {
+        g_queue_free(priv->pending_updates);
+        priv->pending_updates = NULL;
+    }
+
+    if (priv->history != NULL) {
+        g_queue_free_full(priv->history, history_entry_free);
+        priv->history = NULL;
+    }
+
+    if (priv->priority_validations != NULL) {
+        g_queue_free(priv->priority_validations);
+        priv->priority_validations = NULL;
+    }
+
+    if (priv->pending_validations != NULL) {
+        g_queue_free(priv->pending_validations);
+        priv->pending_validations = NULL;
+    }
+
+    if (priv->apps_by_object != NULL) {
+        g_hash_table_destroy(priv->apps_by_object);
+        priv->apps_by_object = NULL;
+    }
+
+    if (priv->apps_by_menu != NULL) {
+        g_hash_table_destroy(priv->apps_by_menu);
+        priv->apps_by_menu = NULL;
+    }
+
+    if (priv->apps_by_name != NULL) {
+        g_hash_table_destroy(priv->apps_by_name);
+        priv->apps_by_name = NULL;
+    }
+
+    if (priv->apps_by_sender != NULL) {
+        g_hash_table_destroy(priv->apps_by_sender);
+        priv->apps_by_sender = NULL;
+    }
+
+    if (priv->visible_applications != NULL) {
+        g_sequence_free(priv->visible_applications);
+        priv->visible_applications = NULL;
+    }
+
+    if (priv->applications != NULL) {
+        g_sequence_free(priv->applications);
+        priv->applications = NULL;
+    }
+
     G_OBJECT_CLASS (application_service_appstore_parent_class)->finalize (object);
     return;
 }
 
-/* Loads the file and adds the override entries to the table
-   of overrides */
-static void
-load_override_file (GHashTable * hash, const gchar * filename)
+/* The override wins, then what the item asked for, and if
+   there's neither we make one up from its category and ID. */
+static guint
+compute_ordering_index (Application * app)
 {
-    g_return_if_fail(hash != NULL);
-    g_return_if_fail(filename != NULL);
+    ApplicationServiceAppstorePrivate * priv = application_service_appstore_get_instance_private(app->appstore);
 
-    if (!g_file_test(filename, G_FILE_TEST_EXISTS)) {
-        g_debug("Override file '%s' doesn't exist", filename);
-        return;
+    gpointer ordering_index_over = g_hash_table_lookup(priv->ordering_overrides, app->id);
+    if (ordering_index_over != NULL) {
+        return (guint)GPOINTER_TO_INT(ordering_index_over);
     }
 
-    g_debug("Loading overrides from: '%s'", filename);
+    if (app->item_ordering_index != 0) {
+        return app->item_ordering_index;
+    }
 
-    GError * error = NULL;
-    GKeyFile * keyfile = g_key_file_new();
-    g_key_file_load_from_file(keyfile, filename, G_KEY_FILE_NONE, &error);
+    return generate_id(app->category, app->id);
+}
 
-    if (error != NULL) {
-        g_warning("Unable to load keyfile '%s' because: %s", filename, error->message);
-        g_error_free(error);
-        g_key_file_free(keyfile);
-        return;
-    }
+/* Loads the overrides again and moves the apps whose
+   override changed, the others stay where they are. */
+static gboolean
+reload_overrides (gpointer user_data)
+{
+    ApplicationServiceAppstore * appstore = APPLICATION_SERVICE_APPSTORE(user_data);
+    ApplicationServiceAppstorePrivate * priv = application_service_appstore_get_instance_private(appstore);
 
-    gchar ** keys = g_key_file_get_keys(keyfile, OVERRIDE_GROUP_NAME, NULL, &error);
-    if (error != NULL) {
-        g_warning("Unable to get keys from keyfile '%s' because: %s", filename, error->message);
-        g_error_free(error);
-        g_key_file_free(keyfile);
-        return;
-    }
+    priv->override_reload = 0;
+
+    g_debug("Reloading ordering overrides");
 
-    gchar * key;
-    gint i;
+    GHashTable * old = priv->ordering_overrides;
+    priv->ordering_overrides = overrides_load(priv->override_files, G_N_ELEMENTS(priv->override_files), priv->override_cache);
 
-    for (i = 0; (key = keys[i]) != NULL; i++) {
-        GError * valerror = NULL;
-        gint val = g_key_file_get_integer(keyfile, OVERRIDE_GROUP_NAME, key, &valerror);
+    /* Moving apps changes the sequence, so find them first */
+    GList * changed = NULL;
+    GSequenceIter * iter;
+    for (iter = g_sequence_get_begin_iter(priv->applications); !g_sequence_iter_is_end(iter); iter = g_sequence_iter_next(iter)) {
+        Application * app = (Application *)g_sequence_get(iter);
 
-        if (valerror != NULL) {
-            g_warning("Unable to get key '%s' out of file '%s' because: %s", key, filename, valerror->message);
-            g_error_free(valerror);
+        if (!app->validated || app->id == NULL) {
             continue;
         }
-        g_debug("%s: override '%s' with value '%d'", filename, key, val);
 
-        g_hash_table_insert(hash, g_strdup(key), GINT_TO_POINTER(val));
+        if (g_hash_table_lookup(old, app->id) != g_hash_table_lookup(priv->ordering_overrides, app->id)) {
+            changed = g_list_prepend(changed, app);
+        }
+    }
+
+    GList * link;
+    for (link = changed; link != NULL; link = link->next) {
+        Application * app = (Application *)link->data;
+        set_ordering_index(app, compute_ordering_index(app));
+    }
+
+    g_list_free(changed);
+    g_hash_table_destroy(old);
+
+    return G_SOURCE_REMOVE;
+}
+
+/* One of the override files changed, editors tend to do that in
+   a few steps, so wait for it to settle. */
+static void
+override_file_changed (GFileMonitor * monitor, GFile * file, GFile * other, GFileMonitorEvent event, gpointer user_data)
+{
+    ApplicationServiceAppstorePrivate * priv = application_service_appstore_get_instance_private(APPLICATION_SERVICE_APPSTORE(user_data));
+
+    if (event == G_FILE_MONITOR_EVENT_ATTRIBUTE_CHANGED) {
+        return;
+    }
+
+    if (priv->override_reload != 0) {
+        g_source_remove(priv->override_reload);
     }
-    g_strfreev(keys);
-    g_key_file_free(keyfile);
+
+    priv->override_reload = g_timeout_add(OVERRIDE_RELOAD_DELAY, reload_overrides, user_data);
 
     return;
 }
@@ -434,7 +1151,7 @@ got_all_properties (GObject * source_object, GAsyncResult * res,
              * guide = NULL, * title = NULL;
     GVariant *pTooltip = NULL;
 
-    GVariant * properties = g_dbus_proxy_call_finish(G_DBUS_PROXY(source_object), res, &error);
+    GVariant * properties = g_dbus_connection_call_finish(G_DBUS_CONNECTION(source_object), res, &error);
 
     if (g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
         g_error_free (error);
@@ -446,15 +1163,41 @@ got_all_properties (GObject * source_object, GAsyncResult * res,
         app->props_cancel = NULL;
     }
 
+    ApplicationServiceAppstorePrivate * priv = application_service_appstore_get_instance_private(app->appstore);
+
+    histogram_add(&priv->stats.getall_latency, g_get_monotonic_time() - app->props_requested_at);
+    TRACE(got_all_properties, app->dbus_name, app->dbus_object, TRACE_STR(app->id), g_get_monotonic_time(), error != NULL);
+    call_done(app, app->props_requested_at, error);
+
     if (error != NULL) {
-        g_critical("Could not grab DBus properties for %s: %s", app->dbus_name, error->message);
-        g_error_free(error);
-        if (!app->validated)
+        priv->stats.getall_errors++;
+
+        if (!app->validated) {
+            g_critical("Could not grab DBus properties for %s: %s", app->dbus_name, error->message);
+            g_error_free(error);
             application_free(app);
+            return;
+        }
+
+        /* An item we already show keeps what it had.  What it never
+           answered gets asked again, the quarantine spaces that out
+           if it keeps quiet, but an error of its own would only come
+           back the same. */
+        if (call_answered(error)) {
+            g_warning("Could not refresh DBus properties for %s: %s", app->dbus_name, error->message);
+        } else {
+            g_debug("No answer refreshing DBus properties for %s: %s", app->dbus_name, error->message);
+            app->dirty_props = PROPERTY_ALL;
+        }
+        g_error_free(error);
+
+        refresh_pending(app);
         return;
     }
 
-    ApplicationServiceAppstorePrivate * priv = application_service_appstore_get_instance_private(app->appstore);
+    GVariant * dict = g_variant_get_child_value(properties, 0);
+    record_item(app->appstore, RECORDING_EVENT_PROPERTIES, app->dbus_name, app->dbus_object, dict);
+    g_variant_unref(dict);
 
     /* Grab all properties from variant */
     GVariantIter * iter = NULL;
@@ -503,111 +1246,70 @@ got_all_properties (GObject * source_object, GAsyncResult * res,
         g_warning("Notification Item on object %s of %s doesn't have enough properties.", app->dbus_object, app->dbus_name);
         if (!app->validated)
             application_free(app);
+        else
+            refresh_pending(app);
     }
     else {
+        gboolean newly_validated = !app->validated;
+        if (newly_validated) {
+            g_debug("'%s' validated %" G_GINT64_FORMAT "us after registering", g_variant_get_string(id, NULL), g_get_monotonic_time() - app->registered_at);
+        }
         app->validated = TRUE;
+        validation_done(app);
 
         /* It is possible we're coming through a second time and
-           getting the properties.  So we need to ensure we don't
-           already have them stored */
-        g_free(app->id);
-        g_free(app->category);
-        g_free(app->icon);
-        g_free(app->menu);
-
-        app->id = g_variant_dup_string(id, NULL);
-        app->category = g_variant_dup_string(category, NULL);
-        app->status = string_to_status(g_variant_get_string(status, NULL));
-        app->icon = g_variant_dup_string(icon_name, NULL);
-        app->menu = g_variant_dup_string(menu, NULL);
-
-        /* Now the optional properties */
-
-        g_free(app->icon_desc);
-        if (icon_desc != NULL) {
-            app->icon_desc = g_variant_dup_string(icon_desc, NULL);
-        }
-        else {
-            app->icon_desc = g_strdup("");
-        }
-
-        g_free(app->aicon);
-        if (aicon_name != NULL) {
-            app->aicon = g_variant_dup_string(aicon_name, NULL);
-        } else {
-            app->aicon = g_strdup("");
-        }
-
-        g_free(app->aicon_desc);
-        if (aicon_desc != NULL) {
-            app->aicon_desc = g_variant_dup_string(aicon_desc, NULL);
-        }
-        else {
-            app->aicon_desc = g_strdup("");
-        }
-
-        g_free(app->icon_theme_path);
-        if (icon_theme_path != NULL) {
-            app->icon_theme_path = g_variant_dup_string(icon_theme_path, NULL);
-        } else {
-            app->icon_theme_path = g_strdup("");
-        }
-
-        gpointer ordering_index_over = g_hash_table_lookup(priv->ordering_overrides, app->id);
-        if (ordering_index_over == NULL) {
-            if (index == NULL || g_variant_get_uint32(index) == 0) {
-                app->ordering_index = generate_id(string_to_cat(app->category), app->id);
-            } else {
-                app->ordering_index = g_variant_get_uint32(index);
-            }
-        } else {
-            app->ordering_index = GPOINTER_TO_UINT(ordering_index_over);
-        }
-        g_debug("'%s' ordering index is '%X'", app->id, app->ordering_index);
-        priv->applications = g_list_sort_with_data(priv->applications, app_sort_func, NULL);
-
-        g_free(app->label);
-        if (label != NULL) {
-            app->label = g_variant_dup_string(label, NULL);
-        } else {
-            app->label = g_strdup("");
-        }
+           getting the properties.  Fields that didn't change are
+           left alone, and the snapshot only gets rebuilt if one
+           of them did. */
+        gboolean changed = FALSE;
 
-        g_free(app->guide);
-        if (guide != NULL) {
-            app->guide = g_variant_dup_string(guide, NULL);
-        } else {
-            app->guide = g_strdup("");
-        }
-
-        g_free(app->title);
-        if (title != NULL) {
-            app->title = g_variant_dup_string(title, NULL);
-        } else {
-            app->title = g_strdup("");
+        changed = set_string(&app->id, g_variant_get_string(id, NULL)) || changed;
+        app->category = string_to_cat(g_variant_get_string(category, NULL));
+        app->status = string_to_status(g_variant_get_string(status, NULL));
+        changed = set_string(&app->icon, g_variant_get_string(icon_name, NULL)) || changed;
+
+        /* The menu index is keyed on the menu path, so it has to
+           be taken out before the path changes */
+        if (g_strcmp0(app->menu, g_variant_get_string(menu, NULL)) != 0) {
+            menu_index_remove(app);
+            set_string(&app->menu, g_variant_get_string(menu, NULL));
+            menu_index_add(app);
+            changed = TRUE;
         }
 
-        g_free (app->sTooltipIcon);
-        g_free (app->sTooltipTitle);
-        g_free (app->sTooltipDescription);
-
-        if (pTooltip != NULL)
-        {
-            g_variant_get (pTooltip, "(sa(iiay)ss)", &app->sTooltipIcon, NULL, &app->sTooltipTitle, &app->sTooltipDescription);
-        }
-        else
-        {
-            app->sTooltipIcon = g_strdup ("");
-            app->sTooltipTitle = g_strdup ("");
-            app->sTooltipDescription = g_strdup ("");
+        /* Now the optional properties */
+        changed = set_string(&app->icon_desc, icon_desc != NULL ? g_variant_get_string(icon_desc, NULL) : "") || changed;
+        changed = set_string(&app->aicon, aicon_name != NULL ? g_variant_get_string(aicon_name, NULL) : "") || changed;
+        changed = set_string(&app->aicon_desc, aicon_desc != NULL ? g_variant_get_string(aicon_desc, NULL) : "") || changed;
+        changed = set_string(&app->icon_theme_path, icon_theme_path != NULL ? g_variant_get_string(icon_theme_path, NULL) : "") || changed;
+
+        app->item_ordering_index = (index != NULL) ? g_variant_get_uint32(index) : 0;
+        guint ordering_index = compute_ordering_index(app);
+        g_debug("'%s' ordering index is '%X'", app->id, ordering_index);
+        set_ordering_index(app, ordering_index);
+
+        changed = set_string(&app->label, label != NULL ? g_variant_get_string(label, NULL) : "") || changed;
+        changed = set_string(&app->guide, guide != NULL ? g_variant_get_string(guide, NULL) : "") || changed;
+        changed = set_string(&app->title, title != NULL ? g_variant_get_string(title, NULL) : "") || changed;
+        changed = set_tooltip(app, pTooltip) || changed;
+
+        if (changed) {
+            snapshot_changed(app);
         }
 
         apply_status(app);
 
-        if (app->queued_props) {
-            get_all_properties(app);
-            app->queued_props = FALSE;
+        /* Hosts only hear of items that turned out to be real.  The
+           name goes in place of the terminating NULL, which moves
+           along. */
+        if (newly_validated) {
+            app->item_name = g_strdup_printf("%s%s", app->dbus_name, app->dbus_object);
+            g_ptr_array_index(priv->item_names, priv->item_names->len - 1) = app->item_name;
+            g_ptr_array_add(priv->item_names, NULL);
+            g_signal_emit(app->appstore, signals[ITEM_REGISTERED], 0, app->item_name);
         }
+
+        refresh_pending(app);
     }
 
     if (menu)            g_variant_unref (menu);
@@ -632,233 +1334,1136 @@ got_all_properties (GObject * source_object, GAsyncResult * res,
     return;
 }
 
+/* Starts validating the next waiting items, the ones that have
+   an ordering override first, as long as there is room for them. */
 static void
-get_all_properties (Application * app)
+start_validations (ApplicationServiceAppstore * appstore)
 {
-    if (app->props != NULL && app->props_cancel == NULL) {
-        app->props_cancel = g_cancellable_new();
-        g_dbus_proxy_call(app->props, "GetAll",
-                          g_variant_new("(s)", NOTIFICATION_ITEM_DBUS_IFACE),
-                          G_DBUS_CALL_FLAGS_NONE, -1, app->props_cancel,
-                          got_all_properties, app);
-    }
-    else {
-        g_debug("Queuing a properties check");
-        app->queued_props = TRUE;
-    }
-}
+    ApplicationServiceAppstorePrivate * priv = application_service_appstore_get_instance_private(appstore);
 
-/* Simple translation function -- could be optimized */
-static AppIndicatorStatus
-string_to_status(const gchar * status_string)
-{
-    GEnumClass * klass = G_ENUM_CLASS(g_type_class_ref(APP_INDICATOR_TYPE_INDICATOR_STATUS));
-    g_return_val_if_fail(klass != NULL, APP_INDICATOR_STATUS_PASSIVE);
+    while (priv->validations_in_flight < priv->max_validations) {
+        Application * app = g_queue_pop_head(priv->priority_validations);
 
-    AppIndicatorStatus retval = APP_INDICATOR_STATUS_PASSIVE;
+        if (app == NULL) {
+            app = g_queue_pop_head(priv->pending_validations);
+        }
+
+        if (app == NULL) {
+            break;
+        }
+
+        app->pending_queue = NULL;
+        app->pending_link = NULL;
+        app->validating = TRUE;
+        priv->validations_in_flight++;
+
+        get_all_properties(app);
+    }
+
+    if (priv->validations_in_flight == 0 && priv->burst_start != 0) {
+        priv->stats.time_to_all_items = g_get_monotonic_time() - priv->burst_start;
+        priv->burst_start = 0;
+        g_debug("All items of the registration burst done after %" G_GINT64_FORMAT "us", priv->stats.time_to_all_items);
+    }
+
+    return;
+}
+
+/* Puts a newly registered item in line for validation.  Items
+   we have an ordering override for are most likely the ones users
+   expect to see first, so they go ahead of the others.  As we don't
+   know the ID yet, it's guessed from the last part of the object path
+   which is where libayatana-appindicator puts it. */
+static void
+queue_validation (Application * app)
+{
+    ApplicationServiceAppstorePrivate * priv = application_service_appstore_get_instance_private(app->appstore);
+
+    if (priv->burst_start == 0) {
+        priv->burst_start = g_get_monotonic_time();
+        priv->burst_first_item = TRUE;
+    }
+
+    const gchar * guessed_id = strrchr(app->dbus_object, '/');
+    if (guessed_id != NULL && g_hash_table_contains(priv->ordering_overrides, guessed_id + 1)) {
+        app->pending_queue = priv->priority_validations;
+    } else {
+        app->pending_queue = priv->pending_validations;
+    }
+
+    g_queue_push_tail(app->pending_queue, app);
+    app->pending_link = g_queue_peek_tail_link(app->pending_queue);
+
+    start_validations(app->appstore);
+
+    return;
+}
+
+/* The item is validated, or has given up trying, either way
+   it makes room for the next one. */
+static void
+validation_done (Application * app)
+{
+    ApplicationServiceAppstorePrivate * priv = application_service_appstore_get_instance_private(app->appstore);
+
+    if (app->pending_link != NULL) {
+        g_queue_delete_link(app->pending_queue, app->pending_link);
+        app->pending_queue = NULL;
+        app->pending_link = NULL;
+    }
+
+    if (!app->validating) {
+        return;
+    }
+
+    app->validating = FALSE;
+    priv->validations_in_flight--;
+
+    if (app->validated) {
+        histogram_add(&priv->stats.validation_latency, g_get_monotonic_time() - app->registered_at);
+    }
+
+    if (app->validated && priv->burst_first_item && priv->burst_start != 0) {
+        priv->burst_first_item = FALSE;
+        priv->stats.time_to_first_item = g_get_monotonic_time() - priv->burst_start;
+        g_debug("First item of the registration burst validated after %" G_GINT64_FORMAT "us", priv->stats.time_to_first_item);
+    }
+
+    start_validations(app->appstore);
+
+    return;
+}
+
+/* The refresh window is over, go get the properties */
+static gboolean
+refresh_timeout (gpointer user_data)
+{
+    Application * app = (Application *)user_data;
+
+    app->refresh_timer = 0;
+    refresh_properties(app);
+
+    return G_SOURCE_REMOVE;
+}
+
+/* Marks the properties of the application as dirty.  The fetch is
+   pushed back on every request so that a burst of signals turns into
+   one fetch, but never beyond the maximum latency from the first
+   request in the burst. */
+static void
+schedule_refresh (Application * app, guint properties)
+{
+    ApplicationServiceAppstorePrivate * priv = application_service_appstore_get_instance_private(app->appstore);
+    gint64 now = g_get_monotonic_time();
+
+    app->dirty_props |= properties;
+    app->refreshes_requested++;
+    priv->stats.refreshes_requested++;
+
+    if (priv->refresh_window == 0) {
+        refresh_properties(app);
+        return;
+    }
+
+    if (app->refresh_timer != 0) {
+        app->refreshes_merged++;
+        priv->stats.refreshes_merged++;
+
+        gint64 deadline = app->refresh_dirty_since + (gint64)priv->refresh_max_latency * G_TIME_SPAN_MILLISECOND;
+        if (now + (gint64)priv->refresh_window * G_TIME_SPAN_MILLISECOND >= deadline) {
+            /* Keep the pending timer, it fires before the deadline */
+            return;
+        }
+
+        g_source_remove(app->refresh_timer);
+    } else {
+        app->refresh_dirty_since = now;
+    }
+
+    app->refresh_timer = g_timeout_add(priv->refresh_window, refresh_timeout, app);
+
+    return;
+}
+
+/* One outstanding set of Get calls for an application.  It is
+   shared by the calls and freed by the last one to return. */
+typedef struct {
+    Application * app;
+    guint pending;
+    GError * error; /* the first call that got no answer */
+} PropertyFetch;
+
+typedef struct {
+    PropertyFetch * fetch;
+    property_mask_t property;
+} PropertyRequest;
+
+/* Replaces a string field with the string in the variant,
+   or an empty string if there isn't one.  Returns whether the
+   field changed. */
+static gboolean
+set_string_property (gchar ** field, GVariant * value)
+{
+    if (value != NULL && g_variant_is_of_type(value, G_VARIANT_TYPE_STRING)) {
+        return set_string(field, g_variant_get_string(value, NULL));
+    }
+
+    return set_string(field, "");
+}
+
+/* Stores the parts of the tooltip that we show, returns whether
+   any of them changed */
+static gboolean
+set_tooltip (Application * app, GVariant * value)
+{
+    const gchar * icon = "";
+    const gchar * title = "";
+    const gchar * description = "";
+
+    if (value != NULL && g_variant_is_of_type (value, G_VARIANT_TYPE ("(sa(iiay)ss)")))
+    {
+        g_variant_get (value, "(&sa(iiay)&s&s)", &icon, NULL, &title, &description);
+    }
+
+    gboolean changed = FALSE;
+
+    changed = set_string(&app->sTooltipIcon, icon) || changed;
+    changed = set_string(&app->sTooltipTitle, title) || changed;
+    changed = set_string(&app->sTooltipDescription, description) || changed;
+
+    return changed;
+}
+
+/* Stores a single property that we got from a Get call,
+   returns whether it changed */
+static gboolean
+apply_property (Application * app, property_mask_t property, GVariant * value)
+{
+    switch (property) {
+    case PROPERTY_ICON_NAME:
+        return set_string_property(&app->icon, value);
+    case PROPERTY_ICON_DESC:
+        return set_string_property(&app->icon_desc, value);
+    case PROPERTY_AICON_NAME:
+        return set_string_property(&app->aicon, value);
+    case PROPERTY_AICON_DESC:
+        return set_string_property(&app->aicon_desc, value);
+    case PROPERTY_TITLE:
+        return set_string_property(&app->title, value);
+    case PROPERTY_TOOLTIP:
+        return set_tooltip(app, value);
+    default:
+        return FALSE;
+    }
+}
+
+/* Return from getting a single property.  Once the last one of
+   the fetch is back the changes get applied. */
+static void
+got_property (GObject * source_object, GAsyncResult * res, gpointer user_data)
+{
+    PropertyRequest * request = (PropertyRequest *)user_data;
+    PropertyFetch * fetch = request->fetch;
+    property_mask_t property = request->property;
+    g_free(request);
+
+    GError * error = NULL;
+    GVariant * reply = g_dbus_connection_call_finish(G_DBUS_CONNECTION(source_object), res, &error);
+
+    fetch->pending--;
+
+    if (g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+        g_error_free (error);
+        if (fetch->pending == 0) {
+            g_clear_error(&fetch->error);
+            g_free(fetch);
+        }
+        return; // Must exit before accessing freed memory
+    }
+
+    Application * app = fetch->app;
+    ApplicationServiceAppstorePrivate * priv = application_service_appstore_get_instance_private(app->appstore);
+
+    if (error != NULL) {
+        priv->stats.get_errors++;
+        /* Keep what we had, the next refresh may do better */
+        g_debug("Could not get property for %s: %s", app->dbus_name, error->message);
+        if (fetch->error == NULL && !call_answered(error)) {
+            fetch->error = g_error_copy(error);
+        }
+        g_error_free(error);
+    } else {
+        GVariant * value = NULL;
+        g_variant_get(reply, "(v)", &value);
+
+        guint i;
+        for (i = 0; i < G_N_ELEMENTS(refreshable_properties); i++) {
+            if (refreshable_properties[i].property == property) {
+                record_item(app->appstore, RECORDING_EVENT_PROPERTY, app->dbus_name, app->dbus_object,
+                            g_variant_new("(sv)", refreshable_properties[i].name, value));
+            }
+        }
+
+        if (apply_property(app, property, value)) {
+            snapshot_changed(app);
+        }
+        g_variant_unref(value);
+        g_variant_unref(reply);
+    }
+
+    if (fetch->pending != 0) {
+        return;
+    }
+
+    histogram_add(&priv->stats.get_latency, g_get_monotonic_time() - app->props_requested_at);
+    TRACE(got_properties, app->dbus_name, app->dbus_object, TRACE_STR(app->id), g_get_monotonic_time());
+
+    /* The calls went out together, so they count as one */
+    call_done(app, app->props_requested_at, fetch->error);
+    g_clear_error(&fetch->error);
+    g_free(fetch);
+
+    if (app->props_cancel != NULL) {
+        g_object_unref(app->props_cancel);
+        app->props_cancel = NULL;
+    }
+
+    apply_status(app);
+
+    refresh_pending(app);
+
+    return;
+}
+
+/* The connection to talk to the item on.  It is usually there before
+   the item registers, otherwise it comes along with the item proxy. */
+static GDBusConnection *
+app_connection (Application * app)
+{
+    ApplicationServiceAppstorePrivate * priv = application_service_appstore_get_instance_private(app->appstore);
+
+    if (priv->bus != NULL) {
+        return priv->bus;
+    }
+
+    if (app->dbus_proxy != NULL) {
+        return g_dbus_proxy_get_connection(app->dbus_proxy);
+    }
+
+    return NULL;
+}
+
+/* The quarantine of the item is over, anything that came in while
+   it was left alone gets fetched now */
+static void
+call_retry (gpointer user_data)
+{
+    Application * app = (Application *)user_data;
+
+    g_debug("Trying the item on %s%s again", app->dbus_name, app->dbus_object);
+
+    refresh_pending(app);
+
+    return;
+}
+
+/* Learns from how a call to the item went, see call_state_done() */
+static void
+call_done (Application * app, gint64 requested_at, const GError * error)
+{
+    guint delay = call_state_done(&app->calls, requested_at, error);
+
+    if (delay != 0) {
+        g_warning("Item on %s%s isn't answering, leaving it alone for %u ms", app->dbus_name, app->dbus_object, delay);
+    }
+
+    return;
+}
+
+/* Fetches the properties that have been marked dirty.  A full GetAll
+   is only used when everything is dirty; otherwise each invalidated
+   property gets its own Get, all sent at once. */
+static void
+refresh_properties (Application * app)
+{
+    if (app->dirty_props == 0) {
+        return;
+    }
+
+    /* The reply of the call in flight, or the end of the
+       quarantine, will bring us back here */
+    GDBusConnection * connection = app_connection(app);
+    if (connection == NULL || app->props_cancel != NULL || call_state_quarantined(&app->calls)) {
+        return;
+    }
+
+    if (!app->validated || (app->dirty_props & PROPERTY_ALL) == PROPERTY_ALL) {
+        get_all_properties(app);
+        return;
+    }
+
+    ApplicationServiceAppstorePrivate * priv = application_service_appstore_get_instance_private(app->appstore);
+
+    PropertyFetch * fetch = g_new0(PropertyFetch, 1);
+    fetch->app = app;
+
+    app->props_cancel = g_cancellable_new();
+    app->props_requested_at = g_get_monotonic_time();
+
+    guint i;
+    for (i = 0; i < G_N_ELEMENTS(refreshable_properties); i++) {
+        if (!(app->dirty_props & refreshable_properties[i].property)) {
+            continue;
+        }
+
+        PropertyRequest * request = g_new0(PropertyRequest, 1);
+        request->fetch = fetch;
+        request->property = refreshable_properties[i].property;
+        fetch->pending++;
+        priv->stats.get_calls++;
+
+        g_dbus_connection_call(connection, app->dbus_name, app->dbus_object,
+                               "org.freedesktop.DBus.Properties", "Get",
+                               g_variant_new("(ss)", NOTIFICATION_ITEM_DBUS_IFACE, refreshable_properties[i].name),
+                               G_VARIANT_TYPE("(v)"),
+                               G_DBUS_CALL_FLAGS_NONE, call_state_timeout(&app->calls), app->props_cancel,
+                               got_property, request);
+    }
+
+    app->dirty_props = 0;
+
+    return;
+}
+
+static void
+get_all_properties (Application * app)
+{
+    GDBusConnection * connection = app_connection(app);
+
+    if (connection != NULL && app->props_cancel == NULL && !call_state_quarantined(&app->calls)) {
+        ApplicationServiceAppstorePrivate * priv = application_service_appstore_get_instance_private(app->appstore);
+
+        /* Everything comes back with this one */
+        priv->stats.getall_calls++;
+        app->dirty_props = 0;
+        app->props_cancel = g_cancellable_new();
+        app->props_requested_at = g_get_monotonic_time();
+        g_dbus_connection_call(connection, app->dbus_name, app->dbus_object,
+                               "org.freedesktop.DBus.Properties", "GetAll",
+                               g_variant_new("(s)", NOTIFICATION_ITEM_DBUS_IFACE),
+                               G_VARIANT_TYPE("(a{sv})"),
+                               G_DBUS_CALL_FLAGS_NONE, call_state_timeout(&app->calls), app->props_cancel,
+                               got_all_properties, app);
+    }
+    else {
+        g_debug("Queuing a properties check");
+        app->queued_props = TRUE;
+    }
+}
+
+/* Starts what came in while a call to the item was out, a whole
+   GetAll if one was asked for or else the dirty properties. */
+static void
+refresh_pending (Application * app)
+{
+    if (app->queued_props) {
+        app->queued_props = FALSE;
+        get_all_properties(app);
+    } else {
+        refresh_properties(app);
+    }
+
+    return;
+}
+
+/* Nick to value tables for the enums items send us as strings.
+   The values are stored off by one so that zero isn't NULL. */
+static GHashTable * status_by_nick = NULL;
+static GHashTable * category_by_nick = NULL;
+
+static GHashTable *
+build_enum_table (GType type)
+{
+    GEnumClass * klass = G_ENUM_CLASS(g_type_class_ref(type));
+    GHashTable * table = g_hash_table_new(g_str_hash, g_str_equal);
+    guint i;
+
+    for (i = 0; i < klass->n_values; i++) {
+        g_hash_table_insert(table,
+                            (gpointer)g_intern_string(klass->values[i].value_nick),
+                            GINT_TO_POINTER(klass->values[i].value + 1));
+    }
+
+    g_type_class_unref(klass);
+
+    return table;
+}
+
+/* Built once, the lookups don't need the enum classes */
+static void
+build_enum_tables (void)
+{
+    if (status_by_nick == NULL) {
+        status_by_nick = build_enum_table(APP_INDICATOR_TYPE_INDICATOR_STATUS);
+    }
+
+    if (category_by_nick == NULL) {
+        category_by_nick = build_enum_table(APP_INDICATOR_TYPE_INDICATOR_CATEGORY);
+    }
+
+    return;
+}
+
+/* Simple translation function */
+static AppIndicatorStatus
+string_to_status(const gchar * status_string)
+{
+    gint value = GPOINTER_TO_INT(g_hash_table_lookup(status_by_nick, status_string));
+
+    if (value == 0) {
+        g_warning("Unrecognized status '%s' assuming passive.", status_string);
+        return APP_INDICATOR_STATUS_PASSIVE;
+    }
+
+    return (AppIndicatorStatus)(value - 1);
+}
+
+/* Simple translation function */
+static AppIndicatorCategory
+string_to_cat(const gchar * cat_string)
+{
+    gint value = GPOINTER_TO_INT(g_hash_table_lookup(category_by_nick, cat_string));
+
+    if (value == 0) {
+        g_warning("Unrecognized status '%s' assuming other.", cat_string);
+        return APP_INDICATOR_CATEGORY_OTHER;
+    }
+
+    return (AppIndicatorCategory)(value - 1);
+}
+
+
+/* A small helper function to get the position of an application
+   in the app list of the applications that are visible.  Hidden
+   applications get the position they'd take if they were shown. */
+static gint
+get_position (Application * app) {
+    ApplicationServiceAppstorePrivate * priv = application_service_appstore_get_instance_private(app->appstore);
+
+    if (app->visible_iter != NULL) {
+        return g_sequence_iter_get_position(app->visible_iter);
+    }
+
+    if (app->iter == NULL) {
+        g_warning("Unable to find position for app '%s'", app->id);
+        return -1;
+    }
+
+    GSequenceIter * iter = g_sequence_search(priv->visible_applications, app, app_sort_func, NULL);
+    return g_sequence_iter_get_position(iter);
+}
+
+/* A simple global function for dealing with freeing the information
+   in an Application structure */
+static void
+application_free (Application * app)
+{
+    if (app == NULL) return;
+    g_debug("Application free '%s'", app->id);
+
+    /* Handle the case where this could be called by unref'ing one of
+       the proxy objects. */
+    if (app->currently_free) return;
+    app->currently_free = TRUE;
+
+    ApplicationServiceAppstorePrivate * priv = application_service_appstore_get_instance_private(app->appstore);
+
+    if (app->refresh_timer != 0) {
+        g_source_remove(app->refresh_timer);
+        app->refresh_timer = 0;
+    }
+
+    call_state_clear(&app->calls);
+
+    guint throttled = 0;
+    guint i;
+    for (i = 0; i < SIGNAL_CLASS_COUNT; i++) {
+        throttle_clear(&app->buckets[i]);
+        throttled += app->buckets[i].throttled;
+    }
+
+    /* Let the next item through if this one was in line */
+    validation_done(app);
+
+    if (app->pending_fields != 0) {
+        g_queue_remove(priv->pending_updates, app);
+        app->pending_fields = 0;
+    }
+
+    g_debug("'%s' requested %u property refreshes, %u merged", app->id, app->refreshes_requested, app->refreshes_merged);
+    g_debug("'%s' had %u signals throttled", app->id, throttled);
+
+    /* Remove from the application lists */
+    if (app->visible_iter != NULL) {
+        g_sequence_remove(app->visible_iter);
+        app->visible_iter = NULL;
+    }
+
+    if (app->iter != NULL) {
+        g_sequence_remove(app->iter);
+        app->iter = NULL;
+    }
+
+    if (app->item_name != NULL) {
+        gchar * item_name = g_strdup(app->item_name);
+
+        g_ptr_array_remove(priv->item_names, app->item_name);
+        app->item_name = NULL;
+
+        g_signal_emit(app->appstore, signals[ITEM_UNREGISTERED], 0, item_name);
+        g_free(item_name);
+    }
+
+    if (g_hash_table_lookup(priv->apps_by_object, app) == app) {
+        g_hash_table_remove(priv->apps_by_object, app);
+    }
+    menu_index_remove(app);
+    sender_index_remove(app);
+
+    unwatch_app_name(app);
+
+    if (app->props_cancel != NULL) {
+        g_cancellable_cancel(app->props_cancel);
+        g_object_unref(app->props_cancel);
+        app->props_cancel = NULL;
+    }
+
+    if (app->dbus_proxy) {
+        g_signal_handlers_disconnect_by_data(app->dbus_proxy, app);
+        g_object_unref(app->dbus_proxy);
+    }
+
+    clear_string(&app->owner);
+
+    if (app->dbus_proxy_cancel != NULL) {
+        g_cancellable_cancel(app->dbus_proxy_cancel);
+        g_object_unref(app->dbus_proxy_cancel);
+        app->dbus_proxy_cancel = NULL;
+    }
+
+    clear_string(&app->id);
+    clear_string(&app->dbus_name);
+    clear_string(&app->dbus_object);
+    clear_string(&app->icon);
+    clear_string(&app->icon_desc);
+    clear_string(&app->aicon);
+    clear_string(&app->aicon_desc);
+    clear_string(&app->menu);
+    clear_string(&app->icon_theme_path);
+    clear_string(&app->label);
+    clear_string(&app->guide);
+    clear_string(&app->title);
+    clear_string(&app->sTooltipIcon);
+    clear_string(&app->sTooltipTitle);
+    clear_string(&app->sTooltipDescription);
+    forget_sent_values(app);
+    g_free(app);
+    return;
+}
+
+/* Gets called when the proxy changes owners, which is usually when it
+   drops off of the bus. */
+static void
+application_died (Application * app)
+{
+    /* Application died */
+    g_debug("Application proxy destroyed '%s'", app->id);
+
+    ApplicationServiceAppstorePrivate * priv = application_service_appstore_get_instance_private(app->appstore);
+    priv->stats.removals++;
+
+    record_item(app->appstore, RECORDING_EVENT_UNREGISTER, app->dbus_name, app->dbus_object, NULL);
+
+    /* Remove from the panel */
+    app->status = APP_INDICATOR_STATUS_PASSIVE;
+    apply_status(app);
+
+    /* Destroy the data */
+    application_free(app);
+    return;
+}
+
+/* This function takes two Application structure
+   pointers and uses their ordering index to compare them. */
+static gint
+app_sort_func (gconstpointer a, gconstpointer b, gpointer userdata)
+{
+    Application * appa = (Application *)a;
+    Application * appb = (Application *)b;
+    return (appb->ordering_index/2) - (appa->ordering_index/2);
+}
+
+/* Hash and equality for the index of applications by their
+   bus name and NotificationItem object path. */
+static guint
+app_object_hash (gconstpointer key)
+{
+    const Application * app = (const Application *)key;
+    return g_str_hash(app->dbus_name) * 31 + g_str_hash(app->dbus_object);
+}
+
+static gboolean
+app_object_equal (gconstpointer a, gconstpointer b)
+{
+    const Application * appa = (const Application *)a;
+    const Application * appb = (const Application *)b;
+    return g_strcmp0(appa->dbus_name, appb->dbus_name) == 0 &&
+           g_strcmp0(appa->dbus_object, appb->dbus_object) == 0;
+}
+
+/* Hash and equality for the index of applications by their
+   bus name and menu object path.  Only applications with a menu
+   go in, but the lookup key may still lack one. */
+static guint
+app_menu_hash (gconstpointer key)
+{
+    const Application * app = (const Application *)key;
+    return g_str_hash(app->dbus_name) * 31 + g_str_hash(app->menu != NULL ? app->menu : "");
+}
+
+static gboolean
+app_menu_equal (gconstpointer a, gconstpointer b)
+{
+    const Application * appa = (const Application *)a;
+    const Application * appb = (const Application *)b;
+    return g_strcmp0(appa->dbus_name, appb->dbus_name) == 0 &&
+           g_strcmp0(appa->menu, appb->menu) == 0;
+}
+
+/* Puts the application in the menu index.  Applications with the
+   same menu queue up in a chain, the first one has the slot like the
+   first match of a list walk would.  The chain is keyed on it. */
+static void
+menu_index_add (Application * app)
+{
+    if (app->menu == NULL || app->menu_link != NULL) return;
+
+    ApplicationServiceAppstorePrivate * priv = application_service_appstore_get_instance_private(app->appstore);
+    GQueue * chain = g_hash_table_lookup(priv->apps_by_menu, app);
+
+    if (chain == NULL) {
+        chain = g_queue_new();
+        g_hash_table_insert(priv->apps_by_menu, app, chain);
+    }
+
+    g_queue_push_tail(chain, app);
+    app->menu_link = g_queue_peek_tail_link(chain);
+
+    return;
+}
+
+/* Drops the application from the menu index.  If it had the slot,
+   the next one in the chain takes it over and the key with it. */
+static void
+menu_index_remove (Application * app)
+{
+    if (app->menu_link == NULL) return;
+
+    ApplicationServiceAppstorePrivate * priv = application_service_appstore_get_instance_private(app->appstore);
+    GQueue * chain = g_hash_table_lookup(priv->apps_by_menu, app);
+    gboolean had_slot = (g_queue_peek_head_link(chain) == app->menu_link);
+
+    g_queue_delete_link(chain, app->menu_link);
+    app->menu_link = NULL;
+
+    if (!had_slot) {
+        return;
+    }
+
+    g_hash_table_steal(priv->apps_by_menu, app);
+
+    if (g_queue_is_empty(chain)) {
+        g_queue_free(chain);
+    } else {
+        g_hash_table_insert(priv->apps_by_menu, g_queue_peek_head(chain), chain);
+    }
+
+    return;
+}
+
+/* Hash and equality for the index of applications by the
+   unique name and object path their signals come from. */
+static guint
+app_sender_hash (gconstpointer key)
+{
+    const Application * app = (const Application *)key;
+    return g_str_hash(app->owner) * 31 + g_str_hash(app->dbus_object);
+}
+
+static gboolean
+app_sender_equal (gconstpointer a, gconstpointer b)
+{
+    const Application * appa = (const Application *)a;
+    const Application * appb = (const Application *)b;
+    return g_strcmp0(appa->owner, appb->owner) == 0 &&
+           g_strcmp0(appa->dbus_object, appb->dbus_object) == 0;
+}
+
+/* Drops the application from the sender index, unless another
+   application on the same object has taken its slot. */
+static void
+sender_index_remove (Application * app)
+{
+    if (app->owner == NULL) return;
+
+    ApplicationServiceAppstorePrivate * priv = application_service_appstore_get_instance_private(app->appstore);
+
+    if (g_hash_table_lookup(priv->apps_by_sender, app) == app) {
+        g_hash_table_remove(priv->apps_by_sender, app);
+    }
+
+    return;
+}
+
+/* Sends the signal to the subscribed clients, filtered for each of
+   them, and broadcasts it if asked to */
+static void
+emit_signal (ApplicationServiceAppstore * appstore, const gchar * name,
+             GVariant * variant, gboolean broadcast)
+{
+    ApplicationServiceAppstorePrivate * priv = application_service_appstore_get_instance_private(appstore);
+
+    g_variant_ref_sink(variant);
+
+    clients_deliver(priv->clients, name, variant);
+
+    if (!broadcast) {
+        g_variant_unref(variant);
+        return;
+    }
+
+    statistics_count_signal(&priv->stats, name);
+
+    TRACE(emit_signal, name, g_get_monotonic_time());
+
+    GError * error = NULL;
+
+    g_dbus_connection_emit_signal (priv->bus,
+                               NULL,
+                               INDICATOR_APPLICATION_DBUS_OBJ,
+                               INDICATOR_APPLICATION_DBUS_IFACE,
+                               name,
+                               variant,
+                               &error);
+
+    if (error != NULL) {
+        g_critical("Unable to send %s signal: %s", name, error->message);
+        g_error_free(error);
+    }
+
+    g_variant_unref(variant);
+
+    return;
+}
+
+static void
+history_entry_free (gpointer data)
+{
+    HistoryEntry * entry = (HistoryEntry *)data;
+
+    g_variant_unref(entry->params);
+    g_free(entry);
+}
+
+/* Gives a change to the list its generation and remembers it, so
+   panels that saw the generation before can catch up with
+   GetApplicationsSince.  The signal is only broadcast if asked to,
+   the change is recorded and the subscribed clients get it either
+   way. */
+static void
+emit_change (ApplicationServiceAppstore * appstore, const gchar * name, GVariant * params, gboolean send)
+{
+    ApplicationServiceAppstorePrivate * priv = application_service_appstore_get_instance_private(appstore);
+
+    g_variant_ref_sink(params);
+
+    priv->generation++;
+    snapshot_invalidate(appstore);
+
+    if (priv->history_size > 0) {
+        HistoryEntry * entry = g_new0(HistoryEntry, 1);
+        entry->generation = priv->generation;
+        entry->name = name;
+        entry->params = g_variant_ref(params);
+        g_queue_push_tail(priv->history, entry);
+
+        while (g_queue_get_length(priv->history) > priv->history_size) {
+            history_entry_free(g_queue_pop_head(priv->history));
+        }
+    }
 
-    GEnumValue * val = g_enum_get_value_by_nick(klass, status_string);
-    if (val == NULL) {
-        g_warning("Unrecognized status '%s' assuming passive.", status_string);
-    } else {
-        retval = (AppIndicatorStatus)val->value;
+    emit_signal(appstore, name, params, send);
+
+    g_variant_unref(params);
+}
+
+/* Remembers the value we're sending to the panels and tells
+   whether it differs from the last one. */
+static gboolean
+update_sent_value (gchar ** sent, const gchar * value)
+{
+    if (value == NULL) {
+        value = "";
     }
 
-    g_type_class_unref(klass);
+    /* The fields are interned, so this is only another ref */
+    return set_string(sent, value);
+}
 
-    return retval;
+/* The panels dropped the application, so next time everything
+   needs to be sent again. */
+static void
+forget_sent_values (Application * app)
+{
+    clear_string(&app->sent_icon);
+    clear_string(&app->sent_icon_desc);
+    clear_string(&app->sent_label);
+    clear_string(&app->sent_guide);
+    clear_string(&app->sent_title);
+    clear_string(&app->sent_tooltip_icon);
+    clear_string(&app->sent_tooltip_title);
+    clear_string(&app->sent_tooltip_description);
 }
 
-/* Simple translation function -- could be optimized */
-static AppIndicatorCategory
-string_to_cat(const gchar * cat_string)
+/* Remembers everything that went out with ApplicationAdded */
+static void
+remember_sent_values (Application * app, const gchar * icon, const gchar * desc)
 {
-    GEnumClass * klass = G_ENUM_CLASS(g_type_class_ref(APP_INDICATOR_TYPE_INDICATOR_CATEGORY));
-    g_return_val_if_fail(klass != NULL, APP_INDICATOR_CATEGORY_OTHER);
+    update_sent_value(&app->sent_icon, icon);
+    update_sent_value(&app->sent_icon_desc, desc);
+    update_sent_value(&app->sent_label, app->label);
+    update_sent_value(&app->sent_guide, app->guide);
+    update_sent_value(&app->sent_title, app->title);
+    update_sent_value(&app->sent_tooltip_icon, app->sTooltipIcon);
+    update_sent_value(&app->sent_tooltip_title, app->sTooltipTitle);
+    update_sent_value(&app->sent_tooltip_description, app->sTooltipDescription);
+}
 
-    AppIndicatorCategory retval = APP_INDICATOR_CATEGORY_OTHER;
+/* Figures out which icon we should be showing */
+static void
+get_shown_icon (Application * app, const gchar ** icon, const gchar ** desc)
+{
+    *icon = app->icon;
+    *desc = app->icon_desc;
 
-    GEnumValue * val = g_enum_get_value_by_nick(klass, cat_string);
-    if (val == NULL) {
-        g_warning("Unrecognized status '%s' assuming other.", cat_string);
-    } else {
-        retval = (AppIndicatorCategory)val->value;
+    if (app->status == APP_INDICATOR_STATUS_ATTENTION && app->aicon != NULL && app->aicon[0] != '\0') {
+        *icon = app->aicon;
+        *desc = app->aicon_desc;
     }
 
-    g_type_class_unref(klass);
+    if (*icon == NULL) {
+        *icon = "";
+    }
 
-    return retval;
+    if (*desc == NULL) {
+        *desc = "";
+    }
 }
 
+/* Sends all the accumulated field changes in one ApplicationsChanged
+   signal.  This has to happen before anything that changes positions
+   goes out, as the changes are sent with the current positions. */
+static void
+flush_updates (ApplicationServiceAppstore * appstore)
+{
+    ApplicationServiceAppstorePrivate * priv = application_service_appstore_get_instance_private(appstore);
+
+    if (priv->flush_updates_idle != 0) {
+        g_source_remove(priv->flush_updates_idle);
+        priv->flush_updates_idle = 0;
+    }
 
-/* A small helper function to get the position of an application
-   in the app list of the applications that are visible. */
-static gint
-get_position (Application * app) {
-    ApplicationServiceAppstorePrivate * priv = application_service_appstore_get_instance_private(app->appstore);
+    if (g_queue_is_empty(priv->pending_updates)) {
+        return;
+    }
 
-    GList * lapp;
-    gint count;
+    GVariantBuilder builder;
+    g_variant_builder_init(&builder, G_VARIANT_TYPE("a(iua{sv})"));
 
-    /* Go through the list and try to find ours */
-    for (lapp = priv->applications, count = 0; lapp != NULL; lapp = g_list_next(lapp), count++) {
-        if (lapp->data == app) {
-            break;
+    Application * app;
+    guint changes = 0;
+    while ((app = g_queue_pop_head(priv->pending_updates)) != NULL) {
+        guint fields = app->pending_fields;
+        app->pending_fields = 0;
+
+        gint position = get_position(app);
+        if (position == -1) {
+            continue;
+        }
+
+        GVariantBuilder values;
+        g_variant_builder_init(&values, G_VARIANT_TYPE_VARDICT);
+
+        if (fields & INDICATOR_APPLICATION_FIELD_ICON) {
+            const gchar * icon = NULL, * desc = NULL;
+            get_shown_icon(app, &icon, &desc);
+            g_variant_builder_add(&values, "{sv}", "icon", g_variant_new_string(icon));
+            g_variant_builder_add(&values, "{sv}", "icon-desc", g_variant_new_string(desc));
         }
 
-        /* If the selected app isn't visible let's not
-           count it's position */
-        Application * thisapp = (Application *)(lapp->data);
-        if (thisapp->visible_state == VISIBLE_STATE_HIDDEN) {
-            count--;
+        if (fields & INDICATOR_APPLICATION_FIELD_ICON_THEME_PATH) {
+            g_variant_builder_add(&values, "{sv}", "icon-theme-path", g_variant_new_string(app->icon_theme_path != NULL ? app->icon_theme_path : ""));
         }
+
+        if (fields & INDICATOR_APPLICATION_FIELD_LABEL) {
+            g_variant_builder_add(&values, "{sv}", "label", g_variant_new_string(app->label != NULL ? app->label : ""));
+            g_variant_builder_add(&values, "{sv}", "guide", g_variant_new_string(app->guide != NULL ? app->guide : ""));
+        }
+
+        if (fields & INDICATOR_APPLICATION_FIELD_TITLE) {
+            g_variant_builder_add(&values, "{sv}", "title", g_variant_new_string(app->title != NULL ? app->title : ""));
+        }
+
+        if (fields & INDICATOR_APPLICATION_FIELD_TOOLTIP) {
+            g_variant_builder_add(&values, "{sv}", "tooltip-icon", g_variant_new_string(app->sTooltipIcon != NULL ? app->sTooltipIcon : ""));
+            g_variant_builder_add(&values, "{sv}", "tooltip-title", g_variant_new_string(app->sTooltipTitle != NULL ? app->sTooltipTitle : ""));
+            g_variant_builder_add(&values, "{sv}", "tooltip-description", g_variant_new_string(app->sTooltipDescription != NULL ? app->sTooltipDescription : ""));
+        }
+
+        g_variant_builder_add(&builder, "(iua{sv})", position, fields, &values);
+        changes++;
     }
 
-    if (lapp == NULL) {
-        g_warning("Unable to find position for app '%s'", app->id);
-        return -1;
+    if (changes == 0) {
+        g_variant_builder_clear(&builder);
+        return;
+    }
+
+    /* Always recorded, so the history has every change */
+    gboolean send = (clients_batched(priv->clients) > 0);
+    if (send) {
+        priv->stats.updates_sent++;
     }
 
-    return count;
+    emit_change(appstore, "ApplicationsChanged",
+                g_variant_new("(ta(iua{sv}))", priv->generation + 1, &builder),
+                send);
+
+    return;
 }
 
-/* A simple global function for dealing with freeing the information
-   in an Application structure */
+static gboolean
+flush_updates_idle (gpointer user_data)
+{
+    ApplicationServiceAppstorePrivate * priv = application_service_appstore_get_instance_private(APPLICATION_SERVICE_APPSTORE(user_data));
+
+    priv->flush_updates_idle = 0;
+    flush_updates(APPLICATION_SERVICE_APPSTORE(user_data));
+
+    return G_SOURCE_REMOVE;
+}
+
+/* The clients want the updates out before they change */
 static void
-application_free (Application * app)
+flush_updates_cb (gpointer user_data)
 {
-    if (app == NULL) return;
-    g_debug("Application free '%s'", app->id);
+    flush_updates(APPLICATION_SERVICE_APPSTORE(user_data));
 
-    /* Handle the case where this could be called by unref'ing one of
-       the proxy objects. */
-    if (app->currently_free) return;
-    app->currently_free = TRUE;
+    return;
+}
 
+/* Sends a field update the way our clients want it.  Old clients get
+   the per field signal right away.  New clients get the changes of
+   one main loop iteration together in ApplicationsChanged, which are
+   collected even without such clients to keep the history complete.
+   If we don't know any clients yet, the old signals are the safe
+   choice.  Unchanged payloads aren't sent at all, but they get
+   counted. */
+static void
+emit_update (Application * app, gboolean changed, guint field, const gchar * name, GVariant * variant)
+{
     ApplicationServiceAppstorePrivate * priv = application_service_appstore_get_instance_private(app->appstore);
 
-    /* Remove from the application list */
-    priv->applications = g_list_remove(priv->applications, app);
-
-    if (app->name_watcher != 0) {
-        g_dbus_connection_signal_unsubscribe(g_dbus_proxy_get_connection(app->dbus_proxy), app->name_watcher);
-        app->name_watcher = 0;
-    }
+    TRACE(emit_update, app->dbus_name, app->dbus_object, TRACE_STR(app->id), name, changed, g_get_monotonic_time());
 
-    if (app->props) {
-        g_object_unref(app->props);
-    }
+    g_variant_ref_sink(variant);
 
-    if (app->props_cancel != NULL) {
-        g_cancellable_cancel(app->props_cancel);
-        g_object_unref(app->props_cancel);
-        app->props_cancel = NULL;
+    if (!changed) {
+        priv->stats.updates_suppressed++;
+        g_variant_unref(variant);
+        return;
     }
 
-    if (app->dbus_proxy) {
-        g_object_unref(app->dbus_proxy);
+    gboolean broadcast = (clients_legacy(priv->clients) > 0 || clients_batched(priv->clients) == 0);
+    if (broadcast) {
+        priv->stats.updates_sent++;
     }
+    emit_signal(app->appstore, name, variant, broadcast);
 
-    if (app->dbus_proxy_cancel != NULL) {
-        g_cancellable_cancel(app->dbus_proxy_cancel);
-        g_object_unref(app->dbus_proxy_cancel);
-        app->dbus_proxy_cancel = NULL;
+    if (app->pending_fields == 0) {
+        g_queue_push_tail(priv->pending_updates, app);
     }
+    app->pending_fields |= field;
 
-    if (app->id != NULL) {
-        g_free(app->id);
-    }
-    if (app->category != NULL) {
-        g_free(app->category);
-    }
-    if (app->dbus_name != NULL) {
-        g_free(app->dbus_name);
-    }
-    if (app->dbus_object != NULL) {
-        g_free(app->dbus_object);
-    }
-    if (app->icon != NULL) {
-        g_free(app->icon);
-    }
-    if (app->icon_desc != NULL) {
-        g_free(app->icon_desc);
-    }
-    if (app->aicon != NULL) {
-        g_free(app->aicon);
-    }
-    if (app->aicon_desc != NULL) {
-        g_free(app->aicon_desc);
-    }
-    if (app->menu != NULL) {
-        g_free(app->menu);
-    }
-    if (app->icon_theme_path != NULL) {
-        g_free(app->icon_theme_path);
-    }
-    if (app->label != NULL) {
-        g_free(app->label);
-    }
-    if (app->guide != NULL) {
-        g_free(app->guide);
-    }
-    if (app->title != NULL) {
-        g_free(app->title);
+    if (priv->flush_updates_idle == 0) {
+        priv->flush_updates_idle = g_idle_add(flush_updates_idle, app->appstore);
     }
 
-    g_free (app->sTooltipIcon);
-    g_free (app->sTooltipTitle);
-    g_free (app->sTooltipDescription);
-    g_free(app);
-    return;
+    g_variant_unref(variant);
 }
 
-/* Gets called when the proxy changes owners, which is usually when it
-   drops off of the bus. */
+/* Sets what a client wants to get, among the applications that are
+   visible right now, see clients_subscribe() */
 static void
-application_died (Application * app)
+subscribe_client (ApplicationServiceAppstore * appstore, const gchar * sender, GVariant * options)
 {
-    /* Application died */
-    g_debug("Application proxy destroyed '%s'", app->id);
+    ApplicationServiceAppstorePrivate * priv = application_service_appstore_get_instance_private(appstore);
+    GPtrArray * ids = g_ptr_array_sized_new(g_sequence_get_length(priv->visible_applications));
+    GSequenceIter * iter;
 
-    /* Remove from the panel */
-    app->status = APP_INDICATOR_STATUS_PASSIVE;
-    apply_status(app);
+    for (iter = g_sequence_get_begin_iter(priv->visible_applications); !g_sequence_iter_is_end(iter); iter = g_sequence_iter_next(iter)) {
+        Application * app = (Application *)g_sequence_get(iter);
+        g_ptr_array_add(ids, app->id);
+    }
 
-    /* Destroy the data */
-    application_free(app);
-    return;
-}
+    clients_subscribe(priv->clients, sender, options, ids, priv->generation);
 
-/* This function takes two Application structure
-   pointers and uses their ordering index to compare them. */
-static gint
-app_sort_func (gconstpointer a, gconstpointer b, gpointer userdata)
-{
-    Application * appa = (Application *)a;
-    Application * appb = (Application *)b;
-    return (appb->ordering_index/2) - (appa->ordering_index/2);
+    g_ptr_array_unref(ids);
+
+    return;
 }
 
+/* Moves the application to the place its new ordering index puts
+   it at.  Only this application moves, and panels get told about it
+   if that changes its position among the visible ones. */
 static void
-emit_signal (ApplicationServiceAppstore * appstore, const gchar * name,
-             GVariant * variant)
+set_ordering_index (Application * app, guint ordering_index)
 {
-    ApplicationServiceAppstorePrivate * priv = application_service_appstore_get_instance_private(appstore);
+    if (app->ordering_index == ordering_index) {
+        return;
+    }
 
-    GError * error = NULL;
+    gint old_position = -1;
+    if (app->visible_iter != NULL) {
+        old_position = get_position(app);
+    }
 
-    g_dbus_connection_emit_signal (priv->bus,
-                               NULL,
-                               INDICATOR_APPLICATION_DBUS_OBJ,
-                               INDICATOR_APPLICATION_DBUS_IFACE,
-                               name,
-                               variant,
-                               &error);
+    app->ordering_index = ordering_index;
 
-    if (error != NULL) {
-        g_critical("Unable to send %s signal: %s", name, error->message);
-        g_error_free(error);
-        return;
+    if (app->iter != NULL) {
+        g_sequence_sort_changed(app->iter, app_sort_func, NULL);
+    }
+
+    if (app->visible_iter != NULL) {
+        g_sequence_sort_changed(app->visible_iter, app_sort_func, NULL);
+
+        gint new_position = get_position(app);
+        if (new_position != old_position) {
+            g_debug("Moving app '%s' from %d to %d", app->id, old_position, new_position);
+            flush_updates(app->appstore);
+            emit_change (app->appstore, "ApplicationMoved",
+                         g_variant_new ("(ii)", old_position, new_position), TRUE);
+        }
     }
 
     return;
@@ -872,6 +2477,8 @@ apply_status (Application * app)
 {
     ApplicationServiceAppstore * appstore = app->appstore;
 
+    TRACE(apply_status, app->dbus_name, app->dbus_object, TRACE_STR(app->id), app->status, app->visible_state, g_get_monotonic_time());
+
     /* g_debug("Applying status.  Status: %d  Visible: %d", app->status, app->visible_state); */
 
     visible_state_t goal_state = VISIBLE_STATE_HIDDEN;
@@ -880,15 +2487,10 @@ apply_status (Application * app)
         goal_state = VISIBLE_STATE_SHOWN;
     }
 
-    /* Nothing needs to change, we're good */
-    if (app->visible_state == goal_state /* ) { */
+    /* Nothing needs to change, we're good.  For a visible application
+       the updates below only send what differs from the last time. */
+    if (app->visible_state == goal_state
         && goal_state == VISIBLE_STATE_HIDDEN) {
-        /* TODO: Uhg, this is a little wrong in that we're going to
-           send an icon every time the status changes and the indicator
-           is visible even though it might not be updating.  But, at
-           this point we need a small patch that is harmless.  In the
-           future we need to track which icon is shown and remove the
-           duplicate message. */
         return;
     }
 
@@ -901,48 +2503,64 @@ apply_status (Application * app)
         gint position = get_position(app);
         if (position == -1) return;
 
-        emit_signal (appstore, "ApplicationRemoved",
-                     g_variant_new ("(i)", position));
-    } else {
-        /* Figure out which icon we should be using */
-        gchar * newicon = app->icon;
-        gchar * newdesc = app->icon_desc;
-        if (app->status == APP_INDICATOR_STATUS_ATTENTION && app->aicon != NULL && app->aicon[0] != '\0') {
-            newicon = app->aicon;
-            newdesc = app->aicon_desc;
-        }
+        flush_updates(appstore);
+        emit_change (appstore, "ApplicationRemoved",
+                     g_variant_new ("(i)", position), TRUE);
 
-        if (newdesc == NULL) {
-            newdesc = "";
+        if (app->visible_iter != NULL) {
+            g_sequence_remove(app->visible_iter);
+            app->visible_iter = NULL;
         }
 
+        forget_sent_values(app);
+    } else {
+        /* Figure out which icon we should be using */
+        const gchar * newicon = NULL;
+        const gchar * newdesc = NULL;
+        get_shown_icon(app, &newicon, &newdesc);
+
         /* Determine whether we're already shown or not */
         if (app->visible_state == VISIBLE_STATE_HIDDEN) {
+            ApplicationServiceAppstorePrivate * priv = application_service_appstore_get_instance_private(appstore);
+            flush_updates(appstore);
+            app->visible_iter = g_sequence_insert_sorted(priv->visible_applications, app, app_sort_func, NULL);
+
             /* Put on panel */
-            emit_signal (appstore, "ApplicationAdded",
+            emit_change (appstore, "ApplicationAdded",
                      g_variant_new ("(sisosssssssss)", newicon,
                                         get_position(app),
                                         app->dbus_name, app->menu,
                                         app->icon_theme_path,
                                         app->label, app->guide,
-                                        newdesc, app->id, app->title, app->sTooltipIcon != NULL ? app->sTooltipIcon : "", app->sTooltipTitle != NULL ? app->sTooltipTitle : "", app->sTooltipDescription != NULL ? app->sTooltipDescription : ""));
+                                        newdesc, app->id, app->title, app->sTooltipIcon != NULL ? app->sTooltipIcon : "", app->sTooltipTitle != NULL ? app->sTooltipTitle : "", app->sTooltipDescription != NULL ? app->sTooltipDescription : ""), TRUE);
+            remember_sent_values(app, newicon, newdesc);
         } else {
             /* Icon update */
             gint position = get_position(app);
             if (position == -1) return;
 
-            emit_signal (appstore, "ApplicationIconChanged",
+            gboolean changed = update_sent_value(&app->sent_icon, newicon);
+            changed = update_sent_value(&app->sent_icon_desc, newdesc) || changed;
+            emit_update (app, changed, INDICATOR_APPLICATION_FIELD_ICON, "ApplicationIconChanged",
                      g_variant_new ("(iss)", position, newicon, newdesc));
-            emit_signal (appstore, "ApplicationLabelChanged",
+
+            changed = update_sent_value(&app->sent_label, app->label);
+            changed = update_sent_value(&app->sent_guide, app->guide) || changed;
+            emit_update (app, changed, INDICATOR_APPLICATION_FIELD_LABEL, "ApplicationLabelChanged",
                      g_variant_new ("(iss)", position,
                                             app->label != NULL ? app->label : "",
                                             app->guide != NULL ? app->guide : ""));
-            emit_signal (appstore, "ApplicationTitleChanged",
+
+            changed = update_sent_value(&app->sent_title, app->title);
+            emit_update (app, changed, INDICATOR_APPLICATION_FIELD_TITLE, "ApplicationTitleChanged",
                      g_variant_new ("(is)", position,
                                             app->title != NULL ? app->title : ""));
 
+            changed = update_sent_value(&app->sent_tooltip_icon, app->sTooltipIcon);
+            changed = update_sent_value(&app->sent_tooltip_title, app->sTooltipTitle) || changed;
+            changed = update_sent_value(&app->sent_tooltip_description, app->sTooltipDescription) || changed;
             GVariant *pParams = g_variant_new ("(isss)", position, app->sTooltipIcon != NULL ? app->sTooltipIcon : "", app->sTooltipTitle != NULL ? app->sTooltipTitle : "", app->sTooltipDescription != NULL ? app->sTooltipDescription : "");
-            emit_signal (appstore, "ApplicationTooltipChanged", pParams);
+            emit_update (app, changed, INDICATOR_APPLICATION_FIELD_TOOLTIP, "ApplicationTooltipChanged", pParams);
         }
     }
 
@@ -969,14 +2587,14 @@ new_icon_theme_path (Application * app, const gchar * icon_theme_path)
 {
     if (g_strcmp0(icon_theme_path, app->icon_theme_path)) {
         /* If the new icon theme path is actually a new icon theme path */
-        if (app->icon_theme_path != NULL) g_free(app->icon_theme_path);
-        app->icon_theme_path = g_strdup(icon_theme_path);
+        set_string(&app->icon_theme_path, icon_theme_path);
+        snapshot_changed(app);
 
         if (app->visible_state != VISIBLE_STATE_HIDDEN) {
             gint position = get_position(app);
             if (position == -1) return;
 
-            emit_signal (app->appstore,
+            emit_update (app, TRUE, INDICATOR_APPLICATION_FIELD_ICON_THEME_PATH,
                          "ApplicationIconThemePathChanged",
                      g_variant_new ("(is)", position,
                                         app->icon_theme_path));
@@ -993,29 +2611,21 @@ new_label (Application * app, const gchar * label, const gchar * guide)
 {
     gboolean changed = FALSE;
 
-    if (g_strcmp0(app->label, label) != 0) {
-        changed = TRUE;
-        if (app->label != NULL) {
-            g_free(app->label);
-            app->label = NULL;
-        }
-        app->label = g_strdup(label);
-    }
+    changed = set_string(&app->label, label) || changed;
+    changed = set_string(&app->guide, guide) || changed;
 
-    if (g_strcmp0(app->guide, guide) != 0) {
-        changed = TRUE;
-        if (app->guide != NULL) {
-            g_free(app->guide);
-            app->guide = NULL;
-        }
-        app->guide = g_strdup(guide);
+    if (changed) {
+        snapshot_changed(app);
     }
 
-    if (changed) {
+    if (changed && app->visible_state != VISIBLE_STATE_HIDDEN) {
         gint position = get_position(app);
         if (position == -1) return;
 
-        emit_signal (app->appstore, "ApplicationLabelChanged",
+        update_sent_value(&app->sent_label, app->label);
+        update_sent_value(&app->sent_guide, app->guide);
+
+        emit_update (app, TRUE, INDICATOR_APPLICATION_FIELD_LABEL, "ApplicationLabelChanged",
                  g_variant_new ("(iss)", position,
                                     app->label != NULL ? app->label : "",
                                     app->guide != NULL ? app->guide : ""));
@@ -1036,76 +2646,251 @@ application_service_appstore_application_add (ApplicationServiceAppstore * appst
     g_return_if_fail(IS_APPLICATION_SERVICE_APPSTORE(appstore));
     g_return_if_fail(dbus_name != NULL && dbus_name[0] != '\0');
     g_return_if_fail(dbus_object != NULL && dbus_object[0] != '\0');
+
+    /* Anyone on the bus can hand these to us, and calls to a bad
+       name or path would never come back, leaving the validation
+       slot taken for good */
+    if (!g_dbus_is_name(dbus_name) || !g_variant_is_object_path(dbus_object)) {
+        g_warning("Ignoring item with bad bus name '%s' or object path '%s'", dbus_name, dbus_object);
+        return;
+    }
+
+    TRACE(item_add, dbus_name, dbus_object, g_get_monotonic_time());
+    record_item(appstore, RECORDING_EVENT_REGISTER, dbus_name, dbus_object, NULL);
     Application * app = find_application(appstore, dbus_name, dbus_object);
 
-    if (app != NULL) {
-        g_debug("Application already exists, re-requesting properties.");
-        get_all_properties(app);
+    if (app != NULL) {
+        if (app->pending_link != NULL) {
+            g_debug("Application already exists, waiting for validation.");
+            return;
+        }
+        g_debug("Application already exists, re-requesting properties.");
+        get_all_properties(app);
+        return;
+    }
+
+    /* Build the application entry.  This will be carried
+       along until we're sure we've got everything. */
+    app = g_new0(Application, 1);
+
+    app->validated = FALSE;
+    set_string(&app->dbus_name, dbus_name);
+    set_string(&app->dbus_object, dbus_object);
+    app->appstore = appstore;
+    app->status = APP_INDICATOR_STATUS_PASSIVE;
+    app->icon = NULL;
+    app->aicon = NULL;
+    app->menu = NULL;
+    app->icon_theme_path = NULL;
+    app->label = NULL;
+    app->guide = NULL;
+    app->title = NULL;
+    app->currently_free = FALSE;
+    app->ordering_index = 0;
+    app->visible_state = VISIBLE_STATE_HIDDEN;
+    app->name_watched = FALSE;
+    app->props_cancel = NULL;
+    app->queued_props = FALSE;
+    app->registered_at = g_get_monotonic_time();
+    app->sTooltipIcon = NULL;
+    app->sTooltipTitle = NULL;
+    app->sTooltipDescription = NULL;
+
+    /* Get the DBus proxy for the NotificationItem interface.  It is
+       only used for calls, the properties are fetched by us below so
+       they don't get transferred twice, and the signals come in
+       through the appstore's subscription.  The owner of a well-known
+       name is tracked by the appstore's name watch too, so the proxy
+       doesn't need a match rule of its own for it.  Before GLib 2.72
+       that can't be turned off, and each proxy on a well-known name
+       still adds one NameOwnerChanged match rule. */
+    GDBusProxyFlags proxy_flags = G_DBUS_PROXY_FLAGS_DO_NOT_LOAD_PROPERTIES | G_DBUS_PROXY_FLAGS_DO_NOT_CONNECT_SIGNALS;
+#if GLIB_CHECK_VERSION(2, 72, 0)
+    proxy_flags |= G_DBUS_PROXY_FLAGS_NO_MATCH_RULE;
+#endif
+    app->dbus_proxy_cancel = g_cancellable_new();
+    g_dbus_proxy_new_for_bus(G_BUS_TYPE_SESSION,
+                     proxy_flags,
+                     NULL,
+                             app->dbus_name,
+                             app->dbus_object,
+                             NOTIFICATION_ITEM_DBUS_IFACE,
+                     app->dbus_proxy_cancel,
+                     dbus_proxy_cb,
+                         app);
+
+    ApplicationServiceAppstorePrivate * priv = application_service_appstore_get_instance_private(app->appstore);
+
+    call_state_init(&app->calls, &priv->calls, call_retry, app);
+
+    /* Every kind of signal starts with a full budget */
+    guint i;
+    for (i = 0; i < SIGNAL_CLASS_COUNT; i++) {
+        app->buckets[i].app = app;
+        app->buckets[i].tokens = priv->rate_burst;
+        app->buckets[i].refilled_at = app->registered_at;
+    }
+
+    priv->stats.registrations++;
+
+    app->iter = g_sequence_insert_sorted(priv->applications, app, app_sort_func, NULL);
+    g_hash_table_insert(priv->apps_by_object, app, app);
+
+    /* Validate while the proxy is being built */
+    queue_validation(app);
+
+    /* We're returning, nothing is yet added until the properties
+       come back and give us more info. */
+    return;
+}
+
+/* A name on the bus changed owners, if it's gone all the
+   apps on it went with it. */
+static void
+name_changed (GDBusConnection * connection, const gchar * sender_name,
+              const gchar * object_path, const gchar * interface_name,
+              const gchar * signal_name, GVariant * parameters,
+              gpointer user_data)
+{
+    ApplicationServiceAppstorePrivate * priv = application_service_appstore_get_instance_private(APPLICATION_SERVICE_APPSTORE(user_data));
+
+    const gchar * name = NULL;
+    const gchar * new_owner = NULL;
+    g_variant_get(parameters, "(&s&s&s)", &name, NULL, &new_owner);
+
+    if (new_owner[0] != 0) {
+        return;
+    }
+
+    GList * apps = g_hash_table_lookup(priv->apps_by_name, name);
+    if (apps == NULL) {
+        return;
+    }
+
+    /* Dying takes them out of the list */
+    apps = g_list_copy(apps);
+    g_list_foreach(apps, (GFunc)application_died, NULL);
+    g_list_free(apps);
+}
+
+/* Watches the name an app is on.  There's one subscription for
+   all the names, so the bus has only one rule to check for us. */
+static void
+watch_app_name (Application * app, GDBusConnection * connection)
+{
+    ApplicationServiceAppstorePrivate * priv = application_service_appstore_get_instance_private(app->appstore);
+
+    if (app->name_watched) {
+        return;
+    }
+
+    if (priv->watch_bus == NULL) {
+        priv->watch_bus = g_object_ref(connection);
+    }
+
+    if (priv->name_watch == 0) {
+        priv->name_watch = g_dbus_connection_signal_subscribe(connection,
+                                                              "org.freedesktop.DBus",
+                                                              "org.freedesktop.DBus",
+                                                              "NameOwnerChanged",
+                                                              "/org/freedesktop/DBus",
+                                                              NULL,
+                                                              G_DBUS_SIGNAL_FLAGS_NO_MATCH_RULE,
+                                                              name_changed,
+                                                              app->appstore,
+                                                              NULL);
+
+        /* Our own rule, so that names showing up don't get sent */
+        g_dbus_connection_call(connection,
+                               "org.freedesktop.DBus",
+                               "/org/freedesktop/DBus",
+                               "org.freedesktop.DBus",
+                               "AddMatch",
+                               g_variant_new("(s)", NAME_LOST_MATCH_RULE),
+                               NULL, G_DBUS_CALL_FLAGS_NONE, -1,
+                               NULL, NULL, NULL);
+    }
+
+    GList * apps = g_hash_table_lookup(priv->apps_by_name, app->dbus_name);
+    g_hash_table_replace(priv->apps_by_name, g_strdup(app->dbus_name), g_list_prepend(apps, app));
+    app->name_watched = TRUE;
+
+    return;
+}
+
+static void
+unwatch_app_name (Application * app)
+{
+    ApplicationServiceAppstorePrivate * priv = application_service_appstore_get_instance_private(app->appstore);
+
+    if (!app->name_watched) {
         return;
     }
 
-    /* Build the application entry.  This will be carried
-       along until we're sure we've got everything. */
-    app = g_new0(Application, 1);
+    GList * apps = g_hash_table_lookup(priv->apps_by_name, app->dbus_name);
+    apps = g_list_remove(apps, app);
 
-    app->validated = FALSE;
-    app->dbus_name = g_strdup(dbus_name);
-    app->dbus_object = g_strdup(dbus_object);
-    app->appstore = appstore;
-    app->status = APP_INDICATOR_STATUS_PASSIVE;
-    app->icon = NULL;
-    app->aicon = NULL;
-    app->menu = NULL;
-    app->icon_theme_path = NULL;
-    app->label = NULL;
-    app->guide = NULL;
-    app->title = NULL;
-    app->currently_free = FALSE;
-    app->ordering_index = 0;
-    app->visible_state = VISIBLE_STATE_HIDDEN;
-    app->name_watcher = 0;
-    app->props_cancel = NULL;
-    app->props = NULL;
-    app->queued_props = FALSE;
-    app->sTooltipIcon = NULL;
-    app->sTooltipTitle = NULL;
-    app->sTooltipDescription = NULL;
+    if (apps == NULL) {
+        g_hash_table_remove(priv->apps_by_name, app->dbus_name);
+    } else {
+        g_hash_table_replace(priv->apps_by_name, g_strdup(app->dbus_name), apps);
+    }
 
-    /* Get the DBus proxy for the NotificationItem interface */
-    app->dbus_proxy_cancel = g_cancellable_new();
-    g_dbus_proxy_new_for_bus(G_BUS_TYPE_SESSION,
-                     G_DBUS_PROXY_FLAGS_NONE,
-                     NULL,
-                             app->dbus_name,
-                             app->dbus_object,
-                             NOTIFICATION_ITEM_DBUS_IFACE,
-                     app->dbus_proxy_cancel,
-                     dbus_proxy_cb,
-                         app);
+    app->name_watched = FALSE;
+
+    return;
+}
 
+/* Puts the app in the index that item signals are routed
+   through, under the unique name it has now. */
+static void
+route_app_signals (Application * app, GDBusConnection * connection)
+{
     ApplicationServiceAppstorePrivate * priv = application_service_appstore_get_instance_private(app->appstore);
-    priv->applications = g_list_insert_sorted_with_data (priv->applications, app, app_sort_func, NULL);
 
-    /* We're returning, nothing is yet added until the properties
-       come back and give us more info. */
+    if (priv->watch_bus == NULL) {
+        priv->watch_bus = g_object_ref(connection);
+    }
+
+    /* One rule on the bus for the signals of all items */
+    if (priv->item_signals_watch == 0) {
+        priv->item_signals_watch = g_dbus_connection_signal_subscribe(connection,
+                                                                      NULL,
+                                                                      NOTIFICATION_ITEM_DBUS_IFACE,
+                                                                      NULL,
+                                                                      NULL,
+                                                                      NULL,
+                                                                      G_DBUS_SIGNAL_FLAGS_NONE,
+                                                                      item_signal,
+                                                                      app->appstore,
+                                                                      NULL);
+    }
+
+    sender_index_remove(app);
+    gchar * owner = g_dbus_proxy_get_name_owner(app->dbus_proxy);
+    set_string(&app->owner, owner);
+    g_free(owner);
+
+    if (app->owner == NULL) {
+        g_debug("No one owns '%s' right now", app->dbus_name);
+        return;
+    }
+
+    g_hash_table_replace(priv->apps_by_sender, app, app);
+
     return;
 }
 
+/* A well known name moved to another connection, so the
+   signals come from there now. */
 static void
-name_changed (GDBusConnection * connection, const gchar * sender_name,
-              const gchar * object_path, const gchar * interface_name,
-              const gchar * signal_name, GVariant * parameters,
-              gpointer user_data)
+name_owner_changed (GObject * object, GParamSpec * pspec, gpointer user_data)
 {
     Application * app = (Application *)user_data;
 
-    gchar * new_name = NULL;
-    g_variant_get(parameters, "(sss)", NULL, NULL, &new_name);
-
-    if (new_name == NULL || new_name[0] == 0)
-        application_died(app);
+    route_app_signals(app, g_dbus_proxy_get_connection(G_DBUS_PROXY(object)));
 
-    g_free(new_name);
+    return;
 }
 
 /* Callback from trying to create the proxy for the app. */
@@ -1132,125 +2917,289 @@ dbus_proxy_cb (GObject * object, GAsyncResult * res, gpointer user_data)
     if (error != NULL) {
         g_critical("Could not grab DBus proxy for %s: %s", app->dbus_name, error->message);
         g_error_free(error);
-        application_free(app);
+        /* The properties may have made it onto the panel already */
+        application_died(app);
         return;
     }
 
     /* Okay, we're good to grab the proxy at this point, we're
     sure that it's ours. */
     app->dbus_proxy = proxy;
+    TRACE(proxy_ready, app->dbus_name, app->dbus_object, TRACE_STR(app->id), g_get_monotonic_time());
 
     /* We've got it, let's watch it for destruction */
-    app->name_watcher = g_dbus_connection_signal_subscribe(
-                                       g_dbus_proxy_get_connection(proxy),
-                                       "org.freedesktop.DBus",
-                                       "org.freedesktop.DBus",
-                                       "NameOwnerChanged",
-                                       "/org/freedesktop/DBus",
-                                       g_dbus_proxy_get_name(proxy),
-                                       G_DBUS_SIGNAL_FLAGS_NONE,
-                                       name_changed,
-                                       app,
-                                       NULL);
-
-    g_signal_connect(proxy, "g-signal", G_CALLBACK(app_receive_signal), app);
+    watch_app_name(app, g_dbus_proxy_get_connection(proxy));
 
-    app->props_cancel = g_cancellable_new();
-    g_dbus_proxy_new(g_dbus_proxy_get_connection(proxy),
-                          G_DBUS_PROXY_FLAGS_NONE,
-                          NULL,
-                                  app->dbus_name,
-                                  app->dbus_object,
-                                  "org.freedesktop.DBus.Properties",
-                              app->props_cancel,
-                              props_cb,
-                              app);
+    /* And route its signals to it */
+    g_signal_connect(proxy, "notify::g-name-owner", G_CALLBACK(name_owner_changed), app);
+    route_app_signals(app, g_dbus_proxy_get_connection(proxy));
+
+    /* If there was no connection to ask for the properties
+       on before, there is one now. */
+    if (app->queued_props) {
+        app->queued_props = FALSE;
+        get_all_properties(app);
+    }
 
     return;
 }
 
-/* Callback from trying to create the proxy for the app. */
+/* Handlers for the signals of the items */
 static void
-props_cb (GObject * object, GAsyncResult * res, gpointer user_data)
+item_new_icon (Application * app, GVariant * parameters)
 {
-    GError * error = NULL;
+    /* icon name isn't provided by signal, so look it up */
+    schedule_refresh(app, PROPERTY_ICON_NAME | PROPERTY_ICON_DESC);
+}
 
-    Application * app = (Application *)user_data;
-    g_return_if_fail(app != NULL);
+static void
+item_new_aicon (Application * app, GVariant * parameters)
+{
+    /* aicon name isn't provided by signal, so look it up */
+    schedule_refresh(app, PROPERTY_AICON_NAME | PROPERTY_AICON_DESC);
+}
 
-    GDBusProxy * proxy = g_dbus_proxy_new_for_bus_finish(res, &error);
+static void
+item_new_title (Application * app, GVariant * parameters)
+{
+    /* title name isn't provided by signal, so look it up */
+    schedule_refresh(app, PROPERTY_TITLE);
+}
 
-    if (g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
-        g_error_free (error);
-        return; // Must exit before accessing freed memory
-    }
+static void
+item_new_status (Application * app, GVariant * parameters)
+{
+    const gchar * status = NULL;
+    g_variant_get(parameters, "(&s)", &status);
+    new_status(app, status);
+}
 
-    if (app->props_cancel != NULL) {
-        g_object_unref(app->props_cancel);
-        app->props_cancel = NULL;
-    }
+static void
+item_new_icon_theme_path (Application * app, GVariant * parameters)
+{
+    const gchar * icon_theme_path = NULL;
+    g_variant_get(parameters, "(&s)", &icon_theme_path);
+    new_icon_theme_path(app, icon_theme_path);
+}
 
-    if (error != NULL) {
-        g_critical("Could not grab Properties DBus proxy for %s: %s", app->dbus_name, error->message);
-        g_error_free(error);
-        application_free(app);
+static void
+item_new_label (Application * app, GVariant * parameters)
+{
+    const gchar * label = NULL, * guide = NULL;
+    g_variant_get(parameters, "(&s&s)", &label, &guide);
+    new_label(app, label, guide);
+}
+
+static void
+item_new_tooltip (Application * app, GVariant * parameters)
+{
+    // The tooltip data isn't provided by the signal, so look it up
+    schedule_refresh (app, PROPERTY_TOOLTIP);
+}
+
+static const struct {
+    const gchar * name;
+    const gchar * signature;
+    signal_class_t klass;
+    void (*handler) (Application * app, GVariant * parameters);
+} item_signal_handlers[] = {
+    { NOTIFICATION_ITEM_SIG_NEW_ICON,            "()",   SIGNAL_CLASS_ICON,            item_new_icon },
+    { NOTIFICATION_ITEM_SIG_NEW_AICON,           "()",   SIGNAL_CLASS_AICON,           item_new_aicon },
+    { NOTIFICATION_ITEM_SIG_NEW_TITLE,           "()",   SIGNAL_CLASS_TITLE,           item_new_title },
+    { NOTIFICATION_ITEM_SIG_NEW_STATUS,          "(s)",  SIGNAL_CLASS_STATUS,          item_new_status },
+    { NOTIFICATION_ITEM_SIG_NEW_ICON_THEME_PATH, "(s)",  SIGNAL_CLASS_ICON_THEME_PATH, item_new_icon_theme_path },
+    { NOTIFICATION_ITEM_SIG_NEW_LABEL,           "(ss)", SIGNAL_CLASS_LABEL,           item_new_label },
+    { NOTIFICATION_ITEM_SIG_NEW_TOOLTIP,         "()",   SIGNAL_CLASS_TOOLTIP,         item_new_tooltip }
+};
+
+/* Signal name to its entry in the table above, built once */
+static GHashTable * item_signal_index = NULL;
+
+static void
+build_item_signal_index (void)
+{
+    guint i;
+
+    if (item_signal_index != NULL) {
         return;
     }
 
-    /* Okay, we're good to grab the proxy at this point, we're
-    sure that it's ours. */
-    app->props = proxy;
+    item_signal_index = g_hash_table_new(g_str_hash, g_str_equal);
+    for (i = 0; i < G_N_ELEMENTS(item_signal_handlers); i++) {
+        g_hash_table_insert(item_signal_index, (gpointer)item_signal_handlers[i].name, GUINT_TO_POINTER(i + 1));
+    }
+}
+
+/* Drops whatever signal was waiting in the bucket */
+static void
+throttle_clear (SignalBucket * bucket)
+{
+    if (bucket->timer != 0) {
+        g_source_remove(bucket->timer);
+        bucket->timer = 0;
+    }
 
-    get_all_properties(app);
+    if (bucket->pending != NULL) {
+        g_variant_unref(bucket->pending);
+        bucket->pending = NULL;
+    }
 
     return;
 }
 
-/* Receives all signals from the service, routed to the appropriate functions */
+/* Refills the bucket for the time that went by and takes a
+   token out of it if there is one */
+static gboolean
+throttle_take (SignalBucket * bucket)
+{
+    ApplicationServiceAppstorePrivate * priv = application_service_appstore_get_instance_private(bucket->app->appstore);
+    gint64 now = g_get_monotonic_time();
+
+    bucket->tokens += (gdouble)(now - bucket->refilled_at) * priv->rate_limit / G_USEC_PER_SEC;
+    bucket->tokens = MIN(bucket->tokens, (gdouble)priv->rate_burst);
+    bucket->refilled_at = now;
+
+    if (bucket->tokens < 1.0) {
+        return FALSE;
+    }
+
+    bucket->tokens -= 1.0;
+    return TRUE;
+}
+
+static gboolean throttle_timeout (gpointer user_data);
+
+/* Wakes up once the bucket has a token again */
 static void
-app_receive_signal (GDBusProxy * proxy, gchar * sender_name, gchar * signal_name,
-                    GVariant * parameters, gpointer user_data)
+throttle_schedule (SignalBucket * bucket)
 {
-    Application * app = (Application *)user_data;
+    ApplicationServiceAppstorePrivate * priv = application_service_appstore_get_instance_private(bucket->app->appstore);
+    guint delay = (guint)((1.0 - bucket->tokens) * 1000.0 / priv->rate_limit) + 1;
 
-    if (!app->validated) return;
+    bucket->timer = g_timeout_add(delay, throttle_timeout, bucket);
 
-    if (g_strcmp0(signal_name, NOTIFICATION_ITEM_SIG_NEW_ICON) == 0) {
-        /* icon name isn't provided by signal, so look it up */
-        get_all_properties(app);
+    return;
+}
+
+/* Lets the latest of the signals that had to wait through */
+static gboolean
+throttle_timeout (gpointer user_data)
+{
+    SignalBucket * bucket = (SignalBucket *)user_data;
+
+    bucket->timer = 0;
+
+    if (!throttle_take(bucket)) {
+        throttle_schedule(bucket);
+        return G_SOURCE_REMOVE;
     }
-    else if (g_strcmp0(signal_name, NOTIFICATION_ITEM_SIG_NEW_AICON) == 0) {
-        /* aicon name isn't provided by signal, so look it up */
-        get_all_properties(app);
+
+    GVariant * parameters = bucket->pending;
+    bucket->pending = NULL;
+
+    if (parameters != NULL && bucket->app->validated) {
+        item_signal_handlers[bucket->handler].handler(bucket->app, parameters);
     }
-    else if (g_strcmp0(signal_name, NOTIFICATION_ITEM_SIG_NEW_TITLE) == 0) {
-        /* title name isn't provided by signal, so look it up */
-        get_all_properties(app);
+
+    if (parameters != NULL) {
+        g_variant_unref(parameters);
     }
-    else if (g_strcmp0(signal_name, NOTIFICATION_ITEM_SIG_NEW_STATUS) == 0) {
-        gchar * status = NULL;
-        g_variant_get(parameters, "(s)", &status);
-        new_status(app, status);
-        g_free(status);
-    }
-    else if (g_strcmp0(signal_name, NOTIFICATION_ITEM_SIG_NEW_ICON_THEME_PATH) == 0) {
-        gchar * icon_theme_path = NULL;
-        g_variant_get(parameters, "(s)", &icon_theme_path);
-        new_icon_theme_path(app, icon_theme_path);
-        g_free(icon_theme_path);
-    }
-    else if (g_strcmp0(signal_name, NOTIFICATION_ITEM_SIG_NEW_LABEL) == 0) {
-        gchar * label = NULL, * guide = NULL;
-        g_variant_get(parameters, "(ss)", &label, &guide);
-        new_label(app, label, guide);
-        g_free(label);
-        g_free(guide);
-    }
-    else if (g_strcmp0 (signal_name, NOTIFICATION_ITEM_SIG_NEW_TOOLTIP) == 0)
-    {
-        // The tooltip data isn't provided by the signal, so look it up
-        get_all_properties (app);
+
+    return G_SOURCE_REMOVE;
+}
+
+/* Whether the signal can be handled now.  If not it gets kept,
+   replacing anything older of the same kind, until the item has
+   the budget for it. */
+static gboolean
+throttle_signal (Application * app, guint handler, GVariant * parameters)
+{
+    ApplicationServiceAppstorePrivate * priv = application_service_appstore_get_instance_private(app->appstore);
+    SignalBucket * bucket = &app->buckets[item_signal_handlers[handler].klass];
+
+    if (priv->rate_limit == 0) {
+        return TRUE;
+    }
+
+    /* Going in or out of needing attention is what the user should
+       see right away, and it makes anything waiting stale */
+    if (item_signal_handlers[handler].klass == SIGNAL_CLASS_STATUS) {
+        const gchar * status = NULL;
+        g_variant_get(parameters, "(&s)", &status);
+
+        if (app->status == APP_INDICATOR_STATUS_ATTENTION ||
+                string_to_status(status) == APP_INDICATOR_STATUS_ATTENTION) {
+            throttle_clear(bucket);
+            return TRUE;
+        }
+    }
+
+    if (bucket->timer == 0 && throttle_take(bucket)) {
+        return TRUE;
+    }
+
+    bucket->throttled++;
+    priv->stats.signals_throttled++;
+
+    if (bucket->pending != NULL) {
+        g_variant_unref(bucket->pending);
+    }
+    bucket->pending = g_variant_ref(parameters);
+    bucket->handler = handler;
+
+    if (bucket->timer == 0) {
+        throttle_schedule(bucket);
+    }
+
+    return FALSE;
+}
+
+/* Receives the signals of all the items, routed to the
+   application they came from and the function for them */
+static void
+item_signal (GDBusConnection * connection, const gchar * sender,
+             const gchar * path, const gchar * interface,
+             const gchar * signal, GVariant * parameters,
+             gpointer user_data)
+{
+    ApplicationServiceAppstorePrivate * priv = application_service_appstore_get_instance_private(APPLICATION_SERVICE_APPSTORE(user_data));
+
+    gpointer entry = g_hash_table_lookup(item_signal_index, signal);
+    if (entry == NULL) {
+        return;
+    }
+
+    Application key = {0};
+    key.owner = (gchar *)sender;
+    key.dbus_object = (gchar *)path;
+
+    Application * app = (Application *)g_hash_table_lookup(priv->apps_by_sender, &key);
+    if (app == NULL || !app->validated) {
+        return;
+    }
+
+    guint i = GPOINTER_TO_UINT(entry) - 1;
+
+    /* Items that send something else, only get looked at again */
+    if (!g_variant_is_of_type(parameters, G_VARIANT_TYPE(item_signal_handlers[i].signature))) {
+        g_warning("Item '%s' sent %s with type '%s'", app->id, signal, g_variant_get_type_string(parameters));
+        return;
+    }
+
+    TRACE(item_signal, app->dbus_name, app->dbus_object, TRACE_STR(app->id), signal, g_get_monotonic_time());
+    record_item(app->appstore, RECORDING_EVENT_SIGNAL, app->dbus_name, app->dbus_object,
+                g_variant_new("(sv)", signal, parameters));
+
+    app->buckets[item_signal_handlers[i].klass].received++;
+    priv->stats.signals_received++;
+
+    if (!throttle_signal(app, i, parameters)) {
+        return;
     }
+
+    item_signal_handlers[i].handler(app, parameters);
+
+    return;
 }
 
 /* Looks for an application in the list of applications */
@@ -1259,17 +3208,11 @@ find_application (ApplicationServiceAppstore * appstore, const gchar * address,
 {
     ApplicationServiceAppstorePrivate * priv = application_service_appstore_get_instance_private(appstore);
 
-    GList * listpntr;
-
-    for (listpntr = priv->applications; listpntr != NULL; listpntr = g_list_next(listpntr)) {
-        Application * app = (Application *)listpntr->data;
-
-        if (!g_strcmp0(app->dbus_name, address) && !g_strcmp0(app->dbus_object, object)) {
-            return app;
-        }
-    }
+    Application key = { 0 };
+    key.dbus_name = (gchar *)address;
+    key.dbus_object = (gchar *)object;
 
-    return NULL;
+    return (Application *)g_hash_table_lookup(priv->apps_by_object, &key);
 }
 
 /* Looks for an application in the list of applications with the matching menu */
@@ -1282,17 +3225,13 @@ find_application_by_menu (ApplicationServiceAppstore * appstore, const gchar * a
 
     ApplicationServiceAppstorePrivate * priv = application_service_appstore_get_instance_private(appstore);
 
-    GList *l;
+    Application key = { 0 };
+    key.dbus_name = (gchar *)address;
+    key.menu = (gchar *)menuobject;
 
-    for (l = priv->applications; l != NULL; l = l->next) {
-        Application *a = l->data;
-        if (g_strcmp0(a->dbus_name, address) == 0 &&
-              g_strcmp0(a->menu, menuobject) == 0) {
-            return a;
-        }
-    }
+    GQueue * chain = g_hash_table_lookup(priv->apps_by_menu, &key);
 
-    return NULL;
+    return chain != NULL ? (Application *)g_queue_peek_head(chain) : NULL;
 }
 
 /* Removes an application.  Currently only works for the apps
@@ -1317,20 +3256,18 @@ application_service_appstore_application_remove (ApplicationServiceAppstore * ap
 gchar**
 application_service_appstore_application_get_list (ApplicationServiceAppstore * appstore)
 {
-    ApplicationServiceAppstorePrivate * priv = application_service_appstore_get_instance_private(appstore);
-
-    gchar ** out;
-    gchar ** outpntr;
-    GList * listpntr;
+    return g_strdupv((gchar **)application_service_appstore_get_items(appstore));
+}
 
-    out = g_new(gchar*, g_list_length(priv->applications) + 1);
+/* The "busname/path" of every validated application in the order
+   they were validated.  It's kept up to date as they come and go, so it stays ours
+   and is only good until the next of them. */
+const gchar * const *
+application_service_appstore_get_items (ApplicationServiceAppstore * appstore)
+{
+    ApplicationServiceAppstorePrivate * priv = application_service_appstore_get_instance_private(appstore);
 
-    for (listpntr = priv->applications, outpntr = out; listpntr != NULL; listpntr = g_list_next(listpntr), ++outpntr) {
-        Application * app = (Application *)listpntr->data;
-        *outpntr = g_strdup_printf("%s%s", app->dbus_name, app->dbus_object);
-    }
-    *outpntr = 0;
-    return out;
+    return (const gchar * const *)priv->item_names->pdata;
 }
 
 /* Creates a basic appstore object and attaches the
@@ -1342,49 +3279,152 @@ application_service_appstore_new (void)
     return appstore;
 }
 
+/* Drops the snapshot, the next caller builds a new one */
+static void
+snapshot_invalidate (ApplicationServiceAppstore * appstore)
+{
+    ApplicationServiceAppstorePrivate * priv = application_service_appstore_get_instance_private(appstore);
+
+    g_clear_pointer(&priv->snapshot, g_variant_unref);
+
+    return;
+}
+
+/* Something about the application changed, which only matters
+   to the snapshot if the application is in it */
+static void
+snapshot_changed (Application * app)
+{
+    if (app->visible_state != VISIBLE_STATE_HIDDEN) {
+        snapshot_invalidate(app->appstore);
+    }
+
+    return;
+}
+
 /* DBus Interface */
+/* The list of visible applications.  It gets built and serialized
+   once and every caller gets a ref on the same one until something
+   in it changes, so panels starting together cost one build. */
 static GVariant *
-get_applications (ApplicationServiceAppstore * appstore)
+get_application_list (ApplicationServiceAppstore * appstore)
 {
     ApplicationServiceAppstorePrivate * priv = application_service_appstore_get_instance_private(appstore);
 
-    GVariant * out = NULL;
+    /* The list has to match the generation we hand out */
+    flush_updates(appstore);
 
-    if (g_list_length(priv->applications) > 0) {
-        GVariantBuilder builder;
-        GList * listpntr;
-        gint position = 0;
+    if (priv->snapshot != NULL) {
+        priv->stats.snapshot_hits++;
+        return g_variant_ref(priv->snapshot);
+    }
 
-        g_variant_builder_init(&builder, G_VARIANT_TYPE ("a(sisosssssssss)"));
+    GVariantBuilder builder;
+    GSequenceIter * iter;
+    gint position = 0;
 
-        for (listpntr = priv->applications; listpntr != NULL; listpntr = g_list_next(listpntr)) {
-            Application * app = (Application *)listpntr->data;
-            if (app->visible_state == VISIBLE_STATE_HIDDEN) {
-                continue;
-            }
+    g_variant_builder_init(&builder, G_VARIANT_TYPE ("a(sisosssssssss)"));
 
-            g_variant_builder_add (&builder, "(sisosssssssss)", app->icon,
-                                   position++, app->dbus_name, app->menu,
-                                   app->icon_theme_path, app->label,
-                                   app->guide,
-                                   (app->icon_desc != NULL) ? app->icon_desc : "",
-                                   app->id, app->title, app->sTooltipIcon != NULL ? app->sTooltipIcon : "", app->sTooltipTitle != NULL ? app->sTooltipTitle : "", app->sTooltipDescription != NULL ? app->sTooltipDescription : "");
-        }
+    for (iter = g_sequence_get_begin_iter(priv->visible_applications); !g_sequence_iter_is_end(iter); iter = g_sequence_iter_next(iter)) {
+        Application * app = (Application *)g_sequence_get(iter);
 
-        out = g_variant_builder_end(&builder);
-    } else {
-        GError * error = NULL;
-        out = g_variant_parse(g_variant_type_new("a(sisosssssssss)"), "[]", NULL, NULL, &error);
-        if (error != NULL) {
-            g_warning("Unable to parse '[]' as a 'a(sisosssssssss)': %s", error->message);
-            out = NULL;
-            g_error_free(error);
+        g_variant_builder_add (&builder, "(sisosssssssss)", app->icon,
+                               position++, app->dbus_name, app->menu,
+                               app->icon_theme_path, app->label,
+                               app->guide,
+                               (app->icon_desc != NULL) ? app->icon_desc : "",
+                               app->id, app->title, app->sTooltipIcon != NULL ? app->sTooltipIcon : "", app->sTooltipTitle != NULL ? app->sTooltipTitle : "", app->sTooltipDescription != NULL ? app->sTooltipDescription : "");
+    }
+
+    priv->snapshot = g_variant_ref_sink(g_variant_builder_end(&builder));
+    priv->stats.snapshot_builds++;
+
+    /* Serialize it now, the replies then only copy the data */
+    g_variant_get_data(priv->snapshot);
+
+    return g_variant_ref(priv->snapshot);
+}
+
+static GVariant *
+get_applications (ApplicationServiceAppstore * appstore, const gchar * sender)
+{
+    ApplicationServiceAppstorePrivate * priv = application_service_appstore_get_instance_private(appstore);
+    GVariant * list = get_application_list(appstore);
+    Client * client = clients_find_subscribed(priv->clients, sender);
+
+    if (client != NULL) {
+        list = client_list(client, list);
+    }
+
+    GVariant * out = g_variant_new_tuple(&list, 1);
+
+    g_variant_unref(list);
+
+    return out;
+}
+
+/* Tells a panel what changed since the generation it last saw.  If
+   that's further back than our history goes, or from another
+   instance of the service, it gets the whole list instead. */
+static GVariant *
+get_applications_since (ApplicationServiceAppstore * appstore, const gchar * sender, guint64 since)
+{
+    ApplicationServiceAppstorePrivate * priv = application_service_appstore_get_instance_private(appstore);
+
+    GVariant * list = get_application_list(appstore);
+
+    /* There's no history of what a subscribed client saw, it's
+       either up to date or gets its whole list */
+    Client * client = clients_find_subscribed(priv->clients, sender);
+    if (client != NULL) {
+        gboolean full = !client_up_to_date(client, since);
+
+        if (full) {
+            list = client_list(client, list);
+        } else {
+            g_variant_unref(list);
+            list = g_variant_ref_sink(g_variant_new_array(G_VARIANT_TYPE("(sisosssssssss)"), NULL, 0));
         }
+
+        GVariant * out = g_variant_new("(tb@a(sisosssssssss)@a(sv))", client_get_generation(client), full, list,
+                                       g_variant_new_array(G_VARIANT_TYPE("(sv)"), NULL, 0));
+        g_variant_unref(list);
+
+        return out;
     }
 
-    if (out != NULL) {
-        return g_variant_new_tuple(&out, 1);
-    } else {
-        return NULL;
+    gboolean full = TRUE;
+    if (since == priv->generation) {
+        full = FALSE;
+    } else if (since != 0 && since < priv->generation && !g_queue_is_empty(priv->history)) {
+        HistoryEntry * oldest = (HistoryEntry *)g_queue_peek_head(priv->history);
+        full = (oldest->generation > since + 1);
+    }
+
+    GVariantBuilder changes;
+    g_variant_builder_init(&changes, G_VARIANT_TYPE("a(sv)"));
+
+    if (!full) {
+        GList * link;
+
+        /* Skip the list, the changes are all they need */
+        g_variant_unref(list);
+        list = g_variant_ref_sink(g_variant_new_array(G_VARIANT_TYPE("(sisosssssssss)"), NULL, 0));
+
+        for (link = g_queue_peek_head_link(priv->history); link != NULL; link = link->next) {
+            HistoryEntry * entry = (HistoryEntry *)link->data;
+
+            if (entry->generation > since) {
+                g_variant_builder_add(&changes, "(sv)", entry->name, entry->params);
+            }
+        }
     }
+
+    g_debug("Panel at generation %" G_GUINT64_FORMAT " gets %s up to %" G_GUINT64_FORMAT,
+            since, full ? "the list" : "the changes", priv->generation);
+
+    GVariant * out = g_variant_new("(tb@a(sisosssssssss)a(sv))", priv->generation, full, list, &changes);
+    g_variant_unref(list);
+
+    return out;
 }
@@ -61,6 +61,7 @@ void  application_service_appstore_application_remove     (ApplicationServiceApp
                                                            const gchar *             dbus_name,
                                                            const gchar *             dbus_object);
 gchar** application_service_appstore_application_get_list (ApplicationServiceAppstore *   appstore);
+const gchar * const * application_service_appstore_get_items (ApplicationServiceAppstore *   appstore);
 
 G_END_DECLS
 
@@ -0,0 +1,190 @@
+/*
+How long the service waits for the items it calls, and how it leaves
+alone an item that stopped answering.
+
+This program is free software: you can redistribute it and/or modify it
+under the terms of the GNU General Public License version 3, as published
+by the Free Software Foundation.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranties of
+MERCHANTABILITY, SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR
+PURPOSE.  See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "application-service-calls.h"
+
+/* The first quarantine of an item and the longest one, in
+   milliseconds */
+#define QUARANTINE_DELAY      1000
+#define QUARANTINE_MAX_DELAY  300000
+
+/* The timeouts are kept within the bounds, the lower one is at
+   least a millisecond so there's always a timeout */
+void
+call_policy_init (CallPolicy * policy, guint timeout_min, guint timeout_max, guint quarantine_failures)
+{
+	policy->timeout_min = MAX(timeout_min, 1);
+	policy->timeout_max = MAX(timeout_max, policy->timeout_min);
+	policy->quarantine_failures = quarantine_failures;
+	policy->timed_out = 0;
+	policy->quarantines = 0;
+
+	return;
+}
+
+void
+call_policy_add_counters (const CallPolicy * policy, GVariantBuilder * counters)
+{
+	g_variant_builder_add(counters, "{st}", "calls-timed-out", policy->timed_out);
+	g_variant_builder_add(counters, "{st}", "quarantines", policy->quarantines);
+
+	return;
+}
+
+void
+call_state_init (CallState * state, CallPolicy * policy, CallRetryFunc retry, gpointer user_data)
+{
+	state->policy = policy;
+	state->latency = 0;
+	state->latency_var = 0;
+	state->failures = 0;
+	state->timeouts = 0;
+	state->quarantines = 0;
+	state->quarantine_timer = 0;
+	state->retry = retry;
+	state->user_data = user_data;
+
+	return;
+}
+
+/* Ends the quarantine without a retry, for when the item goes */
+void
+call_state_clear (CallState * state)
+{
+	if (state->quarantine_timer != 0) {
+		g_source_remove(state->quarantine_timer);
+		state->quarantine_timer = 0;
+	}
+
+	return;
+}
+
+/* How long we wait for the item to answer, in milliseconds.  Until
+   the item has answered once we know nothing about it, a slow start
+   shouldn't count against it, so it gets the D-Bus default (-1). */
+gint
+call_state_timeout (const CallState * state)
+{
+	if (state->latency == 0) {
+		return -1;
+	}
+
+	gint64 timeout = (state->latency + 4 * state->latency_var) / G_TIME_SPAN_MILLISECOND;
+
+	return CLAMP(timeout, (gint64)state->policy->timeout_min, (gint64)state->policy->timeout_max);
+}
+
+/* Whether the item itself answered, even if with an error.  The
+   bus answering in its place doesn't count. */
+gboolean
+call_answered (const GError * error)
+{
+	if (error == NULL) {
+		return TRUE;
+	}
+
+	if (g_error_matches(error, G_DBUS_ERROR, G_DBUS_ERROR_NO_REPLY) ||
+	    g_error_matches(error, G_DBUS_ERROR, G_DBUS_ERROR_TIMEOUT) ||
+	    g_error_matches(error, G_DBUS_ERROR, G_DBUS_ERROR_TIMED_OUT) ||
+	    g_error_matches(error, G_DBUS_ERROR, G_DBUS_ERROR_SERVICE_UNKNOWN) ||
+	    g_error_matches(error, G_DBUS_ERROR, G_DBUS_ERROR_NAME_HAS_NO_OWNER)) {
+		return FALSE;
+	}
+
+	return g_dbus_error_is_remote_error(error);
+}
+
+/* The quarantine is over.  The item gets one call, if that gets no
+   answer either it's back in for longer. */
+static gboolean
+quarantine_timeout (gpointer user_data)
+{
+	CallState * state = (CallState *)user_data;
+
+	state->quarantine_timer = 0;
+	state->failures = state->policy->quarantine_failures - 1;
+
+	state->retry(state->user_data);
+
+	return G_SOURCE_REMOVE;
+}
+
+/* Learns from how a call to the item went.  Answers go into the
+   latency the timeouts are based on, too many calls in a row
+   without one put the item in quarantine.  Returns how long that
+   is in milliseconds if it starts now, zero otherwise. */
+guint
+call_state_done (CallState * state, gint64 requested_at, const GError * error)
+{
+	CallPolicy * policy = state->policy;
+
+	if (call_answered(error)) {
+		gint64 sample = MAX(g_get_monotonic_time() - requested_at, 1);
+
+		if (state->latency == 0) {
+			state->latency = sample;
+			state->latency_var = sample / 2;
+		} else {
+			state->latency_var = (3 * state->latency_var + ABS(state->latency - sample)) / 4;
+			state->latency = (7 * state->latency + sample) / 8;
+		}
+
+		state->failures = 0;
+		state->quarantines = 0;
+		return 0;
+	}
+
+	if (g_error_matches(error, G_IO_ERROR, G_IO_ERROR_TIMED_OUT)) {
+		state->timeouts++;
+		policy->timed_out++;
+	}
+
+	state->failures++;
+
+	if (policy->quarantine_failures == 0 || state->failures < policy->quarantine_failures || state->quarantine_timer != 0) {
+		return 0;
+	}
+
+	guint delay = MIN((guint64)QUARANTINE_DELAY << MIN(state->quarantines, 16), QUARANTINE_MAX_DELAY);
+
+	state->quarantines++;
+	policy->quarantines++;
+	state->quarantine_timer = g_timeout_add(delay, quarantine_timeout, state);
+
+	return delay;
+}
+
+gboolean
+call_state_quarantined (const CallState * state)
+{
+	return state->quarantine_timer != 0;
+}
+
+void
+call_state_add_counters (const CallState * state, GVariantBuilder * counters)
+{
+	g_variant_builder_add(counters, "{st}", "latency", (guint64)state->latency);
+	g_variant_builder_add(counters, "{st}", "latency-variation", (guint64)state->latency_var);
+	/* Zero while the item still gets the D-Bus default */
+	g_variant_builder_add(counters, "{st}", "call-timeout", (guint64)MAX(call_state_timeout(state), 0) * G_TIME_SPAN_MILLISECOND);
+	g_variant_builder_add(counters, "{st}", "calls-timed-out", (guint64)state->timeouts);
+	g_variant_builder_add(counters, "{st}", "failures", (guint64)state->failures);
+	g_variant_builder_add(counters, "{st}", "quarantines", (guint64)state->quarantines);
+	g_variant_builder_add(counters, "{st}", "quarantined", (guint64)call_state_quarantined(state));
+
+	return;
+}
@@ -0,0 +1,74 @@
+/*
+How long the service waits for the items it calls, and how it leaves
+alone an item that stopped answering.
+
+This program is free software: you can redistribute it and/or modify it
+under the terms of the GNU General Public License version 3, as published
+by the Free Software Foundation.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranties of
+MERCHANTABILITY, SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR
+PURPOSE.  See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __APPLICATION_SERVICE_CALLS_H__
+#define __APPLICATION_SERVICE_CALLS_H__
+
+#include <gio/gio.h>
+
+G_BEGIN_DECLS
+
+/* The same for all the items, along with what happened to them */
+typedef struct {
+	guint timeout_min;         /* milliseconds */
+	guint timeout_max;
+	guint quarantine_failures; /* zero for no quarantine */
+	guint64 timed_out;
+	guint64 quarantines;
+} CallPolicy;
+
+/* The quarantine of an item is over and it can be called again */
+typedef void (*CallRetryFunc) (gpointer user_data);
+
+/* What we learned about calling one item */
+typedef struct {
+	CallPolicy * policy;  /* not owned */
+	gint64 latency;       /* smoothed, in microseconds, 0 until it answered */
+	gint64 latency_var;
+	guint failures;       /* calls in a row that got no answer */
+	guint timeouts;
+	guint quarantines;    /* times in a row it was left alone */
+	guint quarantine_timer;
+	CallRetryFunc retry;
+	gpointer user_data;
+} CallState;
+
+void     call_policy_init         (CallPolicy *       policy,
+                                   guint              timeout_min,
+                                   guint              timeout_max,
+                                   guint              quarantine_failures);
+void     call_policy_add_counters (const CallPolicy * policy,
+                                   GVariantBuilder *  counters);
+
+void     call_state_init          (CallState *        state,
+                                   CallPolicy *       policy,
+                                   CallRetryFunc      retry,
+                                   gpointer           user_data);
+void     call_state_clear         (CallState *        state);
+gint     call_state_timeout       (const CallState *  state);
+guint    call_state_done          (CallState *        state,
+                                   gint64             requested_at,
+                                   const GError *     error);
+gboolean call_state_quarantined   (const CallState *  state);
+void     call_state_add_counters  (const CallState *  state,
+                                   GVariantBuilder *  counters);
+
+gboolean call_answered            (const GError *     error);
+
+G_END_DECLS
+
+#endif
@@ -0,0 +1,871 @@
+/*
+The panels talking to the service, which kind of updates each of them
+wants and, once it subscribed, which items and fields it gets.
+
+This program is free software: you can redistribute it and/or modify it
+under the terms of the GNU General Public License version 3, as published
+by the Free Software Foundation.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranties of
+MERCHANTABILITY, SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR
+PURPOSE.  See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "application-service-clients.h"
+#include "dbus-shared.h"
+
+struct _Clients {
+	GHashTable * table;   /* bus name -> Client */
+	guint legacy;
+	guint batched;
+	guint subscribed;
+	ClientsFlushFunc flush;
+	gpointer user_data;
+};
+
+/* Once a client subscribed it only gets the items and fields it
+   asked for, with positions counted among those items. */
+struct _Client {
+	Clients * clients;    /* not ref'd */
+	GDBusConnection * bus;
+	gchar * name;
+	gint version;
+	guint watch;
+	gboolean subscribed;
+	GHashTable * allow;   /* item IDs, NULL for all of them */
+	GHashTable * deny;    /* item IDs, NULL for none */
+	guint fields;
+	guint max_rate;       /* ApplicationsChanged per second, 0 for no limit */
+	GSequence * visible;  /* for each visible application, its node in given or NULL */
+	GSequence * given;    /* the ones the client gets, each pointing back into visible */
+	guint64 generation;
+	GHashTable * held;    /* position -> HeldChange, waiting for the rate */
+	gint64 sent_at;
+	guint held_timer;
+};
+
+/* Field changes of one item that a client hasn't been sent yet */
+typedef struct {
+	guint fields;
+	GVariantDict * values;
+} HeldChange;
+
+static void client_free (gpointer data);
+
+Clients *
+clients_new (ClientsFlushFunc flush, gpointer user_data)
+{
+	Clients * clients = g_new0(Clients, 1);
+
+	clients->table = g_hash_table_new_full(g_str_hash, g_str_equal, NULL, client_free);
+	clients->flush = flush;
+	clients->user_data = user_data;
+
+	return clients;
+}
+
+/* Forgets all the clients, they don't get anything anymore */
+void
+clients_clear (Clients * clients)
+{
+	g_hash_table_remove_all(clients->table);
+	clients->legacy = 0;
+	clients->batched = 0;
+	clients->subscribed = 0;
+
+	return;
+}
+
+void
+clients_free (Clients * clients)
+{
+	if (clients == NULL) {
+		return;
+	}
+
+	g_hash_table_destroy(clients->table);
+	g_free(clients);
+
+	return;
+}
+
+guint
+clients_count (Clients * clients)
+{
+	return g_hash_table_size(clients->table);
+}
+
+/* The clients that only know the per field signals */
+guint
+clients_legacy (Clients * clients)
+{
+	return clients->legacy;
+}
+
+/* The clients that get the field changes in ApplicationsChanged */
+guint
+clients_batched (Clients * clients)
+{
+	return clients->batched;
+}
+
+/* The clients that get their own signals instead of the broadcast */
+guint
+clients_subscribed (Clients * clients)
+{
+	return clients->subscribed;
+}
+
+/* Recounts which kinds of updates our clients want */
+static void
+count_clients (Clients * clients)
+{
+	GHashTableIter iter;
+	gpointer value;
+
+	clients->legacy = 0;
+	clients->batched = 0;
+	clients->subscribed = 0;
+
+	g_hash_table_iter_init(&iter, clients->table);
+	while (g_hash_table_iter_next(&iter, NULL, &value)) {
+		Client * client = (Client *)value;
+
+		/* Subscribed clients don't listen to the broadcast */
+		if (client->subscribed) {
+			clients->subscribed++;
+		} else if (client->version >= INDICATOR_APPLICATION_SERVICE_BATCHED_VERSION) {
+			clients->batched++;
+		} else {
+			clients->legacy++;
+		}
+	}
+
+	return;
+}
+
+/* A client went away, it doesn't need any updates anymore */
+static void
+client_vanished (GDBusConnection * connection, const gchar * name, gpointer user_data)
+{
+	Client * client = (Client *)user_data;
+	Clients * clients = client->clients;
+
+	g_debug("Client '%s' vanished", name);
+
+	/* Anything pending was meant for it as well */
+	clients->flush(clients->user_data);
+
+	g_hash_table_remove(clients->table, name);
+	count_clients(clients);
+
+	return;
+}
+
+static void
+client_free (gpointer data)
+{
+	Client * client = (Client *)data;
+
+	if (client->watch != 0) {
+		g_bus_unwatch_name(client->watch);
+	}
+
+	if (client->held_timer != 0) {
+		g_source_remove(client->held_timer);
+	}
+
+	if (client->allow != NULL) {
+		g_hash_table_destroy(client->allow);
+	}
+
+	if (client->deny != NULL) {
+		g_hash_table_destroy(client->deny);
+	}
+
+	g_sequence_free(client->given);
+	g_sequence_free(client->visible);
+	g_hash_table_destroy(client->held);
+	g_object_unref(client->bus);
+	g_free(client->name);
+	g_free(client);
+
+	return;
+}
+
+static void
+held_change_free (gpointer data)
+{
+	HeldChange * held = (HeldChange *)data;
+
+	g_variant_dict_unref(held->values);
+	g_free(held);
+
+	return;
+}
+
+/* Remembers the protocol version of a client.  A version of zero
+   means that the client didn't say, which doesn't override what it
+   told us before. */
+void
+clients_register (Clients * clients, GDBusConnection * bus, const gchar * sender, gint version)
+{
+	if (sender == NULL || bus == NULL) {
+		return;
+	}
+
+	Client * client = g_hash_table_lookup(clients->table, sender);
+
+	if (client == NULL) {
+		client = g_new0(Client, 1);
+		client->clients = clients;
+		client->bus = g_object_ref(bus);
+		client->name = g_strdup(sender);
+		client->version = version;
+		client->fields = INDICATOR_APPLICATION_FIELD_ALL;
+		client->visible = g_sequence_new(NULL);
+		client->given = g_sequence_new(NULL);
+		client->held = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, held_change_free);
+		g_hash_table_insert(clients->table, client->name, client);
+
+		client->watch = g_bus_watch_name_on_connection(bus, sender,
+		                                               G_BUS_NAME_WATCHER_FLAGS_NONE,
+		                                               NULL, client_vanished,
+		                                               client, NULL);
+	} else if (version != 0) {
+		client->version = version;
+	}
+
+	g_debug("Client '%s' uses protocol version %d", sender, client->version);
+
+	/* Updates still waiting are sent before the client switches */
+	clients->flush(clients->user_data);
+	count_clients(clients);
+
+	return;
+}
+
+/* The per field signals and the field each of them carries */
+static const struct {
+	const gchar * name;
+	guint field;
+} update_signals[] = {
+	{ "ApplicationIconChanged",          INDICATOR_APPLICATION_FIELD_ICON },
+	{ "ApplicationIconThemePathChanged", INDICATOR_APPLICATION_FIELD_ICON_THEME_PATH },
+	{ "ApplicationLabelChanged",         INDICATOR_APPLICATION_FIELD_LABEL },
+	{ "ApplicationTitleChanged",         INDICATOR_APPLICATION_FIELD_TITLE },
+	{ "ApplicationTooltipChanged",       INDICATOR_APPLICATION_FIELD_TOOLTIP }
+};
+
+/* The keys of an ApplicationsChanged entry and their fields */
+static const struct {
+	const gchar * key;
+	guint field;
+} change_keys[] = {
+	{ "icon",                INDICATOR_APPLICATION_FIELD_ICON },
+	{ "icon-desc",           INDICATOR_APPLICATION_FIELD_ICON },
+	{ "icon-theme-path",     INDICATOR_APPLICATION_FIELD_ICON_THEME_PATH },
+	{ "label",               INDICATOR_APPLICATION_FIELD_LABEL },
+	{ "guide",               INDICATOR_APPLICATION_FIELD_LABEL },
+	{ "title",               INDICATOR_APPLICATION_FIELD_TITLE },
+	{ "tooltip-icon",        INDICATOR_APPLICATION_FIELD_TOOLTIP },
+	{ "tooltip-title",       INDICATOR_APPLICATION_FIELD_TOOLTIP },
+	{ "tooltip-description", INDICATOR_APPLICATION_FIELD_TOOLTIP }
+};
+
+/* The field of each entry in an application tuple, as
+   ApplicationAdded and GetApplications have them */
+static const guint application_fields[] = {
+	INDICATOR_APPLICATION_FIELD_ICON,            /* icon */
+	0,                                           /* position */
+	0,                                           /* bus name */
+	0,                                           /* menu */
+	INDICATOR_APPLICATION_FIELD_ICON_THEME_PATH, /* icon theme path */
+	INDICATOR_APPLICATION_FIELD_LABEL,           /* label */
+	INDICATOR_APPLICATION_FIELD_LABEL,           /* guide */
+	INDICATOR_APPLICATION_FIELD_ICON,            /* icon description */
+	0,                                           /* id */
+	INDICATOR_APPLICATION_FIELD_TITLE,           /* title */
+	INDICATOR_APPLICATION_FIELD_TOOLTIP,         /* tooltip icon */
+	INDICATOR_APPLICATION_FIELD_TOOLTIP,         /* tooltip title */
+	INDICATOR_APPLICATION_FIELD_TOOLTIP          /* tooltip description */
+};
+
+static guint
+signal_field (const gchar * name)
+{
+	guint i;
+
+	for (i = 0; i < G_N_ELEMENTS(update_signals); i++) {
+		if (g_strcmp0(update_signals[i].name, name) == 0) {
+			return update_signals[i].field;
+		}
+	}
+
+	return 0;
+}
+
+static guint
+change_key_field (const gchar * key)
+{
+	guint i;
+
+	for (i = 0; i < G_N_ELEMENTS(change_keys); i++) {
+		if (g_strcmp0(change_keys[i].key, key) == 0) {
+			return change_keys[i].field;
+		}
+	}
+
+	return 0;
+}
+
+/* Whether the client asked for the item with this ID */
+static gboolean
+client_allows (Client * client, const gchar * id)
+{
+	if (id == NULL) {
+		id = "";
+	}
+
+	if (client->allow != NULL && !g_hash_table_contains(client->allow, id)) {
+		return FALSE;
+	}
+
+	if (client->deny != NULL && g_hash_table_contains(client->deny, id)) {
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+static gint
+client_visible_count (Client * client)
+{
+	return g_sequence_get_length(client->visible);
+}
+
+/* The node among the ones the client gets of the application at
+   this position, NULL if it doesn't get it */
+static GSequenceIter *
+client_given_iter (Client * client, gint position)
+{
+	if (position < 0 || position >= client_visible_count(client)) {
+		return NULL;
+	}
+
+	return g_sequence_get(g_sequence_get_iter_at_pos(client->visible, position));
+}
+
+static gboolean
+client_shows (Client * client, gint position)
+{
+	return client_given_iter(client, position) != NULL;
+}
+
+/* Where the application at this position is among the ones the
+   client gets.  Both lists are GSequences, which keep the size of
+   each subtree, so that's O(log n) however many there are. */
+static gint
+client_position (Client * client, gint position)
+{
+	GSequenceIter * given = client_given_iter(client, position);
+
+	return given != NULL ? g_sequence_iter_get_position(given) : -1;
+}
+
+/* The ones the client gets are in the order of their nodes in the
+   visible list */
+static gint
+client_given_order (GSequenceIter * a, GSequenceIter * b, gpointer user_data)
+{
+	return g_sequence_iter_compare((GSequenceIter *)g_sequence_get(a), (GSequenceIter *)g_sequence_get(b));
+}
+
+/* Puts an application in at this position, and among the ones the
+   client gets if it's shown */
+static void
+client_insert (Client * client, gint position, gboolean shown)
+{
+	GSequenceIter * entry = g_sequence_insert_before(g_sequence_get_iter_at_pos(client->visible, position), NULL);
+
+	if (shown) {
+		g_sequence_set(entry, g_sequence_insert_sorted_iter(client->given, entry, client_given_order, NULL));
+	}
+
+	return;
+}
+
+/* Takes out the application at this position, returns whether the
+   client got it */
+static gboolean
+client_remove (Client * client, gint position)
+{
+	GSequenceIter * entry = g_sequence_get_iter_at_pos(client->visible, position);
+	GSequenceIter * given = g_sequence_get(entry);
+
+	if (given != NULL) {
+		g_sequence_remove(given);
+	}
+	g_sequence_remove(entry);
+
+	return given != NULL;
+}
+
+/* Copies the tuple with the position at the index replaced and
+   the fields the client doesn't want left empty */
+static GVariant *
+client_tuple (Client * client, GVariant * params, gsize index, gint position, const guint * child_fields)
+{
+	gsize i, n = g_variant_n_children(params);
+	GVariant ** children = g_new(GVariant *, n);
+
+	for (i = 0; i < n; i++) {
+		if (i == index) {
+			children[i] = g_variant_ref_sink(g_variant_new_int32(position));
+		} else if (child_fields != NULL && child_fields[i] != 0 && (client->fields & child_fields[i]) == 0) {
+			children[i] = g_variant_ref_sink(g_variant_new_string(""));
+		} else {
+			children[i] = g_variant_get_child_value(params, i);
+		}
+	}
+
+	GVariant * out = g_variant_new_tuple(children, n);
+
+	for (i = 0; i < n; i++) {
+		g_variant_unref(children[i]);
+	}
+	g_free(children);
+
+	return out;
+}
+
+static void
+client_send (Client * client, const gchar * name, GVariant * params)
+{
+	GError * error = NULL;
+
+	g_dbus_connection_emit_signal (client->bus,
+	                               client->name,
+	                               INDICATOR_APPLICATION_DBUS_OBJ,
+	                               INDICATOR_APPLICATION_SUBSCRIPTION_DBUS_IFACE,
+	                               name,
+	                               params,
+	                               &error);
+
+	if (error != NULL) {
+		g_warning("Unable to send %s signal to '%s': %s", name, client->name, error->message);
+		g_error_free(error);
+	}
+
+	return;
+}
+
+/* Drops the field changes held back for the client, for when it
+   gets them some other way */
+static void
+client_drop_held (Client * client)
+{
+	if (client->held_timer != 0) {
+		g_source_remove(client->held_timer);
+		client->held_timer = 0;
+	}
+
+	g_hash_table_remove_all(client->held);
+}
+
+/* Sends the field changes held back for the client in one
+   ApplicationsChanged */
+static void
+client_flush_held (Client * client)
+{
+	if (g_hash_table_size(client->held) == 0) {
+		client_drop_held(client);
+		return;
+	}
+
+	GVariantBuilder builder;
+	GHashTableIter iter;
+	gpointer key, value;
+
+	g_variant_builder_init(&builder, G_VARIANT_TYPE("a(iua{sv})"));
+
+	g_hash_table_iter_init(&iter, client->held);
+	while (g_hash_table_iter_next(&iter, &key, &value)) {
+		HeldChange * held = (HeldChange *)value;
+		g_variant_builder_add(&builder, "(iu@a{sv})", GPOINTER_TO_INT(key), held->fields, g_variant_dict_end(held->values));
+	}
+
+	client_drop_held(client);
+
+	client->generation++;
+	client->sent_at = g_get_monotonic_time();
+	client_send(client, "ApplicationsChanged", g_variant_new("(ta(iua{sv}))", client->generation, &builder));
+}
+
+static gboolean
+client_held_timeout (gpointer user_data)
+{
+	Client * client = (Client *)user_data;
+
+	client->held_timer = 0;
+	client_flush_held(client);
+
+	return G_SOURCE_REMOVE;
+}
+
+/* Takes the field changes the client wants and sends them, unless
+   that'd go over the rate it asked for.  Then they wait, and more
+   changes to the same items get merged into them. */
+static void
+client_changes (Client * client, GVariant * params)
+{
+	GVariantIter * changes = NULL;
+	GVariantIter * values = NULL;
+	guint64 generation;
+	gint position;
+	guint fields;
+
+	g_variant_get(params, "(ta(iua{sv}))", &generation, &changes);
+	while (g_variant_iter_next(changes, "(iua{sv})", &position, &fields, &values)) {
+		fields &= client->fields;
+
+		if (fields != 0 && client_shows(client, position)) {
+			gint client_pos = client_position(client, position);
+			HeldChange * held = g_hash_table_lookup(client->held, GINT_TO_POINTER(client_pos));
+			const gchar * key;
+			GVariant * value;
+
+			if (held == NULL) {
+				held = g_new0(HeldChange, 1);
+				held->values = g_variant_dict_new(NULL);
+				g_hash_table_insert(client->held, GINT_TO_POINTER(client_pos), held);
+			}
+			held->fields |= fields;
+
+			while (g_variant_iter_next(values, "{&sv}", &key, &value)) {
+				guint field = change_key_field(key);
+
+				if (field == 0 || (fields & field) != 0) {
+					g_variant_dict_insert_value(held->values, key, value);
+				}
+
+				g_variant_unref(value);
+			}
+		}
+
+		g_variant_iter_free(values);
+	}
+	g_variant_iter_free(changes);
+
+	if (g_hash_table_size(client->held) == 0) {
+		return;
+	}
+
+	if (client->max_rate == 0) {
+		client_flush_held(client);
+		return;
+	}
+
+	gint64 interval = G_USEC_PER_SEC / client->max_rate;
+	gint64 since = g_get_monotonic_time() - client->sent_at;
+
+	if (since >= interval) {
+		client_flush_held(client);
+	} else if (client->held_timer == 0) {
+		client->held_timer = g_timeout_add((interval - since) / 1000 + 1, client_held_timeout, client);
+	}
+
+	return;
+}
+
+/* The list changed, which the client only hears about if it
+   involves an item it gets.  The positions it knows change with
+   it, so anything held back goes out first. */
+static void
+client_added (Client * client, GVariant * params)
+{
+	const gchar * id = NULL;
+	gint position;
+
+	g_variant_get_child(params, 1, "i", &position);
+	g_variant_get_child(params, 8, "&s", &id);
+
+	client_flush_held(client);
+
+	if (position < 0 || position > client_visible_count(client)) {
+		position = client_visible_count(client);
+	}
+
+	gboolean shown = client_allows(client, id);
+	client_insert(client, position, shown);
+
+	if (shown) {
+		client->generation++;
+		client_send(client, "ApplicationAdded", client_tuple(client, params, 1, client_position(client, position), application_fields));
+	}
+
+	return;
+}
+
+static void
+client_removed (Client * client, GVariant * params)
+{
+	gint position;
+
+	g_variant_get(params, "(i)", &position);
+
+	if (position < 0 || position >= client_visible_count(client)) {
+		return;
+	}
+
+	client_flush_held(client);
+
+	gint client_pos = client_position(client, position);
+	gboolean shown = client_remove(client, position);
+
+	if (shown) {
+		client->generation++;
+		client_send(client, "ApplicationRemoved", g_variant_new("(i)", client_pos));
+	}
+
+	return;
+}
+
+static void
+client_moved (Client * client, GVariant * params)
+{
+	gint old_position, new_position;
+
+	g_variant_get(params, "(ii)", &old_position, &new_position);
+
+	if (old_position < 0 || old_position >= client_visible_count(client) ||
+		new_position < 0 || new_position >= client_visible_count(client)) {
+		return;
+	}
+
+	client_flush_held(client);
+
+	gint old_client_pos = client_position(client, old_position);
+	gboolean shown = client_remove(client, old_position);
+	client_insert(client, new_position, shown);
+	gint new_client_pos = client_position(client, new_position);
+
+	if (shown && old_client_pos != new_client_pos) {
+		client->generation++;
+		client_send(client, "ApplicationMoved", g_variant_new("(ii)", old_client_pos, new_client_pos));
+	}
+
+	return;
+}
+
+/* Sends a signal to a subscribed client, filtered the way it asked,
+   if it's one it cares about.  Old clients don't get
+   ApplicationsChanged and new ones don't get the per field signals. */
+static void
+client_deliver (Client * client, const gchar * name, GVariant * params)
+{
+	gboolean batched = (client->version >= INDICATOR_APPLICATION_SERVICE_BATCHED_VERSION);
+	guint field = signal_field(name);
+
+	if (g_strcmp0(name, "ApplicationsChanged") == 0) {
+		if (batched) {
+			client_changes(client, params);
+		}
+
+		return;
+	}
+
+	if (field != 0 && batched) {
+		return;
+	}
+
+	if (field != 0) {
+		gint position;
+
+		g_variant_get_child(params, 0, "i", &position);
+		if ((client->fields & field) != 0 && client_shows(client, position)) {
+			client_send(client, name, client_tuple(client, params, 0, client_position(client, position), NULL));
+		}
+	} else if (g_strcmp0(name, "ApplicationAdded") == 0) {
+		client_added(client, params);
+	} else if (g_strcmp0(name, "ApplicationRemoved") == 0) {
+		client_removed(client, params);
+	} else if (g_strcmp0(name, "ApplicationMoved") == 0) {
+		client_moved(client, params);
+	}
+
+	return;
+}
+
+/* Sends the signal to the subscribed clients, filtered for each
+   of them */
+void
+clients_deliver (Clients * clients, const gchar * name, GVariant * params)
+{
+	GHashTableIter iter;
+	gpointer value;
+
+	if (clients->subscribed == 0) {
+		return;
+	}
+
+	g_hash_table_iter_init(&iter, clients->table);
+	while (g_hash_table_iter_next(&iter, NULL, &value)) {
+		Client * client = (Client *)value;
+
+		if (client->subscribed) {
+			client_deliver(client, name, params);
+		}
+	}
+
+	return;
+}
+
+/* Which of the visible applications the client gets, from scratch.
+   The IDs are those of the visible applications, in their order. */
+static void
+client_reset_shown (Client * client, GPtrArray * visible_ids)
+{
+	guint i;
+
+	g_sequence_remove_range(g_sequence_get_begin_iter(client->given), g_sequence_get_end_iter(client->given));
+	g_sequence_remove_range(g_sequence_get_begin_iter(client->visible), g_sequence_get_end_iter(client->visible));
+
+	for (i = 0; i < visible_ids->len; i++) {
+		GSequenceIter * entry = g_sequence_append(client->visible, NULL);
+
+		if (client_allows(client, g_ptr_array_index(visible_ids, i))) {
+			g_sequence_set(entry, g_sequence_append(client->given, entry));
+		}
+	}
+
+	return;
+}
+
+static GHashTable *
+id_set_new (const gchar ** ids)
+{
+	GHashTable * set = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+	guint i;
+
+	for (i = 0; ids[i] != NULL; i++) {
+		g_hash_table_add(set, g_strdup(ids[i]));
+	}
+
+	return set;
+}
+
+/* Sets what a client wants to get.  The options are "allow" and
+   "deny" with item IDs, "fields" with a mask of the fields and
+   "max-rate" with the ApplicationsChanged signals per second.  It
+   starts over with a generation it can't have seen, so it gets its
+   list with GetApplicationsSince. */
+void
+clients_subscribe (Clients * clients, const gchar * sender, GVariant * options,
+                   GPtrArray * visible_ids, guint64 generation)
+{
+	const gchar ** ids = NULL;
+
+	if (sender == NULL) {
+		return;
+	}
+
+	Client * client = g_hash_table_lookup(clients->table, sender);
+	if (client == NULL) {
+		return;
+	}
+
+	g_clear_pointer(&client->allow, g_hash_table_destroy);
+	g_clear_pointer(&client->deny, g_hash_table_destroy);
+
+	if (g_variant_lookup(options, "allow", "^a&s", &ids)) {
+		client->allow = id_set_new(ids);
+		g_free(ids);
+	}
+
+	if (g_variant_lookup(options, "deny", "^a&s", &ids)) {
+		client->deny = id_set_new(ids);
+		g_free(ids);
+	}
+
+	client->fields = INDICATOR_APPLICATION_FIELD_ALL;
+	g_variant_lookup(options, "fields", "u", &client->fields);
+
+	client->max_rate = 0;
+	g_variant_lookup(options, "max-rate", "u", &client->max_rate);
+
+	client_drop_held(client);
+	client_reset_shown(client, visible_ids);
+	client->generation = MAX(client->generation, generation) + 1;
+	client->subscribed = TRUE;
+
+	g_debug("Client '%s' subscribed to %s items, fields 0x%x at %u per second",
+	        sender, (client->allow != NULL || client->deny != NULL) ? "some" : "all",
+	        client->fields, client->max_rate);
+
+	count_clients(clients);
+
+	return;
+}
+
+/* The list as a subscribed client gets it.  Anything held back for
+   it is in there already.  Takes the ref on the list. */
+GVariant *
+client_list (Client * client, GVariant * list)
+{
+	GVariantBuilder builder;
+	gsize i, n = g_variant_n_children(list);
+	gint position = 0;
+
+	client_drop_held(client);
+
+	g_variant_builder_init(&builder, G_VARIANT_TYPE ("a(sisosssssssss)"));
+
+	for (i = 0; i < n; i++) {
+		if (!client_shows(client, i)) {
+			continue;
+		}
+
+		GVariant * entry = g_variant_get_child_value(list, i);
+		g_variant_builder_add_value(&builder, client_tuple(client, entry, 1, position++, application_fields));
+		g_variant_unref(entry);
+	}
+
+	g_variant_unref(list);
+
+	return g_variant_ref_sink(g_variant_builder_end(&builder));
+}
+
+/* The client that's calling, if it subscribed */
+Client *
+clients_find_subscribed (Clients * clients, const gchar * sender)
+{
+	if (sender == NULL) {
+		return NULL;
+	}
+
+	Client * client = g_hash_table_lookup(clients->table, sender);
+	if (client == NULL || !client->subscribed) {
+		return NULL;
+	}
+
+	return client;
+}
+
+guint64
+client_get_generation (Client * client)
+{
+	return client->generation;
+}
+
+/* Whether the client saw everything there is, nothing is held back
+   for it and it's at the generation it says */
+gboolean
+client_up_to_date (Client * client, guint64 since)
+{
+	return since == client->generation && g_hash_table_size(client->held) == 0;
+}
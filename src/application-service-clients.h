@@ -0,0 +1,66 @@
+/*
+The panels talking to the service, which kind of updates each of them
+wants and, once it subscribed, which items and fields it gets.
+
+This program is free software: you can redistribute it and/or modify it
+under the terms of the GNU General Public License version 3, as published
+by the Free Software Foundation.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranties of
+MERCHANTABILITY, SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR
+PURPOSE.  See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __APPLICATION_SERVICE_CLIENTS_H__
+#define __APPLICATION_SERVICE_CLIENTS_H__
+
+#include <gio/gio.h>
+
+G_BEGIN_DECLS
+
+typedef struct _Clients Clients;
+typedef struct _Client Client;
+
+/* Sends the updates still waiting, called before a client comes,
+   goes or switches to other updates so they reach it the way they
+   were meant to */
+typedef void (*ClientsFlushFunc) (gpointer user_data);
+
+Clients *  clients_new             (ClientsFlushFunc  flush,
+                                    gpointer          user_data);
+void       clients_clear           (Clients *         clients);
+void       clients_free            (Clients *         clients);
+
+void       clients_register        (Clients *         clients,
+                                    GDBusConnection * bus,
+                                    const gchar *     sender,
+                                    gint              version);
+void       clients_subscribe       (Clients *         clients,
+                                    const gchar *     sender,
+                                    GVariant *        options,
+                                    GPtrArray *       visible_ids,
+                                    guint64           generation);
+void       clients_deliver         (Clients *         clients,
+                                    const gchar *     name,
+                                    GVariant *        params);
+
+guint      clients_count           (Clients *         clients);
+guint      clients_legacy          (Clients *         clients);
+guint      clients_batched         (Clients *         clients);
+guint      clients_subscribed      (Clients *         clients);
+
+Client *   clients_find_subscribed (Clients *         clients,
+                                    const gchar *     sender);
+guint64    client_get_generation   (Client *          client);
+gboolean   client_up_to_date       (Client *          client,
+                                    guint64           since);
+GVariant * client_list             (Client *          client,
+                                    GVariant *        list);
+
+G_END_DECLS
+
+#endif
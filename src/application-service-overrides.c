@@ -0,0 +1,269 @@
+/*
+The ordering index overrides, read from the keyfiles or from the
+cache of them.
+
+This program is free software: you can redistribute it and/or modify it
+under the terms of the GNU General Public License version 3, as published
+by the Free Software Foundation.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranties of
+MERCHANTABILITY, SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR
+PURPOSE.  See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <glib/gstdio.h>
+#include "application-service-overrides.h"
+
+#define OVERRIDE_GROUP_NAME  "Ordering Index Overrides"
+
+/* The cache holds the stamps (mtime in nanoseconds, size and inode)
+   of the files it was built from and the overrides */
+#define OVERRIDE_CACHE_NAME  "ordering-override.cache"
+#define OVERRIDE_CACHE_TYPE  "(a(sxxt)a{si})"
+
+/* When an override file was last changed, see override_file_stamp() */
+typedef struct {
+	gint64 mtime;
+	gint64 size;
+	guint64 inode;
+} OverrideStamp;
+
+/* Loads the file and adds the override entries to the table
+   of overrides */
+static void
+load_override_file (GHashTable * hash, const gchar * filename)
+{
+	g_return_if_fail(hash != NULL);
+	g_return_if_fail(filename != NULL);
+
+	if (!g_file_test(filename, G_FILE_TEST_EXISTS)) {
+		g_debug("Override file '%s' doesn't exist", filename);
+		return;
+	}
+
+	g_debug("Loading overrides from: '%s'", filename);
+
+	GError * error = NULL;
+	GKeyFile * keyfile = g_key_file_new();
+	g_key_file_load_from_file(keyfile, filename, G_KEY_FILE_NONE, &error);
+
+	if (error != NULL) {
+		g_warning("Unable to load keyfile '%s' because: %s", filename, error->message);
+		g_error_free(error);
+		g_key_file_free(keyfile);
+		return;
+	}
+
+	gchar ** keys = g_key_file_get_keys(keyfile, OVERRIDE_GROUP_NAME, NULL, &error);
+	if (error != NULL) {
+		g_warning("Unable to get keys from keyfile '%s' because: %s", filename, error->message);
+		g_error_free(error);
+		g_key_file_free(keyfile);
+		return;
+	}
+
+	gchar * key;
+	gint i;
+
+	for (i = 0; (key = keys[i]) != NULL; i++) {
+		GError * valerror = NULL;
+		gint val = g_key_file_get_integer(keyfile, OVERRIDE_GROUP_NAME, key, &valerror);
+
+		if (valerror != NULL) {
+			g_warning("Unable to get key '%s' out of file '%s' because: %s", key, filename, valerror->message);
+			g_error_free(valerror);
+			continue;
+		}
+		g_debug("%s: override '%s' with value '%d'", filename, key, val);
+
+		g_hash_table_insert(hash, g_strdup(key), GINT_TO_POINTER(val));
+	}
+	g_strfreev(keys);
+	g_key_file_free(keyfile);
+
+	return;
+}
+
+/* What tells us whether a file changed since the cache was built,
+   a missing file has a size of -1.  Whole seconds would miss a
+   quick edit that keeps the size, and the inode catches files that
+   got replaced. */
+static void
+override_file_stamp (const gchar * filename, OverrideStamp * stamp)
+{
+	GStatBuf buf;
+
+	if (g_stat(filename, &buf) != 0) {
+		stamp->mtime = 0;
+		stamp->size = -1;
+		stamp->inode = 0;
+		return;
+	}
+
+	stamp->mtime = (gint64)buf.st_mtim.tv_sec * G_GINT64_CONSTANT(1000000000) + buf.st_mtim.tv_nsec;
+	stamp->size = (gint64)buf.st_size;
+	stamp->inode = (guint64)buf.st_ino;
+
+	return;
+}
+
+static gchar *
+override_cache_file (void)
+{
+	return g_build_filename(g_get_user_cache_dir(), "ayatana-indicator-application", OVERRIDE_CACHE_NAME, NULL);
+}
+
+/* Maps the cache and takes the overrides out of it, as long as
+   the files it was built from still have the stamps given. */
+static GHashTable *
+read_override_cache (gchar ** files, guint n_files, const OverrideStamp * stamps)
+{
+	gchar * filename = override_cache_file();
+	GMappedFile * mapped = g_mapped_file_new(filename, FALSE, NULL);
+	g_free(filename);
+
+	if (mapped == NULL) {
+		return NULL;
+	}
+
+	GBytes * bytes = g_mapped_file_get_bytes(mapped);
+	GVariant * cache = g_variant_ref_sink(g_variant_new_from_bytes(G_VARIANT_TYPE(OVERRIDE_CACHE_TYPE), bytes, FALSE));
+
+	/* Untrusted data gets its offsets checked on every access,
+	   which makes walking the overrides quadratic.  Check it all
+	   once and read it as trusted from then on. */
+	gboolean normal = g_variant_is_normal_form(cache);
+	g_variant_unref(cache);
+	cache = normal ? g_variant_ref_sink(g_variant_new_from_bytes(G_VARIANT_TYPE(OVERRIDE_CACHE_TYPE), bytes, TRUE)) : NULL;
+
+	g_bytes_unref(bytes);
+	g_mapped_file_unref(mapped);
+
+	if (cache == NULL) {
+		g_debug("Override cache is damaged, rebuilding it");
+		return NULL;
+	}
+
+	GHashTable * hash = NULL;
+	GVariant * sources = g_variant_get_child_value(cache, 0);
+
+	if (g_variant_n_children(sources) == n_files) {
+		gboolean valid = TRUE;
+		guint i;
+
+		for (i = 0; i < n_files && valid; i++) {
+			const gchar * source = NULL;
+			OverrideStamp cached;
+
+			g_variant_get_child(sources, i, "(&sxxt)", &source, &cached.mtime, &cached.size, &cached.inode);
+
+			valid = (g_strcmp0(source, files[i]) == 0 &&
+			         cached.mtime == stamps[i].mtime && cached.size == stamps[i].size &&
+			         cached.inode == stamps[i].inode);
+		}
+
+		if (valid) {
+			GVariantIter iter;
+			const gchar * key;
+			gint32 val;
+
+			hash = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+
+			GVariant * overrides = g_variant_get_child_value(cache, 1);
+			g_variant_iter_init(&iter, overrides);
+			while (g_variant_iter_next(&iter, "{&si}", &key, &val)) {
+				g_hash_table_insert(hash, g_strdup(key), GINT_TO_POINTER(val));
+			}
+			g_variant_unref(overrides);
+		}
+	}
+
+	g_variant_unref(sources);
+	g_variant_unref(cache);
+
+	return hash;
+}
+
+/* Stores the merged overrides so that the next start can skip
+   the keyfiles.  The stamps are the ones from before the keyfiles
+   were read, so an edit while reading them makes the cache stale
+   rather than wrong. */
+static void
+write_override_cache (gchar ** files, guint n_files, GHashTable * hash, const OverrideStamp * stamps)
+{
+	GVariantBuilder sources;
+	GVariantBuilder overrides;
+	GHashTableIter iter;
+	gpointer key, value;
+	guint i;
+
+	g_variant_builder_init(&sources, G_VARIANT_TYPE("a(sxxt)"));
+	for (i = 0; i < n_files; i++) {
+		g_variant_builder_add(&sources, "(sxxt)", files[i], stamps[i].mtime, stamps[i].size, stamps[i].inode);
+	}
+
+	g_variant_builder_init(&overrides, G_VARIANT_TYPE("a{si}"));
+	g_hash_table_iter_init(&iter, hash);
+	while (g_hash_table_iter_next(&iter, &key, &value)) {
+		g_variant_builder_add(&overrides, "{si}", (const gchar *)key, (gint32)GPOINTER_TO_INT(value));
+	}
+
+	GVariant * cache = g_variant_ref_sink(g_variant_new(OVERRIDE_CACHE_TYPE, &sources, &overrides));
+	gchar * filename = override_cache_file();
+	gchar * dirname = g_path_get_dirname(filename);
+	GError * error = NULL;
+
+	g_mkdir_with_parents(dirname, 0700);
+	if (!g_file_set_contents(filename, g_variant_get_data(cache), g_variant_get_size(cache), &error)) {
+		g_debug("Unable to write override cache '%s': %s", filename, error->message);
+		g_error_free(error);
+	}
+
+	g_free(dirname);
+	g_free(filename);
+	g_variant_unref(cache);
+
+	return;
+}
+
+/* Gets the merged overrides, from the cache if it's turned on
+   and still good, otherwise from the keyfiles.  The cache only
+   gets written when it was missing or stale, a good one is left
+   alone. */
+GHashTable *
+overrides_load (gchar ** files, guint n_files, gboolean use_cache)
+{
+	OverrideStamp * stamps = g_new0(OverrideStamp, n_files);
+	GHashTable * hash = NULL;
+	guint i;
+
+	if (use_cache) {
+		for (i = 0; i < n_files; i++) {
+			override_file_stamp(files[i], &stamps[i]);
+		}
+
+		hash = read_override_cache(files, n_files, stamps);
+		if (hash != NULL) {
+			g_debug("Loaded overrides from cache");
+			g_free(stamps);
+			return hash;
+		}
+	}
+
+	hash = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+	for (i = 0; i < n_files; i++) {
+		load_override_file(hash, files[i]);
+	}
+
+	if (use_cache) {
+		write_override_cache(files, n_files, hash, stamps);
+	}
+
+	g_free(stamps);
+
+	return hash;
+}
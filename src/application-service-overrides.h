@@ -0,0 +1,33 @@
+/*
+The ordering index overrides, read from the keyfiles or from the
+cache of them.
+
+This program is free software: you can redistribute it and/or modify it
+under the terms of the GNU General Public License version 3, as published
+by the Free Software Foundation.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranties of
+MERCHANTABILITY, SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR
+PURPOSE.  See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __APPLICATION_SERVICE_OVERRIDES_H__
+#define __APPLICATION_SERVICE_OVERRIDES_H__
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/* The overrides of all the files merged, the later files win.  The
+   table maps item IDs to GINT_TO_POINTER() of the ordering index. */
+GHashTable * overrides_load (gchar ** files,
+                             guint    n_files,
+                             gboolean use_cache);
+
+G_END_DECLS
+
+#endif
@@ -0,0 +1,150 @@
+/*
+Recordings of what the items told the service, to play them back later.
+
+This program is free software: you can redistribute it and/or modify it
+under the terms of the GNU General Public License version 3, as published
+by the Free Software Foundation.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranties of
+MERCHANTABILITY, SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR
+PURPOSE.  See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <glib/gstdio.h>
+#include "application-service-recording.h"
+
+struct _Recording {
+	FILE * file;
+	gint64 started;
+};
+
+/* Starts a new recording, replacing what was in the file.  It has
+   the titles, labels and tooltips of every item in it, so only the
+   user gets to read it. */
+Recording *
+recording_new (const gchar * filename, GError ** error)
+{
+	FILE * file = NULL;
+	int fd = g_open(filename, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+
+	if (fd != -1 && fchmod(fd, 0600) == 0) {
+		file = fdopen(fd, "wb");
+	}
+
+	if (file == NULL) {
+		int saved_errno = errno;
+		if (fd != -1) {
+			close(fd);
+		}
+		g_set_error(error, G_FILE_ERROR, g_file_error_from_errno(saved_errno),
+		            "Unable to open '%s': %s", filename, g_strerror(saved_errno));
+		return NULL;
+	}
+
+	fwrite(RECORDING_MAGIC, 1, RECORDING_MAGIC_SIZE, file);
+
+	Recording * recording = g_new0(Recording, 1);
+	recording->file = file;
+	recording->started = g_get_monotonic_time();
+
+	return recording;
+}
+
+/* Writes one record.  It goes out right away so a service that gets
+   killed in the middle of a storm still leaves the storm behind. */
+void
+recording_add (Recording * recording, const gchar * event,
+               const gchar * dbus_name, const gchar * dbus_object,
+               GVariant * payload)
+{
+	g_return_if_fail(recording != NULL);
+
+	if (payload == NULL) {
+		payload = g_variant_new("()");
+	}
+
+	GVariant * record = g_variant_ref_sink(g_variant_new(RECORDING_TYPE,
+	                                                     (guint64)(g_get_monotonic_time() - recording->started),
+	                                                     event,
+	                                                     dbus_name != NULL ? dbus_name : "",
+	                                                     dbus_object != NULL ? dbus_object : "",
+	                                                     payload));
+	guint32 size = GUINT32_TO_LE((guint32)g_variant_get_size(record));
+
+	fwrite(&size, sizeof(size), 1, recording->file);
+	fwrite(g_variant_get_data(record), 1, g_variant_get_size(record), recording->file);
+	fflush(recording->file);
+
+	g_variant_unref(record);
+
+	return;
+}
+
+void
+recording_free (Recording * recording)
+{
+	if (recording == NULL) {
+		return;
+	}
+
+	fclose(recording->file);
+	g_free(recording);
+
+	return;
+}
+
+/* Reads a whole recording into an array of RECORDING_TYPE variants.
+   A record that was cut off at the end is left out. */
+GPtrArray *
+recording_load (const gchar * filename, GError ** error)
+{
+	gchar * contents = NULL;
+	gsize length = 0;
+
+	if (!g_file_get_contents(filename, &contents, &length, error)) {
+		return NULL;
+	}
+
+	if (length < RECORDING_MAGIC_SIZE || memcmp(contents, RECORDING_MAGIC, RECORDING_MAGIC_SIZE) != 0) {
+		g_set_error(error, G_FILE_ERROR, G_FILE_ERROR_INVAL, "'%s' isn't a recording", filename);
+		g_free(contents);
+		return NULL;
+	}
+
+	GBytes * bytes = g_bytes_new_take(contents, length);
+	GPtrArray * records = g_ptr_array_new_with_free_func((GDestroyNotify)g_variant_unref);
+	gsize offset = RECORDING_MAGIC_SIZE;
+
+	while (offset + sizeof(guint32) <= length) {
+		guint32 size;
+
+		memcpy(&size, (const gchar *)g_bytes_get_data(bytes, NULL) + offset, sizeof(size));
+		size = GUINT32_FROM_LE(size);
+		offset += sizeof(size);
+
+		if (offset + size > length) {
+			break;
+		}
+
+		GBytes * data = g_bytes_new_from_bytes(bytes, offset, size);
+		GVariant * record = g_variant_new_from_bytes(G_VARIANT_TYPE(RECORDING_TYPE), data, FALSE);
+		g_ptr_array_add(records, g_variant_ref_sink(record));
+		g_bytes_unref(data);
+
+		offset += size;
+	}
+
+	g_bytes_unref(bytes);
+
+	return records;
+}
@@ -0,0 +1,59 @@
+/*
+Recordings of what the items told the service, to play them back later.
+
+This program is free software: you can redistribute it and/or modify it
+under the terms of the GNU General Public License version 3, as published
+by the Free Software Foundation.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranties of
+MERCHANTABILITY, SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR
+PURPOSE.  See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __APPLICATION_SERVICE_RECORDING_H__
+#define __APPLICATION_SERVICE_RECORDING_H__
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/* A recording starts with the magic and is followed by the records,
+   each one a little endian 32 bit size and a serialized GVariant of
+   RECORDING_TYPE: the microseconds since the recording started, the
+   event, the bus name and object path of the item, and the payload
+   of the event. */
+#define RECORDING_MAGIC            "SNIREC\0\1"
+#define RECORDING_MAGIC_SIZE       8
+#define RECORDING_TYPE             "(tsssv)"
+
+/* The item registered, the payload is empty */
+#define RECORDING_EVENT_REGISTER   "register"
+/* The item went away, the payload is empty */
+#define RECORDING_EVENT_UNREGISTER "unregister"
+/* Reply to GetAll, the payload is the a{sv} */
+#define RECORDING_EVENT_PROPERTIES "properties"
+/* Reply to Get, the payload is the (sv) of the name and value */
+#define RECORDING_EVENT_PROPERTY   "property"
+/* A signal from the item, the payload is the (sv) of the name and
+   the parameters */
+#define RECORDING_EVENT_SIGNAL     "signal"
+
+typedef struct _Recording Recording;
+
+Recording * recording_new    (const gchar * filename, GError ** error);
+void        recording_add    (Recording *   recording,
+                              const gchar * event,
+                              const gchar * dbus_name,
+                              const gchar * dbus_object,
+                              GVariant *    payload);
+void        recording_free   (Recording *   recording);
+
+GPtrArray * recording_load   (const gchar * filename, GError ** error);
+
+G_END_DECLS
+
+#endif
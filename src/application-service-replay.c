@@ -0,0 +1,509 @@
+/*
+Plays a recording of items back against the service, on whatever
+session bus we're given, so that a storm from a real session can be
+seen again as often as needed.
+
+This program is free software: you can redistribute it and/or modify it
+under the terms of the GNU General Public License version 3, as published
+by the Free Software Foundation.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranties of
+MERCHANTABILITY, SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR
+PURPOSE.  See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <gio/gio.h>
+#include "application-service-recording.h"
+#include "dbus-shared.h"
+
+/* How long to stay around after the last record, so the service can
+   still get the properties of the last items */
+#define LINGER_TIME   1000
+
+/* How far to look ahead for properties to serve with a signal */
+#define PREFETCH_SIZE 256
+
+/* An object we serve in place of a recorded item */
+typedef struct {
+	gchar * path;
+	GHashTable * properties;
+	guint registration;
+} ReplayObject;
+
+/* A recorded bus name, played by a connection of its own */
+typedef struct {
+	GDBusConnection * connection;
+	GHashTable * objects;
+} ReplayItem;
+
+static GMainLoop * mainloop = NULL;
+static GPtrArray * records = NULL;
+static guint next_record = 0;
+static gint64 started = 0;
+static gchar * bus_address = NULL;
+static GHashTable * items = NULL;
+static GHashTable * property_types = NULL;
+
+static gboolean fast = FALSE;
+
+static GOptionEntry options[] = {
+	{ "fast", 'f', 0, G_OPTION_ARG_NONE, &fast, "Play the records as fast as possible instead of at their own pace", NULL },
+	{ NULL }
+};
+
+static gchar *
+item_key (const gchar * name, const gchar * object)
+{
+	return g_strconcat(name, " ", object, NULL);
+}
+
+/* Every property an item ever had, with its type, so that its
+   interface can be described before the first value shows up */
+static void
+learn_property (const gchar * name, const gchar * object, const gchar * property, GVariant * value)
+{
+	gchar * key = item_key(name, object);
+	GHashTable * types = g_hash_table_lookup(property_types, key);
+
+	if (types == NULL) {
+		types = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+		g_hash_table_insert(property_types, key, types);
+	} else {
+		g_free(key);
+	}
+
+	g_hash_table_insert(types, g_strdup(property), g_strdup(g_variant_get_type_string(value)));
+
+	return;
+}
+
+static void
+learn_properties (void)
+{
+	guint i;
+
+	for (i = 0; i < records->len; i++) {
+		const gchar * event, * name, * object;
+		GVariant * payload = NULL;
+
+		g_variant_get(g_ptr_array_index(records, i), "(t&s&s&sv)", NULL, &event, &name, &object, &payload);
+
+		if (g_strcmp0(event, RECORDING_EVENT_PROPERTIES) == 0 && g_variant_is_of_type(payload, G_VARIANT_TYPE_VARDICT)) {
+			GVariantIter iter;
+			const gchar * property;
+			GVariant * value;
+
+			g_variant_iter_init(&iter, payload);
+			while (g_variant_iter_loop(&iter, "{&sv}", &property, &value)) {
+				learn_property(name, object, property, value);
+			}
+		} else if (g_strcmp0(event, RECORDING_EVENT_PROPERTY) == 0 && g_variant_is_of_type(payload, G_VARIANT_TYPE("(sv)"))) {
+			const gchar * property;
+			GVariant * value;
+
+			g_variant_get(payload, "(&sv)", &property, &value);
+			learn_property(name, object, property, value);
+			g_variant_unref(value);
+		}
+
+		g_variant_unref(payload);
+	}
+
+	return;
+}
+
+/* Interface description with the properties the item had */
+static GDBusInterfaceInfo *
+build_interface (const gchar * name, const gchar * object)
+{
+	gchar * key = item_key(name, object);
+	GHashTable * types = g_hash_table_lookup(property_types, key);
+	GString * xml = g_string_new("<node><interface name='" NOTIFICATION_ITEM_DBUS_IFACE "'>");
+	g_free(key);
+
+	if (types != NULL) {
+		GHashTableIter iter;
+		gpointer property, type;
+
+		g_hash_table_iter_init(&iter, types);
+		while (g_hash_table_iter_next(&iter, &property, &type)) {
+			gchar * line = g_markup_printf_escaped("<property name='%s' type='%s' access='read'/>",
+			                                       (const gchar *)property, (const gchar *)type);
+			g_string_append(xml, line);
+			g_free(line);
+		}
+	}
+
+	g_string_append(xml, "</interface></node>");
+
+	GError * error = NULL;
+	GDBusNodeInfo * node = g_dbus_node_info_new_for_xml(xml->str, &error);
+	g_string_free(xml, TRUE);
+
+	if (error != NULL) {
+		g_warning("Unable to describe item %s%s: %s", name, object, error->message);
+		g_error_free(error);
+		return NULL;
+	}
+
+	GDBusInterfaceInfo * info = g_dbus_interface_info_ref(node->interfaces[0]);
+	g_dbus_node_info_unref(node);
+
+	return info;
+}
+
+static void
+item_method_call (GDBusConnection * connection, const gchar * sender,
+                  const gchar * path, const gchar * interface,
+                  const gchar * method, GVariant * params,
+                  GDBusMethodInvocation * invocation, gpointer user_data)
+{
+	/* Nothing gets recorded for them, so there's nothing to do */
+	g_dbus_method_invocation_return_value(invocation, NULL);
+}
+
+static GVariant *
+item_get_property (GDBusConnection * connection, const gchar * sender,
+                   const gchar * path, const gchar * interface,
+                   const gchar * property, GError ** error, gpointer user_data)
+{
+	ReplayObject * object = (ReplayObject *)user_data;
+	GVariant * value = g_hash_table_lookup(object->properties, property);
+
+	if (value == NULL) {
+		g_set_error(error, G_DBUS_ERROR, G_DBUS_ERROR_UNKNOWN_PROPERTY,
+		            "Property '%s' hasn't been recorded yet", property);
+		return NULL;
+	}
+
+	return g_variant_ref(value);
+}
+
+static GDBusInterfaceVTable item_table = {
+	method_call:    item_method_call,
+	get_property:   item_get_property,
+	set_property:   NULL
+};
+
+static void
+object_free (gpointer data)
+{
+	ReplayObject * object = (ReplayObject *)data;
+
+	g_hash_table_destroy(object->properties);
+	g_free(object->path);
+	g_free(object);
+}
+
+static void
+item_free (gpointer data)
+{
+	ReplayItem * item = (ReplayItem *)data;
+
+	g_hash_table_destroy(item->objects);
+	g_dbus_connection_close(item->connection, NULL, NULL, NULL);
+	g_object_unref(item->connection);
+	g_free(item);
+}
+
+static ReplayItem *
+get_item (const gchar * name)
+{
+	ReplayItem * item = g_hash_table_lookup(items, name);
+
+	if (item != NULL) {
+		return item;
+	}
+
+	GError * error = NULL;
+	GDBusConnection * connection = g_dbus_connection_new_for_address_sync(bus_address,
+	                                                                      G_DBUS_CONNECTION_FLAGS_AUTHENTICATION_CLIENT |
+	                                                                      G_DBUS_CONNECTION_FLAGS_MESSAGE_BUS_CONNECTION,
+	                                                                      NULL, NULL, &error);
+
+	if (error != NULL) {
+		g_warning("Unable to connect for %s: %s", name, error->message);
+		g_error_free(error);
+		return NULL;
+	}
+
+	item = g_new0(ReplayItem, 1);
+	item->connection = connection;
+	item->objects = g_hash_table_new_full(g_str_hash, g_str_equal, NULL, object_free);
+	g_hash_table_insert(items, g_strdup(name), item);
+
+	return item;
+}
+
+static ReplayObject *
+get_object (const gchar * name, const gchar * path, gboolean create)
+{
+	ReplayItem * item = create ? get_item(name) : g_hash_table_lookup(items, name);
+
+	if (item == NULL) {
+		return NULL;
+	}
+
+	ReplayObject * object = g_hash_table_lookup(item->objects, path);
+
+	if (object != NULL || !create) {
+		return object;
+	}
+
+	GDBusInterfaceInfo * info = build_interface(name, path);
+	if (info == NULL) {
+		return NULL;
+	}
+
+	object = g_new0(ReplayObject, 1);
+	object->path = g_strdup(path);
+	object->properties = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, (GDestroyNotify)g_variant_unref);
+
+	GError * error = NULL;
+	object->registration = g_dbus_connection_register_object(item->connection, path, info,
+	                                                         &item_table, object, NULL, &error);
+	g_dbus_interface_info_unref(info);
+
+	if (error != NULL) {
+		g_warning("Unable to serve %s%s: %s", name, path, error->message);
+		g_error_free(error);
+		object_free(object);
+		return NULL;
+	}
+
+	g_hash_table_insert(item->objects, object->path, object);
+
+	return object;
+}
+
+static void
+remove_object (const gchar * name, const gchar * path)
+{
+	ReplayItem * item = g_hash_table_lookup(items, name);
+	ReplayObject * object = get_object(name, path, FALSE);
+
+	if (object == NULL) {
+		return;
+	}
+
+	g_dbus_connection_unregister_object(item->connection, object->registration);
+	g_hash_table_remove(item->objects, path);
+
+	/* The service notices the name going away */
+	if (g_hash_table_size(item->objects) == 0) {
+		g_hash_table_remove(items, name);
+	}
+
+	return;
+}
+
+static void
+apply_properties (ReplayObject * object, const gchar * event, GVariant * payload)
+{
+	if (g_strcmp0(event, RECORDING_EVENT_PROPERTIES) == 0 && g_variant_is_of_type(payload, G_VARIANT_TYPE_VARDICT)) {
+		GVariantIter iter;
+		const gchar * property;
+		GVariant * value;
+
+		g_variant_iter_init(&iter, payload);
+		while (g_variant_iter_next(&iter, "{&sv}", &property, &value)) {
+			g_hash_table_insert(object->properties, g_strdup(property), value);
+		}
+	} else if (g_strcmp0(event, RECORDING_EVENT_PROPERTY) == 0 && g_variant_is_of_type(payload, G_VARIANT_TYPE("(sv)"))) {
+		const gchar * property;
+		GVariant * value;
+
+		g_variant_get(payload, "(&sv)", &property, &value);
+		g_hash_table_insert(object->properties, g_strdup(property), value);
+	}
+
+	return;
+}
+
+/* The properties that were fetched because of a signal were recorded
+   after it, but the service asks for them as soon as it sees the
+   signal.  So they're served from the signal on. */
+static void
+prefetch (ReplayObject * object, guint record, const gchar * name)
+{
+	guint i;
+
+	for (i = record + 1; i < records->len && i <= record + PREFETCH_SIZE; i++) {
+		const gchar * event, * other_name, * other_object;
+		GVariant * payload = NULL;
+
+		g_variant_get(g_ptr_array_index(records, i), "(t&s&s&sv)", NULL, &event, &other_name, &other_object, &payload);
+
+		if (g_strcmp0(other_name, name) != 0 || g_strcmp0(other_object, object->path) != 0) {
+			g_variant_unref(payload);
+			continue;
+		}
+
+		gboolean done = (g_strcmp0(event, RECORDING_EVENT_SIGNAL) == 0 ||
+		                 g_strcmp0(event, RECORDING_EVENT_REGISTER) == 0 ||
+		                 g_strcmp0(event, RECORDING_EVENT_UNREGISTER) == 0);
+
+		if (!done) {
+			apply_properties(object, event, payload);
+		}
+
+		g_variant_unref(payload);
+
+		if (done) {
+			break;
+		}
+	}
+
+	return;
+}
+
+static void
+play_record (guint record)
+{
+	const gchar * event, * name, * path;
+	GVariant * payload = NULL;
+
+	g_variant_get(g_ptr_array_index(records, record), "(t&s&s&sv)", NULL, &event, &name, &path, &payload);
+
+	if (g_strcmp0(event, RECORDING_EVENT_REGISTER) == 0) {
+		ReplayObject * object = get_object(name, path, TRUE);
+
+		if (object != NULL) {
+			prefetch(object, record, name);
+
+			ReplayItem * item = g_hash_table_lookup(items, name);
+			g_dbus_connection_call(item->connection,
+			                       NOTIFICATION_WATCHER_DBUS_ADDR,
+			                       NOTIFICATION_WATCHER_DBUS_OBJ,
+			                       NOTIFICATION_WATCHER_DBUS_IFACE,
+			                       "RegisterStatusNotifierItem",
+			                       g_variant_new("(s)", path),
+			                       NULL, G_DBUS_CALL_FLAGS_NONE, -1,
+			                       NULL, NULL, NULL);
+		}
+	} else if (g_strcmp0(event, RECORDING_EVENT_UNREGISTER) == 0) {
+		remove_object(name, path);
+	} else if (g_strcmp0(event, RECORDING_EVENT_SIGNAL) == 0) {
+		ReplayObject * object = get_object(name, path, FALSE);
+
+		if (object != NULL && g_variant_is_of_type(payload, G_VARIANT_TYPE("(sv)"))) {
+			const gchar * signal;
+			GVariant * params;
+
+			prefetch(object, record, name);
+
+			g_variant_get(payload, "(&sv)", &signal, &params);
+			g_dbus_connection_emit_signal(((ReplayItem *)g_hash_table_lookup(items, name))->connection,
+			                              NULL, path, NOTIFICATION_ITEM_DBUS_IFACE,
+			                              signal, params, NULL);
+			g_variant_unref(params);
+		}
+	} else {
+		ReplayObject * object = get_object(name, path, FALSE);
+
+		if (object != NULL) {
+			apply_properties(object, event, payload);
+		}
+	}
+
+	g_variant_unref(payload);
+
+	return;
+}
+
+static gboolean
+quit (gpointer user_data)
+{
+	g_main_loop_quit(mainloop);
+	return G_SOURCE_REMOVE;
+}
+
+/* Plays everything that is due, then waits for the next record.  In
+   fast mode the main loop still gets to run between the records so
+   the replies to the service go out. */
+static gboolean
+play_next (gpointer user_data)
+{
+	while (next_record < records->len) {
+		guint64 at = 0;
+
+		g_variant_get_child(g_ptr_array_index(records, next_record), 0, "t", &at);
+
+		if (!fast) {
+			gint64 wait = started + (gint64)at - g_get_monotonic_time();
+
+			if (wait > 0) {
+				g_timeout_add((guint)((wait + 999) / 1000), play_next, NULL);
+				return G_SOURCE_REMOVE;
+			}
+		}
+
+		play_record(next_record++);
+
+		if (fast) {
+			g_idle_add(play_next, NULL);
+			return G_SOURCE_REMOVE;
+		}
+	}
+
+	g_print("Played %u records in %" G_GINT64_FORMAT "ms\n", records->len, (g_get_monotonic_time() - started) / 1000);
+	g_timeout_add(LINGER_TIME, quit, NULL);
+
+	return G_SOURCE_REMOVE;
+}
+
+int
+main (int argc, char ** argv)
+{
+	GError * error = NULL;
+	GOptionContext * context = g_option_context_new("RECORDING - play items back against the application service");
+
+	g_option_context_add_main_entries(context, options, NULL);
+
+	if (!g_option_context_parse(context, &argc, &argv, &error) || argc != 2) {
+		g_printerr("%s\n", error != NULL ? error->message : "Which recording should be played?");
+		g_clear_error(&error);
+		g_option_context_free(context);
+		return 1;
+	}
+
+	g_option_context_free(context);
+
+	records = recording_load(argv[1], &error);
+	if (records == NULL) {
+		g_printerr("%s\n", error->message);
+		g_error_free(error);
+		return 1;
+	}
+
+	bus_address = g_dbus_address_get_for_bus_sync(G_BUS_TYPE_SESSION, NULL, &error);
+	if (bus_address == NULL) {
+		g_printerr("No session bus to play on: %s\n", error->message);
+		g_error_free(error);
+		g_ptr_array_unref(records);
+		return 1;
+	}
+
+	items = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, item_free);
+	property_types = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, (GDestroyNotify)g_hash_table_destroy);
+
+	learn_properties();
+
+	mainloop = g_main_loop_new(NULL, FALSE);
+
+	started = g_get_monotonic_time();
+	g_idle_add(play_next, NULL);
+	g_main_loop_run(mainloop);
+
+	g_main_loop_unref(mainloop);
+	g_hash_table_destroy(items);
+	g_hash_table_destroy(property_types);
+	g_ptr_array_unref(records);
+	g_free(bus_address);
+
+	return 0;
+}
@@ -0,0 +1,140 @@
+/*
+Counters and latency histograms the service keeps, for GetStatistics.
+
+This program is free software: you can redistribute it and/or modify it
+under the terms of the GNU General Public License version 3, as published
+by the Free Software Foundation.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranties of
+MERCHANTABILITY, SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR
+PURPOSE.  See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <string.h>
+#include "application-service-stats.h"
+
+/* Upper bounds of the latency histogram buckets in microseconds */
+static const guint64 histogram_bounds[HISTOGRAM_BUCKETS - 1] = {
+	1000, 2000, 5000, 10000, 25000, 50000, 100000, 250000, 500000, 1000000, 2500000
+};
+
+void
+statistics_init (Statistics * stats)
+{
+	memset(stats, 0, sizeof(Statistics));
+	stats->signals_by_name = g_hash_table_new_full(g_str_hash, g_str_equal, NULL, g_free);
+
+	return;
+}
+
+void
+statistics_clear (Statistics * stats)
+{
+	g_clear_pointer(&stats->signals_by_name, g_hash_table_destroy);
+
+	return;
+}
+
+/* Counts a signal we broadcast.  The names are interned, there's
+   only a handful of them. */
+void
+statistics_count_signal (Statistics * stats, const gchar * name)
+{
+	guint64 * count = (guint64 *)g_hash_table_lookup(stats->signals_by_name, name);
+
+	if (count == NULL) {
+		count = g_new0(guint64, 1);
+		g_hash_table_insert(stats->signals_by_name, (gpointer)g_intern_string(name), count);
+	}
+
+	(*count)++;
+
+	return;
+}
+
+void
+statistics_add_counters (const Statistics * stats, GVariantBuilder * counters)
+{
+	GHashTableIter iter;
+	gpointer key, value;
+
+	g_variant_builder_add(counters, "{st}", "registrations", stats->registrations);
+	g_variant_builder_add(counters, "{st}", "removals", stats->removals);
+	g_variant_builder_add(counters, "{st}", "getall-calls", stats->getall_calls);
+	g_variant_builder_add(counters, "{st}", "getall-errors", stats->getall_errors);
+	g_variant_builder_add(counters, "{st}", "get-calls", stats->get_calls);
+	g_variant_builder_add(counters, "{st}", "get-errors", stats->get_errors);
+	g_variant_builder_add(counters, "{st}", "refreshes-requested", stats->refreshes_requested);
+	g_variant_builder_add(counters, "{st}", "refreshes-merged", stats->refreshes_merged);
+	g_variant_builder_add(counters, "{st}", "signals-received", stats->signals_received);
+	g_variant_builder_add(counters, "{st}", "signals-throttled", stats->signals_throttled);
+	g_variant_builder_add(counters, "{st}", "updates-sent", stats->updates_sent);
+	g_variant_builder_add(counters, "{st}", "updates-suppressed", stats->updates_suppressed);
+	g_variant_builder_add(counters, "{st}", "snapshot-builds", stats->snapshot_builds);
+	g_variant_builder_add(counters, "{st}", "snapshot-hits", stats->snapshot_hits);
+	g_variant_builder_add(counters, "{st}", "time-to-first-item", (guint64)stats->time_to_first_item);
+	g_variant_builder_add(counters, "{st}", "time-to-all-items", (guint64)stats->time_to_all_items);
+
+	/* The signals we sent, by name */
+	g_hash_table_iter_init(&iter, stats->signals_by_name);
+	while (g_hash_table_iter_next(&iter, &key, &value)) {
+		gchar * name = g_strconcat("sent-", (const gchar *)key, NULL);
+		g_variant_builder_add(counters, "{st}", name, *(guint64 *)value);
+		g_free(name);
+	}
+
+	return;
+}
+
+static void
+add_histogram (GVariantBuilder * builder, const gchar * name, const Histogram * histogram)
+{
+	GVariantBuilder bounds;
+	GVariantBuilder counts;
+	guint i;
+
+	g_variant_builder_init(&bounds, G_VARIANT_TYPE("at"));
+	for (i = 0; i < G_N_ELEMENTS(histogram_bounds); i++) {
+		g_variant_builder_add(&bounds, "t", histogram_bounds[i]);
+	}
+
+	g_variant_builder_init(&counts, G_VARIANT_TYPE("at"));
+	for (i = 0; i < HISTOGRAM_BUCKETS; i++) {
+		g_variant_builder_add(&counts, "t", histogram->counts[i]);
+	}
+
+	g_variant_builder_add(builder, "{s(atat)}", name, &bounds, &counts);
+
+	return;
+}
+
+void
+statistics_add_histograms (const Statistics * stats, GVariantBuilder * histograms)
+{
+	add_histogram(histograms, "getall-latency", &stats->getall_latency);
+	add_histogram(histograms, "get-latency", &stats->get_latency);
+	add_histogram(histograms, "validation-latency", &stats->validation_latency);
+
+	return;
+}
+
+/* Counts a duration in the first bucket that holds it */
+void
+histogram_add (Histogram * histogram, gint64 duration)
+{
+	guint i;
+
+	for (i = 0; i < G_N_ELEMENTS(histogram_bounds); i++) {
+		if (duration <= (gint64)histogram_bounds[i]) {
+			break;
+		}
+	}
+
+	histogram->counts[i]++;
+
+	return;
+}
@@ -0,0 +1,71 @@
+/*
+Counters and latency histograms the service keeps, for GetStatistics.
+
+This program is free software: you can redistribute it and/or modify it
+under the terms of the GNU General Public License version 3, as published
+by the Free Software Foundation.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranties of
+MERCHANTABILITY, SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR
+PURPOSE.  See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __APPLICATION_SERVICE_STATS_H__
+#define __APPLICATION_SERVICE_STATS_H__
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/* One bucket for each bound in application-service-stats.c and one
+   more for anything slower */
+#define HISTOGRAM_BUCKETS 12
+
+typedef struct {
+	guint64 counts[HISTOGRAM_BUCKETS];
+} Histogram;
+
+/* The service is single threaded, so plain counters are all it
+   takes.  They're only put together when someone asks. */
+typedef struct {
+	guint64 registrations;
+	guint64 removals;
+	guint64 getall_calls;
+	guint64 getall_errors;
+	guint64 get_calls;
+	guint64 get_errors;
+	guint64 refreshes_requested;
+	guint64 refreshes_merged;
+	guint64 signals_received;
+	guint64 signals_throttled;
+	guint64 updates_sent;
+	guint64 updates_suppressed;
+	guint64 snapshot_builds;
+	guint64 snapshot_hits;
+	gint64 time_to_first_item;
+	gint64 time_to_all_items;
+	GHashTable * signals_by_name;
+	Histogram getall_latency;
+	Histogram get_latency;
+	Histogram validation_latency;
+} Statistics;
+
+void statistics_init            (Statistics *       stats);
+void statistics_clear           (Statistics *       stats);
+void statistics_count_signal    (Statistics *       stats,
+                                 const gchar *      name);
+void statistics_add_counters    (const Statistics * stats,
+                                 GVariantBuilder *  counters);
+void statistics_add_histograms  (const Statistics * stats,
+                                 GVariantBuilder *  histograms);
+
+void histogram_add              (Histogram *        histogram,
+                                 gint64             duration);
+
+G_END_DECLS
+
+#endif
@@ -24,10 +24,7 @@ with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include "config.h"
 #endif
 
-#include <stdlib.h>
-#include <dbus/dbus-glib.h>
-#include <dbus/dbus-glib-lowlevel.h>
-#include <dbus/dbus-glib-bindings.h>
+#include <gio/gio.h>
 #include "application-service-watcher.h"
 #include "dbus-shared.h"
 
@@ -47,16 +44,26 @@ enum {
 
 #define CURRENT_PROTOCOL_VERSION 0
 
-static gboolean _ayatana_notification_watcher_server_register_status_notifier_item (ApplicationServiceWatcher * appwatcher, const gchar * service, DBusGMethodInvocation * method);
-static gboolean _ayatana_notification_watcher_server_register_status_notifier_host (ApplicationServiceWatcher * appwatcher, const gchar * host);
-static void get_name_cb (DBusGProxy * proxy, guint status, GError * error, gpointer data);
+/* DBus Prototypes */
+static void bus_method_call (GDBusConnection * connection, const gchar * sender, const gchar * path, const gchar * interface, const gchar * method, GVariant * params, GDBusMethodInvocation * invocation, gpointer user_data);
+static GVariant * bus_get_prop (GDBusConnection * connection, const gchar * sender, const gchar * path, const gchar * interface, const gchar * property, GError ** error, gpointer user_data);
+static void name_acquired (GDBusConnection * connection, const gchar * name, gpointer user_data);
+static void name_lost (GDBusConnection * connection, const gchar * name, gpointer user_data);
+static void host_unwatch (gpointer data);
+static void host_vanished (GDBusConnection * connection, const gchar * name, gpointer user_data);
+static void item_registered (ApplicationServiceAppstore * appstore, const gchar * item, gpointer user_data);
+static void item_unregistered (ApplicationServiceAppstore * appstore, const gchar * item, gpointer user_data);
 
-#include "ayatana-notification-watcher-server.h"
+#include "gen-ayatana-notification-watcher.xml.h"
 
 /* Private Stuff */
 typedef struct {
 	ApplicationServiceAppstore * appstore;
-	DBusGProxy * dbus_proxy;
+	GDBusConnection * bus;
+	guint dbus_registration;
+	guint name_owner;
+	GHashTable * hosts; /* bus name -> name watch */
+	GVariant * items;   /* RegisteredStatusNotifierItems, NULL until asked for */
 } ApplicationServiceWatcherPrivate;
 
 /* Signals Stuff */
@@ -69,6 +76,15 @@ enum {
 
 static guint signals[LAST_SIGNAL] = { 0 };
 
+/* GDBus Stuff */
+static GDBusNodeInfo *      node_info = NULL;
+static GDBusInterfaceInfo * interface_info = NULL;
+static GDBusInterfaceVTable interface_table = {
+	method_call:    bus_method_call,
+	get_property:   bus_get_prop,
+	set_property:   NULL /* No properties that can be set */
+};
+
 /* GObject stuff */
 static void application_service_watcher_class_init (ApplicationServiceWatcherClass *klass);
 static void application_service_watcher_init       (ApplicationServiceWatcher *self);
@@ -137,8 +153,24 @@ application_service_watcher_class_init (ApplicationServiceWatcherClass *klass)
 	                                           g_cclosure_marshal_VOID__VOID,
 	                                           G_TYPE_NONE, 0, G_TYPE_NONE);
 
-	dbus_g_object_type_install_info(APPLICATION_SERVICE_WATCHER_TYPE,
-	                                &dbus_glib__ayatana_notification_watcher_server_object_info);
+	/* Setting up the DBus interfaces */
+	if (node_info == NULL) {
+		GError * error = NULL;
+
+		node_info = g_dbus_node_info_new_for_xml(_ayatana_notification_watcher, &error);
+		if (error != NULL) {
+			g_critical("Unable to parse Notification Watcher Interface description: %s", error->message);
+			g_error_free(error);
+		}
+	}
+
+	if (interface_info == NULL) {
+		interface_info = g_dbus_node_info_lookup_interface(node_info, NOTIFICATION_WATCHER_DBUS_IFACE);
+
+		if (interface_info == NULL) {
+			g_critical("Unable to find interface '" NOTIFICATION_WATCHER_DBUS_IFACE "'");
+		}
+	}
 
 	return;
 }
@@ -149,36 +181,11 @@ application_service_watcher_init (ApplicationServiceWatcher *self)
 	ApplicationServiceWatcherPrivate * priv = application_service_watcher_get_instance_private(self);
 
 	priv->appstore = NULL;
-
-	GError * error = NULL;
-	DBusGConnection * session_bus = dbus_g_bus_get(DBUS_BUS_SESSION, &error);
-	if (error != NULL) {
-		g_warning("Unable to get session bus: %s", error->message);
-		g_error_free(error);
-		exit(0);
-		return;
-	}
-
-	dbus_g_connection_register_g_object(session_bus,
-	                                    NOTIFICATION_WATCHER_DBUS_OBJ,
-	                                    G_OBJECT(self));
-
-	priv->dbus_proxy = dbus_g_proxy_new_for_name_owner(session_bus,
-	                                                   DBUS_SERVICE_DBUS,
-	                                                   DBUS_PATH_DBUS,
-	                                                   DBUS_INTERFACE_DBUS,
-	                                                   &error);
-	if (error != NULL) {
-		g_error("Ah, can't get proxy to dbus: %s", error->message);
-		g_error_free(error);
-		return;
-	}
-
-	org_freedesktop_DBus_request_name_async(priv->dbus_proxy,
-	                                        NOTIFICATION_WATCHER_DBUS_ADDR,
-	                                        DBUS_NAME_FLAG_DO_NOT_QUEUE,
-	                                        get_name_cb,
-	                                        self);
+	priv->bus = NULL;
+	priv->dbus_registration = 0;
+	priv->name_owner = 0;
+	priv->hosts = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, host_unwatch);
+	priv->items = NULL;
 
 	return;
 }
@@ -187,12 +194,35 @@ static void
 application_service_watcher_dispose (GObject *object)
 {
 	ApplicationServiceWatcherPrivate * priv = application_service_watcher_get_instance_private(APPLICATION_SERVICE_WATCHER(object));
-	
+
+	if (priv->name_owner != 0) {
+		g_bus_unown_name(priv->name_owner);
+		priv->name_owner = 0;
+	}
+
+	if (priv->hosts != NULL) {
+		g_hash_table_destroy(priv->hosts);
+		priv->hosts = NULL;
+	}
+
+	if (priv->dbus_registration != 0) {
+		g_dbus_connection_unregister_object(priv->bus, priv->dbus_registration);
+		priv->dbus_registration = 0;
+	}
+
+	if (priv->bus != NULL) {
+		g_object_unref(priv->bus);
+		priv->bus = NULL;
+	}
+
 	if (priv->appstore != NULL) {
+		g_signal_handlers_disconnect_by_data(priv->appstore, object);
 		g_object_unref(G_OBJECT(priv->appstore));
 		priv->appstore = NULL;
 	}
 
+	g_clear_pointer(&priv->items, g_variant_unref);
+
 	G_OBJECT_CLASS (application_service_watcher_parent_class)->dispose (object);
 	return;
 }
@@ -223,65 +253,244 @@ application_service_watcher_get_property (GObject * object, guint prop_id, GValu
 		g_value_set_boolean (value, TRUE);
 		break;
 	case PROP_REGISTERED_STATUS_NOTIFIER_ITEMS:
-		g_value_set_boxed (value, application_service_appstore_application_get_list(priv->appstore));
+		g_value_set_boxed (value, application_service_appstore_get_items(priv->appstore));
 		break;
 	}
 }
 
+/* Builds the watcher on the connection the rest of the service
+   uses, so that there's only one socket and one dispatch. */
 ApplicationServiceWatcher *
-application_service_watcher_new (ApplicationServiceAppstore * appstore)
+application_service_watcher_new (ApplicationServiceAppstore * appstore, GDBusConnection * connection)
 {
 	GObject * obj = g_object_new(APPLICATION_SERVICE_WATCHER_TYPE, NULL);
 	ApplicationServiceWatcherPrivate * priv = application_service_watcher_get_instance_private(APPLICATION_SERVICE_WATCHER(obj));
 	priv->appstore = appstore;
 	g_object_ref(G_OBJECT(priv->appstore));
+	priv->bus = g_object_ref(connection);
+
+	g_signal_connect(priv->appstore, "item-registered", G_CALLBACK(item_registered), obj);
+	g_signal_connect(priv->appstore, "item-unregistered", G_CALLBACK(item_unregistered), obj);
+
+	GError * error = NULL;
+	priv->dbus_registration = g_dbus_connection_register_object(priv->bus,
+	                                                            NOTIFICATION_WATCHER_DBUS_OBJ,
+	                                                            interface_info,
+	                                                            &interface_table,
+	                                                            obj,
+	                                                            NULL,
+	                                                            &error);
+
+	if (error != NULL) {
+		g_critical("Unable to register the object to DBus: %s", error->message);
+		g_error_free(error);
+		return APPLICATION_SERVICE_WATCHER(obj);
+	}
+
+	priv->name_owner = g_bus_own_name_on_connection(priv->bus,
+	                                                NOTIFICATION_WATCHER_DBUS_ADDR,
+	                                                G_BUS_NAME_OWNER_FLAGS_DO_NOT_QUEUE,
+	                                                name_acquired,
+	                                                name_lost,
+	                                                obj,
+	                                                NULL);
+
 	return APPLICATION_SERVICE_WATCHER(obj);
 }
 
-static gboolean
-_ayatana_notification_watcher_server_register_status_notifier_item (ApplicationServiceWatcher * appwatcher, const gchar * service, DBusGMethodInvocation * method)
+static void
+emit_host_signal (ApplicationServiceWatcher * watcher, const gchar * name)
 {
-	ApplicationServiceWatcherPrivate * priv = application_service_watcher_get_instance_private(appwatcher);
-
-	if (service[0] == '/') {
-		char * sender = dbus_g_method_get_sender(method);
-		application_service_appstore_application_add(priv->appstore,
-		                                             sender,
-		                                             service);
-		g_free(sender);
-	} else {
-		application_service_appstore_application_add(priv->appstore,
-		                                             service,
-		                                             NOTIFICATION_ITEM_DEFAULT_OBJ);
+	ApplicationServiceWatcherPrivate * priv = application_service_watcher_get_instance_private(watcher);
+	GError * error = NULL;
+
+	g_dbus_connection_emit_signal(priv->bus,
+	                              NULL,
+	                              NOTIFICATION_WATCHER_DBUS_OBJ,
+	                              NOTIFICATION_WATCHER_DBUS_IFACE,
+	                              name,
+	                              NULL,
+	                              &error);
+
+	if (error != NULL) {
+		g_warning("Unable to send %s signal: %s", name, error->message);
+		g_error_free(error);
 	}
 
-	dbus_g_method_return(method, G_TYPE_NONE);
-	return TRUE;
+	return;
 }
 
-static gboolean
-_ayatana_notification_watcher_server_register_status_notifier_host (ApplicationServiceWatcher * appwatcher, const gchar * host)
+/* Keeps track of a host for as long as its name is around.  We're a
+   host ourselves, so IsStatusNotifierHostRegistered stays TRUE, but
+   items still get told about the hosts coming along. */
+static void
+register_host (ApplicationServiceWatcher * watcher, const gchar * service)
 {
+	ApplicationServiceWatcherPrivate * priv = application_service_watcher_get_instance_private(watcher);
+
+	if (g_hash_table_contains(priv->hosts, service)) {
+		return;
+	}
+
+	guint watch = g_bus_watch_name_on_connection(priv->bus, service,
+	                                             G_BUS_NAME_WATCHER_FLAGS_NONE,
+	                                             NULL, host_vanished,
+	                                             watcher, NULL);
+	g_hash_table_insert(priv->hosts, g_strdup(service), GUINT_TO_POINTER(watch));
+
+	g_debug("Host '%s' registered", service);
 
-	return FALSE;
+	emit_host_signal(watcher, "StatusNotifierHostRegistered");
+	g_signal_emit(watcher, signals[STATUS_NOTIFIER_HOST_REGISTERED], 0);
+
+	return;
+}
+
+static void
+host_unwatch (gpointer data)
+{
+	g_bus_unwatch_name(GPOINTER_TO_UINT(data));
+}
+
+/* The host is gone, and with it its registration.  The protocol
+   has no signal for that, and IsStatusNotifierHostRegistered stays
+   TRUE with us around, so there's nothing to tell the items. */
+static void
+host_vanished (GDBusConnection * connection, const gchar * name, gpointer user_data)
+{
+	ApplicationServiceWatcherPrivate * priv = application_service_watcher_get_instance_private(APPLICATION_SERVICE_WATCHER(user_data));
+
+	g_debug("Host '%s' vanished", name);
+
+	g_hash_table_remove(priv->hosts, name);
+
+	return;
 }
 
-/* Function to handle the return of the get name.  There isn't a whole
-   lot that can be done, but we're atleast going to tell people. */
+/* Tells the hosts about an item coming or going, and drops the
+   list we had of them */
 static void
-get_name_cb (DBusGProxy * proxy, guint status, GError * error, gpointer data)
+item_changed (ApplicationServiceWatcher * watcher, const gchar * item, guint signal, const gchar * name)
 {
+	ApplicationServiceWatcherPrivate * priv = application_service_watcher_get_instance_private(watcher);
+	GError * error = NULL;
+
+	g_clear_pointer(&priv->items, g_variant_unref);
+
+	g_dbus_connection_emit_signal(priv->bus,
+	                              NULL,
+	                              NOTIFICATION_WATCHER_DBUS_OBJ,
+	                              NOTIFICATION_WATCHER_DBUS_IFACE,
+	                              name,
+	                              g_variant_new("(s)", item),
+	                              &error);
+
 	if (error != NULL) {
-		g_warning("Unable to get watcher name '%s' because: %s", NOTIFICATION_WATCHER_DBUS_ADDR, error->message);
-		return;
+		g_warning("Unable to send %s signal: %s", name, error->message);
+		g_error_free(error);
 	}
 
-	if (status != DBUS_REQUEST_NAME_REPLY_PRIMARY_OWNER &&
-			status != DBUS_REQUEST_NAME_REPLY_ALREADY_OWNER) {
-		g_warning("Unable to get watcher name '%s'", NOTIFICATION_WATCHER_DBUS_ADDR);
-		return;
+	g_signal_emit(watcher, signals[signal], 0, item);
+
+	return;
+}
+
+static void
+item_registered (ApplicationServiceAppstore * appstore, const gchar * item, gpointer user_data)
+{
+	item_changed(APPLICATION_SERVICE_WATCHER(user_data), item, STATUS_NOTIFIER_ITEM_REGISTERED, "StatusNotifierItemRegistered");
+}
+
+static void
+item_unregistered (ApplicationServiceAppstore * appstore, const gchar * item, gpointer user_data)
+{
+	item_changed(APPLICATION_SERVICE_WATCHER(user_data), item, STATUS_NOTIFIER_ITEM_UNREGISTERED, "StatusNotifierItemUnregistered");
+}
+
+/* Method calls coming in over DBus */
+static void
+bus_method_call (GDBusConnection * connection, const gchar * sender,
+                 const gchar * path, const gchar * interface,
+                 const gchar * method, GVariant * params,
+                 GDBusMethodInvocation * invocation, gpointer user_data)
+{
+	ApplicationServiceWatcherPrivate * priv = application_service_watcher_get_instance_private(APPLICATION_SERVICE_WATCHER(user_data));
+
+	if (g_strcmp0(method, "RegisterStatusNotifierItem") == 0) {
+		const gchar * service = NULL;
+		const gchar * name = NULL;
+		const gchar * object = NULL;
+		g_variant_get(params, "(&s)", &service);
+
+		if (service[0] == '/') {
+			name = sender;
+			object = service;
+		} else {
+			name = service;
+			object = NOTIFICATION_ITEM_DEFAULT_OBJ;
+		}
+
+		if (!g_dbus_is_name(name) || !g_variant_is_object_path(object)) {
+			g_dbus_method_invocation_return_error(invocation,
+			                                      G_DBUS_ERROR,
+			                                      G_DBUS_ERROR_INVALID_ARGS,
+			                                      "'%s' is neither a bus name nor an object path", service);
+			return;
+		}
+
+		application_service_appstore_application_add(priv->appstore, name, object);
+		g_dbus_method_invocation_return_value(invocation, NULL);
+	} else if (g_strcmp0(method, "RegisterStatusNotifierHost") == 0) {
+		const gchar * service = NULL;
+		g_variant_get(params, "(&s)", &service);
+
+		if (!g_dbus_is_name(service)) {
+			service = sender;
+		}
+
+		register_host(APPLICATION_SERVICE_WATCHER(user_data), service);
+		g_dbus_method_invocation_return_value(invocation, NULL);
+	} else {
+		g_warning("Calling method '%s' on the notification watcher and it's unknown", method);
+		g_dbus_method_invocation_return_error(invocation,
+		                                      G_DBUS_ERROR,
+		                                      G_DBUS_ERROR_UNKNOWN_METHOD,
+		                                      "Unknown method '%s'", method);
+	}
+
+	return;
+}
+
+/* Properties read over DBus */
+static GVariant *
+bus_get_prop (GDBusConnection * connection, const gchar * sender,
+              const gchar * path, const gchar * interface,
+              const gchar * property, GError ** error, gpointer user_data)
+{
+	ApplicationServiceWatcherPrivate * priv = application_service_watcher_get_instance_private(APPLICATION_SERVICE_WATCHER(user_data));
+
+	if (g_strcmp0(property, "ProtocolVersion") == 0) {
+		return g_variant_new_int32(CURRENT_PROTOCOL_VERSION);
+	} else if (g_strcmp0(property, "IsStatusNotifierHostRegistered") == 0) {
+		return g_variant_new_boolean(TRUE);
+	} else if (g_strcmp0(property, "RegisteredStatusNotifierItems") == 0) {
+		/* Built once for every change to the items */
+		if (priv->items == NULL) {
+			priv->items = g_variant_ref_sink(g_variant_new_strv(application_service_appstore_get_items(priv->appstore), -1));
+		}
+		return g_variant_ref(priv->items);
 	}
 
+	g_set_error(error, G_DBUS_ERROR, G_DBUS_ERROR_UNKNOWN_PROPERTY, "Unknown property '%s'", property);
+	return NULL;
+}
+
+/* Nice to know, but we're not doing anything special */
+static void
+name_acquired (GDBusConnection * connection, const gchar * name, gpointer user_data)
+{
+	g_debug("Got watcher name '%s'", name);
+
 	/* After we've got the name we can request upstart to trigger
 	   the jobs of any application indicators that need to start
 	   at desktop init time. */
@@ -315,3 +524,12 @@ get_name_cb (DBusGProxy * proxy, guint status, GError * error, gpointer data)
 
 	return;
 }
+
+/* There isn't a whole lot that can be done, but we're
+   atleast going to tell people. */
+static void
+name_lost (GDBusConnection * connection, const gchar * name, gpointer user_data)
+{
+	g_warning("Unable to get watcher name '%s'", name);
+	return;
+}
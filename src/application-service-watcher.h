@@ -25,6 +25,7 @@ with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 #include <glib.h>
 #include <glib-object.h>
+#include <gio/gio.h>
 
 #include "application-service-appstore.h"
 
@@ -54,7 +55,7 @@ struct _ApplicationServiceWatcher {
 };
 
 GType application_service_watcher_get_type (void);
-ApplicationServiceWatcher * application_service_watcher_new (ApplicationServiceAppstore * appstore);
+ApplicationServiceWatcher * application_service_watcher_new (ApplicationServiceAppstore * appstore, GDBusConnection * connection);
 
 G_END_DECLS
 
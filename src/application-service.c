@@ -43,7 +43,7 @@ bus_acquired (GDBusConnection * con, const gchar * name, gpointer user_data)
 	appstore = application_service_appstore_new();
 
 	/* Adding a watcher for the Apps coming up */
-	watcher = application_service_watcher_new(appstore);
+	watcher = application_service_watcher_new(appstore, con);
 }
 
 /* Nice to know, but we're not doing anything special */
@@ -23,7 +23,25 @@ with this program.  If not, see <http://www.gnu.org/licenses/>.
 #define INDICATOR_APPLICATION_DBUS_ADDR        "org.ayatana.indicator.application"
 #define INDICATOR_APPLICATION_DBUS_OBJ         "/org/ayatana/indicator/application/service"
 #define INDICATOR_APPLICATION_DBUS_IFACE       "org.ayatana.indicator.application.service"
-#define INDICATOR_APPLICATION_SERVICE_VERSION  2
+#define INDICATOR_APPLICATION_SERVICE_VERSION  3
+
+/* Counters and histograms of the service, next to the main interface */
+#define INDICATOR_APPLICATION_STATS_DBUS_IFACE "org.ayatana.indicator.application.service.Statistics"
+
+/* The filtered signals of subscribed clients, sent to them alone */
+#define INDICATOR_APPLICATION_SUBSCRIPTION_DBUS_IFACE "org.ayatana.indicator.application.service.Subscription"
+
+/* Clients that set at least this protocol version get the field
+   updates batched in ApplicationsChanged */
+#define INDICATOR_APPLICATION_SERVICE_BATCHED_VERSION  3
+
+/* The fields in the mask of an ApplicationsChanged entry */
+#define INDICATOR_APPLICATION_FIELD_ICON             (1 << 0)
+#define INDICATOR_APPLICATION_FIELD_ICON_THEME_PATH  (1 << 1)
+#define INDICATOR_APPLICATION_FIELD_LABEL            (1 << 2)
+#define INDICATOR_APPLICATION_FIELD_TITLE            (1 << 3)
+#define INDICATOR_APPLICATION_FIELD_TOOLTIP          (1 << 4)
+#define INDICATOR_APPLICATION_FIELD_ALL              ((1 << 5) - 1)
 
 #define NOTIFICATION_WATCHER_DBUS_ADDR    "org.kde.StatusNotifierWatcher"
 #define NOTIFICATION_WATCHER_DBUS_OBJ     "/StatusNotifierWatcher"
@@ -43,6 +43,7 @@ with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 /* Local Stuff */
 #include "dbus-shared.h"
+#include "tracing.h"
 #include "gen-ayatana-application-service.xml.h"
 #include "ayatana-application-service-marshal.h"
 
@@ -84,6 +85,10 @@ typedef struct {
     GCancellable * get_apps_cancel;
     guint watch;
     GDBusConnection *pConnection;
+    gboolean batched_updates;
+    guint64 generation;
+    gboolean catching_up;  /* applying what GetApplicationsSince sent */
+    gboolean out_of_sync;  /* a sync was asked for while catching up */
 } IndicatorApplicationPrivate;
 
 typedef struct _ApplicationEntry ApplicationEntry;
@@ -96,6 +101,7 @@ struct _ApplicationEntry {
     gchar * guide;
     gchar * longname;
     gint nPosition;
+    gboolean bPending; /* in the list, but the host only gets it once the menu is there */
     GMenuModel *pModel;
     GActionGroup *pActions;
     gboolean bMenuShown;
@@ -118,15 +124,20 @@ static gboolean disconnected_kill (gpointer user_data);
 static void disconnected_kill_helper (gpointer data, gpointer user_data);
 static void application_added (IndicatorApplication * application, const gchar * iconname, gint position, const gchar * dbusaddress, const gchar * dbusobject, const gchar * icon_theme_path, const gchar * label, const gchar * guide, const gchar * accessible_desc, const gchar * hint, const gchar *sTooltipIcon, const gchar *sTooltipTitle, const gchar *sTooltipDescription);
 static void application_removed (IndicatorApplication * application, gint position);
+static void application_moved (IndicatorApplication * application, gint oldposition, gint newposition);
 static void application_label_changed (IndicatorApplication * application, gint position, const gchar * label, const gchar * guide);
 static void application_icon_changed (IndicatorApplication * application, gint position, const gchar * iconname, const gchar * icondesc);
 static void application_icon_theme_path_changed (IndicatorApplication * application, gint position, const gchar * icon_theme_path);
 static void get_applications (GObject * obj, GAsyncResult * res, gpointer user_data);
+static void get_applications_since (GObject * obj, GAsyncResult * res, gpointer user_data);
+static void sync_applications (IndicatorApplication * self);
+static void handle_signal (IndicatorApplication * self, const gchar * signal_name, GVariant * parameters);
 static void get_applications_helper (IndicatorApplication * self, GVariant * variant);
 static void theme_dir_unref(IndicatorApplication * ia, const gchar * dir);
 static void theme_dir_ref(IndicatorApplication * ia, const gchar * dir);
 static void icon_theme_remove_dir_from_search_path (const char * dir);
 static void service_proxy_cb (GObject * object, GAsyncResult * res, gpointer user_data);
+static void set_protocol_version (IndicatorApplication * self);
 static void receive_signal (GDBusProxy * proxy, gchar * sender_name, gchar * signal_name, GVariant * parameters, gpointer user_data);
 
 G_DEFINE_TYPE_WITH_PRIVATE (IndicatorApplication, indicator_application, INDICATOR_OBJECT_TYPE);
@@ -173,6 +184,10 @@ indicator_application_init (IndicatorApplication *self)
     priv->theme_dirs = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
 
     priv->get_apps_cancel = NULL;
+    priv->batched_updates = FALSE;
+    priv->generation = 0;
+    priv->catching_up = FALSE;
+    priv->out_of_sync = FALSE;
 
     return;
 }
@@ -263,11 +278,103 @@ connected (GDBusConnection * con, const gchar * name, const gchar * owner, gpoin
                          priv->service_proxy_cancel,
                          service_proxy_cb,
                              application);
+    } else if (priv->service_proxy != NULL) {
+        /* A new instance of the service doesn't know about us,
+           and we need to know what it has */
+        set_protocol_version(application);
     }
 
     return;
 }
 
+/* Tells us whether the service will batch the updates for us */
+static void
+protocol_version_cb (GObject * object, GAsyncResult * res, gpointer user_data)
+{
+    IndicatorApplication * self = INDICATOR_APPLICATION(user_data);
+    IndicatorApplicationPrivate * priv = indicator_application_get_instance_private(self);
+    GError * error = NULL;
+
+    GVariant * result = g_dbus_proxy_call_finish(G_DBUS_PROXY(object), res, &error);
+
+    if (error != NULL) {
+        /* Older services don't know the method and send the field
+           signals, which we handle anyway */
+        g_debug("Service does not batch updates: %s", error->message);
+        g_error_free(error);
+    } else {
+        gint version = 0;
+        g_variant_get(result, "(i)", &version);
+        g_variant_unref(result);
+
+        priv->batched_updates = (version >= INDICATOR_APPLICATION_SERVICE_BATCHED_VERSION);
+        g_debug("Service protocol version %d", version);
+    }
+
+    /* Now that we know how to talk to it, get the applications */
+    if (priv->service_proxy != NULL) {
+        sync_applications(self);
+    }
+
+    g_object_unref(self);
+    return;
+}
+
+/* Gets the applications from the service.  Services that batch
+   updates also tell us what changed since the generation we have,
+   older ones send the whole list.  A call in flight is cancelled,
+   its answer would start from a generation we're past. */
+static void
+sync_applications (IndicatorApplication * self)
+{
+    IndicatorApplicationPrivate * priv = indicator_application_get_instance_private(self);
+
+    /* The generation is only right again once the catching up is
+       done, it asks again from there */
+    if (priv->catching_up) {
+        priv->out_of_sync = TRUE;
+        return;
+    }
+
+    if (priv->get_apps_cancel != NULL) {
+        g_cancellable_cancel(priv->get_apps_cancel);
+        g_object_unref(priv->get_apps_cancel);
+    }
+
+    priv->get_apps_cancel = g_cancellable_new();
+
+    if (priv->batched_updates) {
+        g_debug("Request apps since generation %" G_GUINT64_FORMAT, priv->generation);
+        g_dbus_proxy_call(priv->service_proxy, "GetApplicationsSince",
+                          g_variant_new("(t)", priv->generation),
+                          G_DBUS_CALL_FLAGS_NONE, -1, priv->get_apps_cancel,
+                          get_applications_since, self);
+    } else {
+        g_debug("Request current apps");
+        g_dbus_proxy_call(priv->service_proxy, "GetApplications", NULL,
+                          G_DBUS_CALL_FLAGS_NONE, -1, priv->get_apps_cancel,
+                          get_applications, self);
+    }
+
+    return;
+}
+
+/* Asks the service to batch the field updates for us.  The service
+   handles our calls in order, so this is in effect before anything
+   that we ask for after it. */
+static void
+set_protocol_version (IndicatorApplication * self)
+{
+    IndicatorApplicationPrivate * priv = indicator_application_get_instance_private(self);
+
+    g_dbus_proxy_call(priv->service_proxy, "SetProtocolVersion",
+                      g_variant_new("(i)", INDICATOR_APPLICATION_SERVICE_VERSION),
+                      G_DBUS_CALL_FLAGS_NONE, -1, NULL,
+                      protocol_version_cb, g_object_ref(self));
+
+    return;
+}
+
 /* Callback from trying to create the proxy for the service, this
    could include starting the service. */
 static void
@@ -299,21 +406,9 @@ service_proxy_cb (GObject * object, GAsyncResult * res, gpointer user_data)
 
     g_signal_connect(proxy, "g-signal", G_CALLBACK(receive_signal), self);
 
-    /* We shouldn't be in a situation where we've already
-       called this function.  It doesn't *hurt* anything, but
-       man we should look into it more. */
-    if (priv->get_apps_cancel != NULL) {
-        g_warning("Already getting applications?  Odd.");
-        return;
-    }
-
-    priv->get_apps_cancel = g_cancellable_new();
-
-    /* Query it for existing applications */
-    g_debug("Request current apps");
-    g_dbus_proxy_call(priv->service_proxy, "GetApplications", NULL,
-                      G_DBUS_CALL_FLAGS_NONE, -1, priv->get_apps_cancel,
-                      get_applications, self);
+    /* Query it for existing applications once we know
+       which protocol it speaks */
+    set_protocol_version(self);
 
     return;
 }
@@ -328,6 +423,15 @@ disconnected (GDBusConnection * con, const gchar * name, gpointer user_data)
     g_return_if_fail(application != NULL);
 
     IndicatorApplicationPrivate * priv = indicator_application_get_instance_private(application);
+    /* Whoever comes next starts counting from scratch, and an
+       answer still on its way is for a list that's gone */
+    priv->batched_updates = FALSE;
+    priv->generation = 0;
+    if (priv->get_apps_cancel != NULL) {
+        g_cancellable_cancel(priv->get_apps_cancel);
+        g_object_unref(priv->get_apps_cancel);
+        priv->get_apps_cancel = NULL;
+    }
     g_list_foreach(priv->applications, disconnected_helper, application);
     /* I'll like this to be a little shorter, but it's a bit
        inpractical to make it so.  This means that the user will
@@ -373,6 +477,35 @@ disconnected_kill_helper (gpointer data, gpointer user_data)
     return;
 }
 
+/* The position of an entry among the ones the host knows about,
+   which leaves out the ones still waiting for their menu */
+static guint
+entry_location (IndicatorApplicationPrivate * priv, ApplicationEntry * app)
+{
+    GList * link;
+    guint location = 0;
+
+    for (link = priv->applications; link != NULL && link->data != app; link = g_list_next(link)) {
+        if (!((ApplicationEntry *)link->data)->bPending) {
+            location++;
+        }
+    }
+
+    return location;
+}
+
+/* Gives every entry the position it has in the service's list */
+static void
+renumber_applications (IndicatorApplicationPrivate * priv)
+{
+    GList * link;
+    gint position = 0;
+
+    for (link = priv->applications; link != NULL; link = g_list_next(link)) {
+        ((ApplicationEntry *)link->data)->nPosition = position++;
+    }
+}
+
 /* Goes through the list of applications that we're maintaining and
    pulls out the IndicatorObjectEntry and returns that in a list
    for the caller. */
@@ -387,8 +520,11 @@ get_entries (IndicatorObject * io)
     GList * apppointer = NULL;
 
     for (apppointer = priv->applications; apppointer != NULL; apppointer = g_list_next(apppointer)) {
-        IndicatorObjectEntry * entry = &(((ApplicationEntry *)apppointer->data)->entry);
-        retval = g_list_prepend(retval, entry);
+        ApplicationEntry * app = (ApplicationEntry *)apppointer->data;
+
+        if (!app->bPending) {
+            retval = g_list_prepend(retval, &(app->entry));
+        }
     }
 
     if (retval != NULL) {
@@ -404,7 +540,7 @@ get_location (IndicatorObject * io, IndicatorObjectEntry * entry)
 {
     g_return_val_if_fail(IS_INDICATOR_APPLICATION(io), 0);
     IndicatorApplicationPrivate * priv = indicator_application_get_instance_private(INDICATOR_APPLICATION(io));
-    return g_list_index(priv->applications, entry);
+    return entry_location(priv, (ApplicationEntry *)entry);
 }
 
 /* Redirect the secondary activate to the Application Item */
@@ -561,9 +697,12 @@ static void applicationAddedFinish (ApplicationEntry *pEntry)
 
     gtk_widget_show (GTK_WIDGET (pEntry->entry.image));
     gtk_widget_hide (GTK_WIDGET (pEntry->entry.menu));
-    IndicatorApplicationPrivate * pPrivate = indicator_application_get_instance_private (INDICATOR_APPLICATION (pEntry->entry.parent_object));
-    pPrivate->applications = g_list_insert (pPrivate->applications, pEntry, pEntry->nPosition);
+
+    /* It has been in the list all along, and kept its place through
+       whatever moved in the meantime */
+    pEntry->bPending = FALSE;
     g_signal_emit (G_OBJECT (pEntry->entry.parent_object), INDICATOR_OBJECT_SIGNAL_ENTRY_ADDED_ID, 0, &(pEntry->entry), TRUE);
+    TRACE (application_added, pEntry->dbusaddress, pEntry->dbusobject, TRACE_STR (pEntry->entry.name_hint), pEntry->nPosition, g_get_monotonic_time ());
     g_signal_connect (pEntry->entry.menu, "popped-up", G_CALLBACK (onMenuPoppedUp), pEntry);
     g_signal_connect (pEntry->entry.menu, "hide", G_CALLBACK (onMenuHide), pEntry);
 
@@ -622,6 +761,7 @@ application_added (IndicatorApplication * application, const gchar * iconname, g
     app->bMenuShown = FALSE;
     app->entry.parent_object = INDICATOR_OBJECT(application);
     app->nPosition = position;
+    app->bPending = TRUE;
     app->old_service = FALSE;
     app->icon_theme_path = NULL;
     if (icon_theme_path != NULL && icon_theme_path[0] != '\0') {
@@ -676,12 +816,18 @@ application_added (IndicatorApplication * application, const gchar * iconname, g
     }
 
     setTooltip (app, sTooltipIcon, sTooltipTitle, sTooltipDescription);
+
+    /* It takes its place right away, so the positions of the
+       signals that follow count it even before its menu is there */
+    IndicatorApplicationPrivate * priv = indicator_application_get_instance_private (application);
+    priv->applications = g_list_insert (priv->applications, app, position);
+    renumber_applications (priv);
+
     gboolean bGLibMenu = g_str_has_prefix (dbusobject, "/org/ayatana/appindicator/");
 
     if (bGLibMenu)
     {
-        IndicatorApplicationPrivate * pPrivate = indicator_application_get_instance_private (application);
-        app->pModel = G_MENU_MODEL (g_dbus_menu_model_get (pPrivate->pConnection, dbusaddress, dbusobject));
+        app->pModel = G_MENU_MODEL (g_dbus_menu_model_get (priv->pConnection, dbusaddress, dbusobject));
         g_signal_connect (app->pModel, "items-changed", G_CALLBACK (onMenuModelChanged), app);
 
         if (g_menu_model_get_n_items (app->pModel))
@@ -711,7 +857,16 @@ application_removed (IndicatorApplication * application, gint position)
     }
 
     priv->applications = g_list_remove(priv->applications, app);
-    g_signal_emit(G_OBJECT(application), INDICATOR_OBJECT_SIGNAL_ENTRY_REMOVED_ID, 0, &(app->entry), TRUE);
+    renumber_applications(priv);
+
+    if (app->bPending) {
+        /* The host never saw it, and the menu must not finish it now */
+        if (app->pModel != NULL) {
+            g_signal_handlers_disconnect_by_data(app->pModel, app);
+        }
+    } else {
+        g_signal_emit(G_OBJECT(application), INDICATOR_OBJECT_SIGNAL_ENTRY_REMOVED_ID, 0, &(app->entry), TRUE);
+    }
 
     if (app->icon_theme_path != NULL) {
         theme_dir_unref(application, app->icon_theme_path);
@@ -754,6 +909,38 @@ application_removed (IndicatorApplication * application, gint position)
     return;
 }
 
+/* The service reordered an application, so we move its entry
+   to the new position and tell the host about it. */
+static void
+application_moved (IndicatorApplication * application, gint oldposition, gint newposition)
+{
+    g_return_if_fail(IS_INDICATOR_APPLICATION(application));
+    IndicatorApplicationPrivate * priv = indicator_application_get_instance_private(application);
+    ApplicationEntry * app = (ApplicationEntry *)g_list_nth_data(priv->applications, oldposition);
+
+    if (app == NULL) {
+        g_warning("Unable to find application at position: %d", oldposition);
+        return;
+    }
+
+    guint oldlocation = entry_location(priv, app);
+
+    priv->applications = g_list_remove(priv->applications, app);
+    priv->applications = g_list_insert(priv->applications, app, newposition);
+    renumber_applications(priv);
+
+    /* An entry still waiting for its menu gets added where it is now */
+    if (!app->bPending) {
+        guint newlocation = entry_location(priv, app);
+
+        if (newlocation != oldlocation) {
+            g_signal_emit(G_OBJECT(application), INDICATOR_OBJECT_SIGNAL_ENTRY_MOVED_ID, 0, &(app->entry), oldlocation, newlocation);
+        }
+    }
+
+    return;
+}
+
 /* The callback for the signal that the label for an application
    has changed. */
 static void
@@ -805,7 +992,8 @@ application_label_changed (IndicatorApplication * application, gint position, co
     /* Protected against not having a label */
     guess_label_size(app);
 
-    if (signal_reload) {
+    /* The host hasn't got it yet if it's still waiting for its menu */
+    if (signal_reload && !app->bPending) {
         /* Telling the listener that this has been removed, and then
            readded to make it reparse the entry. */
         if (app->entry.label != NULL) {
@@ -834,6 +1022,8 @@ application_label_changed (IndicatorApplication * application, gint position, co
         g_signal_emit(G_OBJECT(application), INDICATOR_OBJECT_SIGNAL_ENTRY_ADDED_ID, 0, &(app->entry), TRUE);
     }
 
+    TRACE(application_label_changed, app->dbusaddress, app->dbusobject, TRACE_STR(app->entry.name_hint), position, g_get_monotonic_time());
+
     return;
 }
 
@@ -882,6 +1072,8 @@ application_icon_changed (IndicatorApplication * application, gint position, con
         g_signal_emit(G_OBJECT(application), INDICATOR_OBJECT_SIGNAL_ACCESSIBLE_DESC_UPDATE_ID, 0, &(app->entry), TRUE);
     }
 
+    TRACE(application_icon_changed, app->dbusaddress, app->dbusobject, TRACE_STR(app->entry.name_hint), position, g_get_monotonic_time());
+
     return;
 }
 
@@ -914,6 +1106,73 @@ application_icon_theme_path_changed (IndicatorApplication * application, gint po
     return;
 }
 
+/* Looks up a string in the values of an ApplicationsChanged entry */
+static const gchar *
+lookup_change (GVariant * values, const gchar * key)
+{
+    const gchar * value = NULL;
+
+    if (!g_variant_lookup(values, key, "&s", &value)) {
+        value = "";
+    }
+
+    return value;
+}
+
+/* Applies the field changes the service batched up for us */
+static void
+applications_changed (IndicatorApplication * self, GVariant * parameters)
+{
+    IndicatorApplicationPrivate * priv = indicator_application_get_instance_private(self);
+    GVariantIter * iter = NULL;
+    GVariant * values = NULL;
+    gint position;
+    guint fields;
+
+    guint64 generation = 0;
+    g_variant_get(parameters, "(ta(iua{sv}))", &generation, &iter);
+
+    /* Catching up already brought us this one */
+    if (generation <= priv->generation) {
+        g_debug("Got generation %" G_GUINT64_FORMAT " at %" G_GUINT64_FORMAT ", ignoring it", generation, priv->generation);
+        g_variant_iter_free(iter);
+        return;
+    }
+
+    /* If we missed something, catch up on it instead */
+    if (generation != priv->generation + 1) {
+        g_debug("Got generation %" G_GUINT64_FORMAT " after %" G_GUINT64_FORMAT ", syncing", generation, priv->generation);
+        g_variant_iter_free(iter);
+        sync_applications(self);
+        return;
+    }
+
+    priv->generation = generation;
+
+    while (g_variant_iter_loop(iter, "(iu@a{sv})", &position, &fields, &values)) {
+        if (fields & INDICATOR_APPLICATION_FIELD_ICON_THEME_PATH) {
+            application_icon_theme_path_changed(self, position, lookup_change(values, "icon-theme-path"));
+        }
+
+        if (fields & INDICATOR_APPLICATION_FIELD_ICON) {
+            application_icon_changed(self, position, lookup_change(values, "icon"), lookup_change(values, "icon-desc"));
+        }
+
+        if (fields & INDICATOR_APPLICATION_FIELD_LABEL) {
+            application_label_changed(self, position, lookup_change(values, "label"), lookup_change(values, "guide"));
+        }
+
+        if (fields & INDICATOR_APPLICATION_FIELD_TOOLTIP) {
+            ApplicationEntry * entry = (ApplicationEntry *)g_list_nth_data(priv->applications, position);
+            setTooltip(entry, lookup_change(values, "tooltip-icon"), lookup_change(values, "tooltip-title"), lookup_change(values, "tooltip-description"));
+        }
+    }
+
+    g_variant_iter_free(iter);
+
+    return;
+}
+
 /* Receives all signals from the service, routed to the appropriate functions */
 static void
 receive_signal (GDBusProxy * proxy, gchar * sender_name, gchar * signal_name,
@@ -922,21 +1181,34 @@ receive_signal (GDBusProxy * proxy, gchar * sender_name, gchar * signal_name,
     IndicatorApplication * self = INDICATOR_APPLICATION(user_data);
     IndicatorApplicationPrivate * priv = indicator_application_get_instance_private(self);
 
-    /* If we're in the middle of a GetApplications call and we get
-       any of these our state is probably going to just be confused.  Let's
-       cancel the call we had and try again to try and get a clear answer */
-    if (priv->get_apps_cancel != NULL) {
-        g_cancellable_cancel(priv->get_apps_cancel);
-        g_object_unref(priv->get_apps_cancel);
+    TRACE(receive_signal, signal_name, g_get_monotonic_time());
 
-        priv->get_apps_cancel = g_cancellable_new();
+    if (priv->get_apps_cancel != NULL) {
+        /* The reply to GetApplicationsSince comes after this, and
+           it already includes the change */
+        if (priv->batched_updates) {
+            return;
+        }
 
-        g_dbus_proxy_call(priv->service_proxy, "GetApplications", NULL,
-                          G_DBUS_CALL_FLAGS_NONE, -1, priv->get_apps_cancel,
-                          get_applications, self);
+        /* If we're in the middle of a GetApplications call and we get
+           any of these our state is probably going to just be confused.  Let's
+           cancel the call we had and try again to try and get a clear answer */
+        sync_applications(self);
         return;
     }
 
+    handle_signal(self, signal_name, parameters);
+
+    return;
+}
+
+/* Applies a change the service told us about, either in a signal
+   or when catching up with GetApplicationsSince */
+static void
+handle_signal (IndicatorApplication * self, const gchar * signal_name, GVariant * parameters)
+{
+    IndicatorApplicationPrivate * priv = indicator_application_get_instance_private(self);
+
     if (g_strcmp0(signal_name, "ApplicationAdded") == 0) {
         gchar * iconname = NULL;
         gint position;
@@ -956,6 +1228,7 @@ receive_signal (GDBusProxy * proxy, gchar * sender_name, gchar * signal_name,
                        &icon_theme_path, &label, &guide,
                        &accessible_desc, &hint, &title, &sTooltipIcon, &sTooltipTitle, &sTooltipDescription);
 
+        priv->generation++;
         application_added(self, iconname, position, dbusaddress,
                           dbusobject, icon_theme_path, label, guide,
                           accessible_desc, hint, sTooltipIcon, sTooltipTitle, sTooltipDescription);
@@ -975,8 +1248,23 @@ receive_signal (GDBusProxy * proxy, gchar * sender_name, gchar * signal_name,
     else if (g_strcmp0(signal_name, "ApplicationRemoved") == 0) {
         gint position;
         g_variant_get (parameters, "(i)", &position);
+        priv->generation++;
         application_removed(self, position);
     }
+    else if (g_strcmp0(signal_name, "ApplicationMoved") == 0) {
+        gint oldposition;
+        gint newposition;
+        g_variant_get (parameters, "(ii)", &oldposition, &newposition);
+        priv->generation++;
+        application_moved(self, oldposition, newposition);
+    }
+    else if (g_strcmp0(signal_name, "ApplicationsChanged") == 0) {
+        applications_changed(self, parameters);
+    }
+    else if (priv->batched_updates) {
+        /* We get these in ApplicationsChanged, they're only around
+           for other clients of the service */
+    }
     else if (g_strcmp0(signal_name, "ApplicationIconChanged") == 0) {
         gint position;
         gchar * iconname = NULL;
@@ -1106,6 +1394,91 @@ get_applications_helper (IndicatorApplication * self, GVariant * variant)
     return;
 }
 
+/* Catches up with the service, either with the changes since
+   the generation we had or with the whole list. */
+static void
+get_applications_since (GObject * obj, GAsyncResult * res, gpointer user_data)
+{
+    IndicatorApplication * self = INDICATOR_APPLICATION(user_data);
+    IndicatorApplicationPrivate * priv = indicator_application_get_instance_private(self);
+    GError * error = NULL;
+    GVariant * result;
+    GVariant * child;
+    GVariantIter * apps;
+    GVariantIter * changes;
+    guint64 generation = 0;
+    gboolean full = FALSE;
+
+    result = g_dbus_proxy_call_finish(G_DBUS_PROXY(obj), res, &error);
+
+    /* No one can cancel us anymore, we've completed! */
+    if (priv->get_apps_cancel != NULL) {
+        if (error == NULL || error->domain != G_IO_ERROR || error->code != G_IO_ERROR_CANCELLED) {
+            g_object_unref(priv->get_apps_cancel);
+            priv->get_apps_cancel = NULL;
+        }
+    }
+
+    /* If we got an error, print it and exit out */
+    if (error != NULL) {
+        g_warning("Unable to get application changes: %s", error->message);
+        g_error_free(error);
+        return;
+    }
+
+    g_variant_get(result, "(tba(sisosssssssss)a(sv))", &generation, &full, &apps, &changes);
+
+    /* Changes only ever take us forward */
+    if (!full && generation < priv->generation) {
+        g_debug("Got changes up to generation %" G_GUINT64_FORMAT " at %" G_GUINT64_FORMAT ", ignoring them", generation, priv->generation);
+        g_variant_iter_free(apps);
+        g_variant_iter_free(changes);
+        g_variant_unref(result);
+        return;
+    }
+
+    if (full) {
+        /* Remove all applications that we previously had
+           as we're going to repopulate the list. */
+        while (priv->applications != NULL) {
+            application_removed(self, 0);
+        }
+
+        while ((child = g_variant_iter_next_value (apps))) {
+            get_applications_helper(self, child);
+            g_variant_unref(child);
+        }
+    } else {
+        const gchar * name = NULL;
+        GVariant * params = NULL;
+
+        g_debug("Catching up from generation %" G_GUINT64_FORMAT " to %" G_GUINT64_FORMAT, priv->generation, generation);
+
+        /* A change that doesn't follow on stops it where it is,
+           rather than starting another sync in the middle */
+        priv->catching_up = TRUE;
+        priv->out_of_sync = FALSE;
+        while (!priv->out_of_sync && g_variant_iter_next(changes, "(&sv)", &name, &params)) {
+            handle_signal(self, name, params);
+            g_variant_unref(params);
+        }
+        priv->catching_up = FALSE;
+    }
+
+    if (priv->out_of_sync) {
+        priv->out_of_sync = FALSE;
+        sync_applications(self);
+    } else {
+        priv->generation = generation;
+    }
+
+    g_variant_iter_free(apps);
+    g_variant_iter_free(changes);
+    g_variant_unref(result);
+
+    return;
+}
+
 /* Unrefs a theme directory.  This may involve removing it from
    the search path. */
 static void
@@ -0,0 +1,41 @@
+/*
+Static tracepoints for the service and the indicator.
+
+This program is free software: you can redistribute it and/or modify it
+under the terms of the GNU General Public License version 3, as published
+by the Free Software Foundation.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranties of
+MERCHANTABILITY, SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR
+PURPOSE.  See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __TRACING_H__
+#define __TRACING_H__
+
+/* With ENABLE_TRACING the probes end up as USDT notes that perf and
+   bpftrace can attach to, under the ayatana_indicator_application
+   provider.  Without it they, and their arguments, are gone.  Items
+   are named by their bus name and object path, which both processes
+   know, and the timestamps are g_get_monotonic_time(). */
+
+#ifdef ENABLE_TRACING
+
+#include <sys/sdt.h>
+
+#define TRACE(name, ...) STAP_PROBEV(ayatana_indicator_application, name, ##__VA_ARGS__)
+
+#else
+
+#define TRACE(name, ...) do { } while (0)
+
+#endif
+
+/* Probes don't like NULL strings */
+#define TRACE_STR(str) ((str) != NULL ? (str) : "")
+
+#endif /* __TRACING_H__ */
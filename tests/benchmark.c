@@ -0,0 +1,2537 @@
+/*
+Benchmarks of the application service on a private bus.  The real
+service is started on a bus of its own, synthetic items register with
+it and change, and a headless host listens to what the service tells
+the panels.  Each run prints one line of JSON, so that the results can
+be kept and compared across releases.
+
+This program is free software: you can redistribute it and/or modify it
+under the terms of the GNU General Public License version 3, as published
+by the Free Software Foundation.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranties of
+MERCHANTABILITY, SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR
+PURPOSE.  See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <gio/gio.h>
+#include <glib/gstdio.h>
+#include "dbus-shared.h"
+#include "malloc-counters.h"
+
+/* Set by the build to the binaries under test */
+#ifndef SERVICE_PATH
+#define SERVICE_PATH "ayatana-indicator-application-service"
+#endif
+
+#ifndef REPLAY_PATH
+#define REPLAY_PATH "ayatana-indicator-application-replay"
+#endif
+
+#ifndef MALLOC_COUNTERS_PATH
+#define MALLOC_COUNTERS_PATH "libayatana-indicator-application-malloc-counters.so"
+#endif
+
+/* How often waiting checks the clock, in milliseconds */
+#define WAIT_TICK               100
+
+/* Connections get shared by the items beyond this many */
+#define MAX_CONNECTIONS         64
+
+/* Values the host sees that come from an update we sent */
+#define UPDATE_FORMAT           "bench-%u-%u"
+
+/* The size of the pixmap in the tooltip, apps do send those */
+#define TOOLTIP_PIXMAP_SIZE     22
+
+/* How often to start the service or reload the overrides when
+   timing those */
+#define TIMED_RUNS              5
+
+/* The ordering indexes that put an item first and last */
+#define ORDERING_FIRST          1
+#define ORDERING_LAST           2000000000
+
+static const gchar item_xml[] =
+	"<node>"
+	"  <interface name='" NOTIFICATION_ITEM_DBUS_IFACE "'>"
+	"    <property name='Id' type='s' access='read'/>"
+	"    <property name='Category' type='s' access='read'/>"
+	"    <property name='Status' type='s' access='read'/>"
+	"    <property name='IconName' type='s' access='read'/>"
+	"    <property name='IconAccessibleDesc' type='s' access='read'/>"
+	"    <property name='AttentionIconName' type='s' access='read'/>"
+	"    <property name='AttentionAccessibleDesc' type='s' access='read'/>"
+	"    <property name='Title' type='s' access='read'/>"
+	"    <property name='IconThemePath' type='s' access='read'/>"
+	"    <property name='Menu' type='o' access='read'/>"
+	"    <property name='XAyatanaLabel' type='s' access='read'/>"
+	"    <property name='XAyatanaLabelGuide' type='s' access='read'/>"
+	"    <property name='XAyatanaOrderingIndex' type='u' access='read'/>"
+	"    <property name='ToolTip' type='(sa(iiay)ss)' access='read'/>"
+	"    <method name='Scroll'>"
+	"      <arg type='i' name='delta' direction='in'/>"
+	"      <arg type='s' name='orientation' direction='in'/>"
+	"    </method>"
+	"    <method name='XAyatanaSecondaryActivate'>"
+	"      <arg type='u' name='timestamp' direction='in'/>"
+	"    </method>"
+	"  </interface>"
+	"</node>";
+
+typedef struct _ItemConnection ItemConnection;
+typedef struct _Item Item;
+typedef struct _Scenario Scenario;
+
+/* A connection like an application has, with the items on it */
+struct _ItemConnection {
+	GDBusConnection * connection;
+	guint filter;
+};
+
+/* A synthetic item.  The updates it sends put their number in the
+   value that changes, so the host can tell which one it saw. */
+struct _Item {
+	guint index;
+	ItemConnection * owner;
+	gchar * id;
+	gchar * path;
+	gchar * menu;
+	guint registration;
+	const gchar * status;
+	gchar * icon;
+	gchar * label;
+	gchar * tooltip;
+	guint sent;
+	guint seen;
+	guint goal;
+	gint64 sent_at;
+	gint64 registered_at;
+	gint64 added_at;
+	gboolean added;
+	guint timer;
+	guint reads;
+};
+
+struct _Scenario {
+	const gchar * name;
+	const gchar * description;
+	gboolean (* run) (void);
+};
+
+/* Options */
+static gchar * scenario_name = NULL;
+static gint item_count = 10;
+static gint connection_count = 0;
+static gint update_count = 100;
+static gint update_rate = 0;
+static gchar * update_kind = NULL;
+static gint protocol_version = INDICATOR_APPLICATION_SERVICE_VERSION;
+static gint timeout = 60;
+static gchar ** extra_env = NULL;
+static gchar * output = NULL;
+static gchar * service_path = NULL;
+static gint override_count = 1000;
+static gchar * recording = NULL;
+static gboolean real_time = FALSE;
+
+static GOptionEntry options[] = {
+	{ "scenario", 's', 0, G_OPTION_ARG_STRING, &scenario_name, "What to measure, see --list", "NAME" },
+	{ "items", 'n', 0, G_OPTION_ARG_INT, &item_count, "How many items to register (10)", "N" },
+	{ "connections", 'c', 0, G_OPTION_ARG_INT, &connection_count, "How many connections the items share (one per item, up to 64)", "N" },
+	{ "updates", 'u', 0, G_OPTION_ARG_INT, &update_count, "How many updates each item sends (100)", "N" },
+	{ "rate", 'r', 0, G_OPTION_ARG_INT, &update_rate, "Updates per second per item, 0 sends the next once the host saw the last (0)", "N" },
+	{ "kind", 'k', 0, G_OPTION_ARG_STRING, &update_kind, "What the updates change: label, icon or tooltip (label)", "KIND" },
+	{ "protocol", 'p', 0, G_OPTION_ARG_INT, &protocol_version, "Protocol version the host sets, 0 doesn't set any", "N" },
+	{ "timeout", 't', 0, G_OPTION_ARG_INT, &timeout, "Seconds to wait for anything before giving up (60)", "N" },
+	{ "env", 'e', 0, G_OPTION_ARG_STRING_ARRAY, &extra_env, "Extra environment for the service, can be repeated", "NAME=VALUE" },
+	{ "output", 'o', 0, G_OPTION_ARG_FILENAME, &output, "Append the results to this file instead of printing them", "FILE" },
+	{ "service", 0, 0, G_OPTION_ARG_FILENAME, &service_path, "The service to run, to compare with another build (the one built here)", "PATH" },
+	{ "overrides", 0, 0, G_OPTION_ARG_INT, &override_count, "How many ordering overrides the user has, besides the items (1000)", "N" },
+	{ "recording", 0, 0, G_OPTION_ARG_FILENAME, &recording, "The recording the replay scenario plays", "FILE" },
+	{ "real-time", 0, 0, G_OPTION_ARG_NONE, &real_time, "Replay at the pace of the recording instead of as fast as possible", NULL },
+	{ NULL }
+};
+
+static GTestDBus * bus = NULL;
+static const gchar * bus_address = NULL;
+static gchar * home = NULL;
+
+static GPid service_pid = 0;
+static gboolean service_running = FALSE;
+static gboolean service_stopping = FALSE;
+static gint64 service_started_at = 0;
+static gint64 service_up_at = 0;
+static gboolean service_names[2] = { FALSE, FALSE };
+
+static GDBusConnection * host = NULL;
+static guint host_subscription = 0;
+static guint host_watches[2] = { 0, 0 };
+static guint64 host_messages = 0;
+
+static GDBusInterfaceInfo * item_info = NULL;
+static GPtrArray * connections = NULL;
+static GPtrArray * items = NULL;
+static GHashTable * items_by_id = NULL;
+static guint items_added = 0;
+static guint items_removed = 0;
+static guint items_moved = 0;
+static guint register_errors = 0;
+static GVariant * tooltip_pixmaps = NULL;
+
+static gboolean updating = FALSE;
+static const gchar * updating_kind = NULL;
+static GArray * update_latency = NULL;
+
+/* What went over the item connections, counted in the worker
+   thread of each */
+G_LOCK_DEFINE_STATIC(traffic);
+static guint64 item_messages = 0;
+static guint64 item_bytes = 0;
+static guint64 item_fetches = 0;
+
+/* What the service allocates, when it's counted */
+static MallocCounters * malloc_counters = NULL;
+
+static GString * json = NULL;
+static gboolean json_first = TRUE;
+
+/* JSON */
+
+static void
+json_key (const gchar * key)
+{
+	if (!json_first) {
+		g_string_append_c(json, ',');
+	}
+	json_first = FALSE;
+
+	if (key != NULL) {
+		g_string_append_printf(json, "\"%s\":", key);
+	}
+}
+
+static void
+json_begin (const gchar * key)
+{
+	json_key(key);
+	g_string_append_c(json, '{');
+	json_first = TRUE;
+}
+
+static void
+json_end (void)
+{
+	g_string_append_c(json, '}');
+	json_first = FALSE;
+}
+
+static void
+json_int (const gchar * key, gint64 value)
+{
+	json_key(key);
+	g_string_append_printf(json, "%" G_GINT64_FORMAT, value);
+}
+
+static void
+json_double (const gchar * key, gdouble value)
+{
+	gchar buffer[G_ASCII_DTOSTR_BUF_SIZE];
+
+	json_key(key);
+	g_string_append(json, g_ascii_formatd(buffer, sizeof(buffer), "%.3f", value));
+}
+
+static void
+json_bool (const gchar * key, gboolean value)
+{
+	json_key(key);
+	g_string_append(json, value ? "true" : "false");
+}
+
+/* Only our own names and values end up in here, but escape
+   them anyway */
+static void
+json_string (const gchar * key, const gchar * value)
+{
+	const gchar * c;
+
+	json_key(key);
+	g_string_append_c(json, '"');
+	for (c = value; *c != '\0'; c++) {
+		if (*c == '"' || *c == '\\') {
+			g_string_append_c(json, '\\');
+		}
+		if ((guchar)*c < 0x20) {
+			g_string_append_printf(json, "\\u%04x", (guint)*c);
+		} else {
+			g_string_append_c(json, *c);
+		}
+	}
+	g_string_append_c(json, '"');
+}
+
+static gint
+compare_int64 (gconstpointer a, gconstpointer b)
+{
+	gint64 first = *(const gint64 *)a;
+	gint64 second = *(const gint64 *)b;
+
+	return (first > second) - (first < second);
+}
+
+/* A summary of the samples, all in microseconds */
+static void
+json_samples (const gchar * key, GArray * samples)
+{
+	json_begin(key);
+	json_int("count", samples->len);
+
+	if (samples->len > 0) {
+		gint64 * values = (gint64 *)samples->data;
+		gint64 sum = 0;
+		guint i;
+
+		g_array_sort(samples, compare_int64);
+		for (i = 0; i < samples->len; i++) {
+			sum += values[i];
+		}
+
+		json_int("min", values[0]);
+		json_int("median", values[samples->len / 2]);
+		json_int("p95", values[MIN(samples->len - 1, samples->len * 95 / 100)]);
+		json_int("max", values[samples->len - 1]);
+		json_int("mean", sum / samples->len);
+	}
+
+	json_end();
+}
+
+/* The service process */
+
+/* CPU time of all the threads of a process, in microseconds.
+   Threads that are gone don't count, but the service keeps its
+   threads for as long as it runs. */
+static gint64
+process_cpu_usec (GPid pid)
+{
+	gchar * dirname = g_strdup_printf("/proc/%d/task", (int)pid);
+	GDir * dir = g_dir_open(dirname, 0, NULL);
+	const gchar * task;
+	gint64 total = 0;
+
+	if (dir == NULL) {
+		g_free(dirname);
+		return -1;
+	}
+
+	while ((task = g_dir_read_name(dir)) != NULL) {
+		gchar * filename = g_build_filename(dirname, task, "schedstat", NULL);
+		gchar * contents = NULL;
+
+		if (g_file_get_contents(filename, &contents, NULL, NULL)) {
+			total += g_ascii_strtoll(contents, NULL, 10) / 1000;
+		}
+
+		g_free(contents);
+		g_free(filename);
+	}
+
+	g_dir_close(dir);
+	g_free(dirname);
+
+	return total;
+}
+
+static gint64
+service_cpu_usec (void)
+{
+	return process_cpu_usec(service_pid);
+}
+
+/* How many sockets the service has open, one for each bus
+   connection it keeps */
+static gint64
+service_sockets (void)
+{
+	gchar * dirname = g_strdup_printf("/proc/%d/fd", (int)service_pid);
+	GDir * dir = g_dir_open(dirname, 0, NULL);
+	const gchar * fd;
+	gint64 count = 0;
+
+	if (dir == NULL) {
+		g_free(dirname);
+		return -1;
+	}
+
+	while ((fd = g_dir_read_name(dir)) != NULL) {
+		gchar * filename = g_build_filename(dirname, fd, NULL);
+		gchar * target = g_file_read_link(filename, NULL);
+
+		if (g_str_has_prefix(target != NULL ? target : "", "socket:")) {
+			count++;
+		}
+
+		g_free(target);
+		g_free(filename);
+	}
+
+	g_dir_close(dir);
+	g_free(dirname);
+
+	return count;
+}
+
+/* Whether the service has a library loaded, by part of its name */
+static gboolean
+service_maps (const gchar * library)
+{
+	gchar * filename = g_strdup_printf("/proc/%d/maps", (int)service_pid);
+	gchar * contents = NULL;
+	gboolean found = FALSE;
+
+	if (g_file_get_contents(filename, &contents, NULL, NULL)) {
+		found = (strstr(contents, library) != NULL);
+	}
+
+	g_free(contents);
+	g_free(filename);
+
+	return found;
+}
+
+/* A line of /proc/<pid>/status in KiB, like VmRSS */
+static gint64
+service_status_kib (const gchar * field)
+{
+	gchar * filename = g_strdup_printf("/proc/%d/status", (int)service_pid);
+	gchar * contents = NULL;
+	gint64 value = -1;
+
+	if (g_file_get_contents(filename, &contents, NULL, NULL)) {
+		gchar * line = strstr(contents, field);
+
+		if (line != NULL) {
+			value = g_ascii_strtoll(line + strlen(field) + 1, NULL, 10);
+		}
+	}
+
+	g_free(contents);
+	g_free(filename);
+
+	return value;
+}
+
+static void
+service_exited (GPid pid, gint status, gpointer user_data)
+{
+	if (!service_stopping) {
+		g_printerr("The service exited with status %d\n", status);
+	}
+
+	service_running = FALSE;
+	g_spawn_close_pid(pid);
+}
+
+static gboolean
+service_is_up (void)
+{
+	return service_names[0] && service_names[1];
+}
+
+/* The appstore puts its object on the bus once it has its own
+   connection, which can be after the names show up */
+static gboolean
+service_has_object (void)
+{
+	GVariant * reply = g_dbus_connection_call_sync(host,
+	                                               INDICATOR_APPLICATION_DBUS_ADDR,
+	                                               INDICATOR_APPLICATION_DBUS_OBJ,
+	                                               "org.freedesktop.DBus.Introspectable",
+	                                               "Introspect",
+	                                               NULL,
+	                                               G_VARIANT_TYPE("(s)"),
+	                                               G_DBUS_CALL_FLAGS_NONE,
+	                                               timeout * 1000,
+	                                               NULL,
+	                                               NULL);
+	gboolean found = FALSE;
+
+	if (reply != NULL) {
+		const gchar * xml = NULL;
+		g_variant_get(reply, "(&s)", &xml);
+		found = (strstr(xml, "\"" INDICATOR_APPLICATION_DBUS_IFACE "\"") != NULL);
+		g_variant_unref(reply);
+	}
+
+	return found;
+}
+
+static void
+service_name_appeared (GDBusConnection * connection, const gchar * name, const gchar * owner, gpointer user_data)
+{
+	service_names[GPOINTER_TO_UINT(user_data)] = TRUE;
+}
+
+static void
+service_name_vanished (GDBusConnection * connection, const gchar * name, gpointer user_data)
+{
+	service_names[GPOINTER_TO_UINT(user_data)] = FALSE;
+}
+
+/* Keeps the main loop waking up, so waiting notices the clock */
+static gboolean
+wait_tick (gpointer user_data)
+{
+	return G_SOURCE_CONTINUE;
+}
+
+/* Runs the main loop until the check passes, checking at least
+   every tick.  Gives up when the service is gone or it takes too
+   long. */
+static gboolean
+wait_ticking (gboolean (* check) (void), guint interval)
+{
+	gint64 deadline = g_get_monotonic_time() + (gint64)timeout * G_USEC_PER_SEC;
+	guint tick = g_timeout_add(interval, wait_tick, NULL);
+	gboolean done;
+
+	while (!(done = check()) && (service_running || service_stopping) && g_get_monotonic_time() < deadline) {
+		g_main_context_iteration(NULL, TRUE);
+	}
+
+	g_source_remove(tick);
+
+	return done;
+}
+
+static gboolean
+wait_for (gboolean (* check) (void))
+{
+	return wait_ticking(check, WAIT_TICK);
+}
+
+static gboolean
+service_is_gone (void)
+{
+	return !service_running;
+}
+
+static gboolean
+service_is_down (void)
+{
+	return !service_names[0] && !service_names[1];
+}
+
+/* Starts the service with our environment and the extra one */
+static gboolean
+start_service (const gchar * const * env)
+{
+	gchar * argv[] = { service_path, NULL };
+	gchar ** envp = g_get_environ();
+	GError * error = NULL;
+	guint i;
+
+	envp = g_environ_setenv(envp, "DBUS_SESSION_BUS_ADDRESS", bus_address, TRUE);
+	envp = g_environ_setenv(envp, "HOME", home, TRUE);
+	envp = g_environ_unsetenv(envp, "XDG_DATA_HOME");
+	envp = g_environ_unsetenv(envp, "XDG_CACHE_HOME");
+	envp = g_environ_unsetenv(envp, "XDG_CONFIG_HOME");
+
+	/* Updates are measured as they come, not as the rate limit
+	   lets them through */
+	envp = g_environ_setenv(envp, "AYATANA_INDICATOR_APPLICATION_RATE_LIMIT", "0", TRUE);
+
+	for (i = 0; env != NULL && env[i] != NULL; i++) {
+		gchar ** pair = g_strsplit(env[i], "=", 2);
+		if (pair[0] != NULL && pair[1] != NULL) {
+			envp = g_environ_setenv(envp, pair[0], pair[1], TRUE);
+		}
+		g_strfreev(pair);
+	}
+
+	for (i = 0; extra_env != NULL && extra_env[i] != NULL; i++) {
+		gchar ** pair = g_strsplit(extra_env[i], "=", 2);
+		if (pair[0] != NULL && pair[1] != NULL) {
+			envp = g_environ_setenv(envp, pair[0], pair[1], TRUE);
+		}
+		g_strfreev(pair);
+	}
+
+	service_stopping = FALSE;
+	service_up_at = 0;
+	service_started_at = g_get_monotonic_time();
+
+	if (!g_spawn_async(NULL, argv, envp, G_SPAWN_DO_NOT_REAP_CHILD, NULL, NULL, &service_pid, &error)) {
+		g_printerr("Unable to start '%s': %s\n", service_path, error->message);
+		g_error_free(error);
+		g_strfreev(envp);
+		return FALSE;
+	}
+
+	g_strfreev(envp);
+
+	service_running = TRUE;
+	g_child_watch_add(service_pid, service_exited, NULL);
+
+	if (!wait_for(service_is_up)) {
+		g_printerr("The service didn't show up on the bus\n");
+		return FALSE;
+	}
+
+	/* It's up once it owns both its names and answers there.
+	   Nothing tells when the object is there, so that's asked
+	   every millisecond rather than every tick. */
+	if (!wait_ticking(service_has_object, 1)) {
+		g_printerr("The service didn't put its object on the bus\n");
+		return FALSE;
+	}
+
+	service_up_at = g_get_monotonic_time();
+
+	return TRUE;
+}
+
+static void
+stop_service (void)
+{
+	if (!service_running) {
+		return;
+	}
+
+	/* The child watch is what reaps it */
+	service_stopping = TRUE;
+	kill(service_pid, SIGTERM);
+
+	if (!wait_for(service_is_gone)) {
+		kill(service_pid, SIGKILL);
+		wait_for(service_is_gone);
+	}
+
+	/* So that starting it again doesn't see the old names */
+	wait_for(service_is_down);
+
+	return;
+}
+
+/* Asks the service what it counted */
+static GVariant *
+service_statistics (void)
+{
+	GError * error = NULL;
+	GVariant * stats = g_dbus_connection_call_sync(host,
+	                                               INDICATOR_APPLICATION_DBUS_ADDR,
+	                                               INDICATOR_APPLICATION_DBUS_OBJ,
+	                                               INDICATOR_APPLICATION_STATS_DBUS_IFACE,
+	                                               "GetStatistics",
+	                                               NULL,
+	                                               G_VARIANT_TYPE("(a{st}a{s(atat)}a(ssa{st}))"),
+	                                               G_DBUS_CALL_FLAGS_NONE,
+	                                               timeout * 1000,
+	                                               NULL,
+	                                               &error);
+
+	if (error != NULL) {
+		g_printerr("Unable to get the statistics: %s\n", error->message);
+		g_error_free(error);
+		return NULL;
+	}
+
+	return stats;
+}
+
+/* One of the counters the service keeps, -1 if it doesn't
+   have it */
+static gint64
+service_counter (const gchar * name)
+{
+	GVariant * stats = service_statistics();
+	guint64 value;
+	gint64 result = -1;
+
+	if (stats == NULL) {
+		return -1;
+	}
+
+	GVariant * counters = g_variant_get_child_value(stats, 0);
+	if (g_variant_lookup(counters, name, "t", &value)) {
+		result = (gint64)value;
+	}
+
+	g_variant_unref(counters);
+	g_variant_unref(stats);
+
+	return result;
+}
+
+static void
+json_service (void)
+{
+	json_begin("service");
+	json_int("startup-usec", service_up_at - service_started_at);
+	json_int("cpu-usec", service_cpu_usec());
+	json_int("rss-kib", service_status_kib("VmRSS:"));
+	json_int("peak-rss-kib", service_status_kib("VmHWM:"));
+	json_end();
+
+	GVariant * stats = service_statistics();
+	if (stats == NULL) {
+		return;
+	}
+
+	GVariant * counters = g_variant_get_child_value(stats, 0);
+	GVariantIter iter;
+	const gchar * name;
+	guint64 value;
+
+	json_begin("counters");
+	g_variant_iter_init(&iter, counters);
+	while (g_variant_iter_next(&iter, "{&st}", &name, &value)) {
+		json_int(name, (gint64)value);
+	}
+	json_end();
+
+	g_variant_unref(counters);
+	g_variant_unref(stats);
+
+	return;
+}
+
+/* Items */
+
+/* The signals that have the service fetch properties again, and a
+   property for each that shows it did */
+static const gchar * refresh_signals[] = {
+	"NewIcon",
+	"NewAttentionIcon",
+	"NewTitle",
+	"NewToolTip"
+};
+
+static const gchar * refresh_properties[] = {
+	"IconName",
+	"AttentionIconName",
+	"Title",
+	"ToolTip"
+};
+
+#define REFRESH_READ_ALL ((1 << G_N_ELEMENTS(refresh_properties)) - 1)
+
+static GVariant *
+item_get_property (GDBusConnection * connection, const gchar * sender,
+                   const gchar * path, const gchar * interface,
+                   const gchar * property, GError ** error, gpointer user_data)
+{
+	Item * item = (Item *)user_data;
+	guint i;
+
+	for (i = 0; i < G_N_ELEMENTS(refresh_properties); i++) {
+		if (g_strcmp0(property, refresh_properties[i]) == 0) {
+			item->reads |= 1 << i;
+		}
+	}
+
+	if (g_strcmp0(property, "Id") == 0) {
+		return g_variant_new_string(item->id);
+	} else if (g_strcmp0(property, "Category") == 0) {
+		return g_variant_new_string("ApplicationStatus");
+	} else if (g_strcmp0(property, "Status") == 0) {
+		return g_variant_new_string(item->status);
+	} else if (g_strcmp0(property, "IconName") == 0) {
+		return g_variant_new_string(item->icon);
+	} else if (g_strcmp0(property, "IconAccessibleDesc") == 0) {
+		return g_variant_new_string(item->id);
+	} else if (g_strcmp0(property, "AttentionIconName") == 0) {
+		return g_variant_new_string("");
+	} else if (g_strcmp0(property, "AttentionAccessibleDesc") == 0) {
+		return g_variant_new_string("");
+	} else if (g_strcmp0(property, "Title") == 0) {
+		return g_variant_new_string(item->id);
+	} else if (g_strcmp0(property, "IconThemePath") == 0) {
+		return g_variant_new_string("");
+	} else if (g_strcmp0(property, "Menu") == 0) {
+		return g_variant_new_object_path(item->menu);
+	} else if (g_strcmp0(property, "XAyatanaLabel") == 0) {
+		return g_variant_new_string(item->label);
+	} else if (g_strcmp0(property, "XAyatanaLabelGuide") == 0) {
+		return g_variant_new_string("");
+	} else if (g_strcmp0(property, "XAyatanaOrderingIndex") == 0) {
+		return g_variant_new_uint32(0);
+	} else if (g_strcmp0(property, "ToolTip") == 0) {
+		return g_variant_new("(s@a(iiay)ss)", "", tooltip_pixmaps, item->tooltip, "");
+	}
+
+	g_set_error(error, G_DBUS_ERROR, G_DBUS_ERROR_UNKNOWN_PROPERTY, "No property '%s'", property);
+	return NULL;
+}
+
+static void
+item_method_call (GDBusConnection * connection, const gchar * sender,
+                  const gchar * path, const gchar * interface,
+                  const gchar * method, GVariant * params,
+                  GDBusMethodInvocation * invocation, gpointer user_data)
+{
+	g_dbus_method_invocation_return_value(invocation, NULL);
+}
+
+static GDBusInterfaceVTable item_table = {
+	method_call:    item_method_call,
+	get_property:   item_get_property,
+	set_property:   NULL
+};
+
+/* Counts everything going over an item connection, both ways, and
+   the property fetches the items get */
+static GDBusMessage *
+item_filter (GDBusConnection * connection, GDBusMessage * message, gboolean incoming, gpointer user_data)
+{
+	gsize size = 0;
+	guchar * blob = g_dbus_message_to_blob(message, &size, G_DBUS_CAPABILITY_FLAGS_NONE, NULL);
+	gboolean fetch = incoming &&
+	                 g_dbus_message_get_message_type(message) == G_DBUS_MESSAGE_TYPE_METHOD_CALL &&
+	                 g_strcmp0(g_dbus_message_get_interface(message), "org.freedesktop.DBus.Properties") == 0;
+
+	G_LOCK(traffic);
+	item_messages++;
+	item_bytes += size;
+	if (fetch) {
+		item_fetches++;
+	}
+	G_UNLOCK(traffic);
+
+	g_free(blob);
+
+	return message;
+}
+
+static void
+traffic_get (guint64 * messages, guint64 * bytes)
+{
+	G_LOCK(traffic);
+	*messages = item_messages;
+	*bytes = item_bytes;
+	G_UNLOCK(traffic);
+}
+
+static guint64
+fetches_get (void)
+{
+	guint64 fetches;
+
+	G_LOCK(traffic);
+	fetches = item_fetches;
+	G_UNLOCK(traffic);
+
+	return fetches;
+}
+
+static ItemConnection *
+connection_new (void)
+{
+	GError * error = NULL;
+	GDBusConnection * connection = g_dbus_connection_new_for_address_sync(bus_address,
+	                                                                      G_DBUS_CONNECTION_FLAGS_AUTHENTICATION_CLIENT |
+	                                                                      G_DBUS_CONNECTION_FLAGS_MESSAGE_BUS_CONNECTION,
+	                                                                      NULL, NULL, &error);
+
+	if (error != NULL) {
+		g_printerr("Unable to connect an item: %s\n", error->message);
+		g_error_free(error);
+		return NULL;
+	}
+
+	ItemConnection * item_connection = g_new0(ItemConnection, 1);
+	item_connection->connection = connection;
+	item_connection->filter = g_dbus_connection_add_filter(connection, item_filter, NULL, NULL);
+
+	return item_connection;
+}
+
+static void
+connection_free (gpointer data)
+{
+	ItemConnection * item_connection = (ItemConnection *)data;
+
+	g_dbus_connection_remove_filter(item_connection->connection, item_connection->filter);
+	g_dbus_connection_close_sync(item_connection->connection, NULL, NULL);
+	g_object_unref(item_connection->connection);
+	g_free(item_connection);
+}
+
+static Item *
+item_new (guint index, ItemConnection * owner)
+{
+	Item * item = g_new0(Item, 1);
+	GError * error = NULL;
+
+	item->index = index;
+	item->owner = owner;
+	item->id = g_strdup_printf("benchmark-item-%u", index);
+	item->path = g_strdup_printf("/org/ayatana/benchmark/item%u", index);
+	item->menu = g_strdup_printf("/org/ayatana/benchmark/item%u/menu", index);
+	item->status = "Active";
+	item->icon = g_strdup_printf(UPDATE_FORMAT, index, 0);
+	item->label = g_strdup_printf(UPDATE_FORMAT, index, 0);
+	item->tooltip = g_strdup_printf(UPDATE_FORMAT, index, 0);
+
+	item->registration = g_dbus_connection_register_object(owner->connection, item->path, item_info,
+	                                                       &item_table, item, NULL, &error);
+
+	if (error != NULL) {
+		g_printerr("Unable to export item %u: %s\n", index, error->message);
+		g_error_free(error);
+	}
+
+	return item;
+}
+
+static void
+item_free (gpointer data)
+{
+	Item * item = (Item *)data;
+
+	if (item->timer != 0) {
+		g_source_remove(item->timer);
+	}
+
+	if (item->registration != 0) {
+		g_dbus_connection_unregister_object(item->owner->connection, item->registration);
+	}
+
+	g_free(item->id);
+	g_free(item->path);
+	g_free(item->menu);
+	g_free(item->icon);
+	g_free(item->label);
+	g_free(item->tooltip);
+	g_free(item);
+}
+
+/* A tooltip pixmap, which makes a GetAll as big as a real one */
+static GVariant *
+build_tooltip_pixmaps (void)
+{
+	gsize size = TOOLTIP_PIXMAP_SIZE * TOOLTIP_PIXMAP_SIZE * 4;
+	guchar * pixels = g_malloc0(size);
+	GVariantBuilder builder;
+
+	g_variant_builder_init(&builder, G_VARIANT_TYPE("a(iiay)"));
+	g_variant_builder_add(&builder, "(ii@ay)", TOOLTIP_PIXMAP_SIZE, TOOLTIP_PIXMAP_SIZE,
+	                      g_variant_new_fixed_array(G_VARIANT_TYPE_BYTE, pixels, size, 1));
+	g_free(pixels);
+
+	return g_variant_ref_sink(g_variant_builder_end(&builder));
+}
+
+/* The connections and the items on them, spread evenly */
+static gboolean
+create_items (void)
+{
+	guint count = (connection_count > 0) ? (guint)connection_count : MIN((guint)item_count, MAX_CONNECTIONS);
+	guint i;
+
+	count = MAX(MIN(count, (guint)item_count), 1);
+
+	connections = g_ptr_array_new_with_free_func(connection_free);
+	items = g_ptr_array_new_with_free_func(item_free);
+	items_by_id = g_hash_table_new(g_str_hash, g_str_equal);
+
+	for (i = 0; i < count; i++) {
+		ItemConnection * item_connection = connection_new();
+
+		if (item_connection == NULL) {
+			return FALSE;
+		}
+
+		g_ptr_array_add(connections, item_connection);
+	}
+
+	for (i = 0; i < (guint)item_count; i++) {
+		Item * item = item_new(i, g_ptr_array_index(connections, i % count));
+
+		g_ptr_array_add(items, item);
+		g_hash_table_insert(items_by_id, item->id, item);
+	}
+
+	return TRUE;
+}
+
+static void
+item_registered (GObject * source, GAsyncResult * res, gpointer user_data)
+{
+	GError * error = NULL;
+	GVariant * reply = g_dbus_connection_call_finish(G_DBUS_CONNECTION(source), res, &error);
+
+	if (error != NULL) {
+		g_printerr("Unable to register an item: %s\n", error->message);
+		g_error_free(error);
+		register_errors++;
+		return;
+	}
+
+	g_variant_unref(reply);
+}
+
+static void
+register_item (Item * item)
+{
+	item->registered_at = g_get_monotonic_time();
+
+	g_dbus_connection_call(item->owner->connection,
+	                       NOTIFICATION_WATCHER_DBUS_ADDR,
+	                       NOTIFICATION_WATCHER_DBUS_OBJ,
+	                       NOTIFICATION_WATCHER_DBUS_IFACE,
+	                       "RegisterStatusNotifierItem",
+	                       g_variant_new("(s)", item->path),
+	                       NULL, G_DBUS_CALL_FLAGS_NONE, -1,
+	                       NULL, item_registered, NULL);
+}
+
+/* Changes the item and tells the service, the way an application
+   would for the kind of update we're sending */
+static void
+send_update (Item * item)
+{
+	const gchar * signal = NULL;
+	GVariant * params = NULL;
+	gchar * value;
+
+	item->sent++;
+	item->sent_at = g_get_monotonic_time();
+	value = g_strdup_printf(UPDATE_FORMAT, item->index, item->sent);
+
+	if (g_strcmp0(updating_kind, "icon") == 0) {
+		g_free(item->icon);
+		item->icon = value;
+		signal = "NewIcon";
+	} else if (g_strcmp0(updating_kind, "tooltip") == 0) {
+		g_free(item->tooltip);
+		item->tooltip = value;
+		signal = "NewToolTip";
+	} else {
+		g_free(item->label);
+		item->label = value;
+		signal = "XAyatanaNewLabel";
+		params = g_variant_new("(ss)", item->label, "");
+	}
+
+	g_dbus_connection_emit_signal(item->owner->connection, NULL, item->path,
+	                              NOTIFICATION_ITEM_DBUS_IFACE, signal, params, NULL);
+
+	return;
+}
+
+/* Shows or hides the item, which moves the positions of all the
+   items after it */
+static void
+send_status (Item * item, const gchar * status)
+{
+	item->status = status;
+
+	g_dbus_connection_emit_signal(item->owner->connection, NULL, item->path,
+	                              NOTIFICATION_ITEM_DBUS_IFACE, "NewStatus",
+	                              g_variant_new("(s)", status), NULL);
+}
+
+static gboolean
+send_update_timer (gpointer user_data)
+{
+	Item * item = (Item *)user_data;
+
+	if (item->sent >= item->goal) {
+		item->timer = 0;
+		return G_SOURCE_REMOVE;
+	}
+
+	send_update(item);
+
+	return G_SOURCE_CONTINUE;
+}
+
+/* The host */
+
+/* A value the host got, if it's from one of our updates it's the
+   end of that update's trip */
+static void
+host_saw_value (const gchar * value)
+{
+	guint index, update;
+
+	if (value == NULL || sscanf(value, UPDATE_FORMAT, &index, &update) != 2 || index >= items->len) {
+		return;
+	}
+
+	Item * item = g_ptr_array_index(items, index);
+
+	/* Merged updates only show the latest */
+	if (update != item->sent || update == item->seen || update == 0) {
+		return;
+	}
+
+	item->seen = update;
+
+	if (updating) {
+		gint64 latency = g_get_monotonic_time() - item->sent_at;
+		g_array_append_val(update_latency, latency);
+
+		if (update_rate == 0 && item->sent < item->goal) {
+			send_update(item);
+		}
+	}
+
+	return;
+}
+
+static void
+host_saw_item (const gchar * id)
+{
+	Item * item = g_hash_table_lookup(items_by_id, id);
+
+	if (item == NULL || item->added) {
+		return;
+	}
+
+	item->added = TRUE;
+	item->added_at = g_get_monotonic_time();
+	items_added++;
+}
+
+static void
+host_signal (GDBusConnection * connection, const gchar * sender,
+             const gchar * path, const gchar * interface,
+             const gchar * signal, GVariant * params, gpointer user_data)
+{
+	host_messages++;
+
+	if (items == NULL) {
+		return;
+	}
+
+	if (g_strcmp0(signal, "ApplicationAdded") == 0) {
+		const gchar * id = NULL;
+
+		g_variant_get_child(params, 8, "&s", &id);
+		host_saw_item(id);
+	} else if (g_strcmp0(signal, "ApplicationRemoved") == 0) {
+		items_removed++;
+	} else if (g_strcmp0(signal, "ApplicationMoved") == 0) {
+		items_moved++;
+	} else if (g_strcmp0(signal, "ApplicationIconChanged") == 0 ||
+	           g_strcmp0(signal, "ApplicationLabelChanged") == 0 ||
+	           g_strcmp0(signal, "ApplicationTooltipChanged") == 0) {
+		/* The label and the icon are right after the position,
+		   the tooltip title comes after its icon */
+		const gchar * value = NULL;
+
+		g_variant_get_child(params, g_strcmp0(signal, "ApplicationTooltipChanged") == 0 ? 2 : 1, "&s", &value);
+		host_saw_value(value);
+	} else if (g_strcmp0(signal, "ApplicationsChanged") == 0) {
+		GVariant * changes = g_variant_get_child_value(params, 1);
+		GVariantIter iter;
+		GVariant * values;
+
+		g_variant_iter_init(&iter, changes);
+		while (g_variant_iter_next(&iter, "(iu@a{sv})", NULL, NULL, &values)) {
+			const gchar * value = NULL;
+
+			if (g_variant_lookup(values, "icon", "&s", &value)) {
+				host_saw_value(value);
+			}
+			if (g_variant_lookup(values, "label", "&s", &value)) {
+				host_saw_value(value);
+			}
+			if (g_variant_lookup(values, "tooltip-title", "&s", &value)) {
+				host_saw_value(value);
+			}
+
+			g_variant_unref(values);
+		}
+
+		g_variant_unref(changes);
+	}
+
+	return;
+}
+
+static gboolean
+host_connect (void)
+{
+	GError * error = NULL;
+
+	host = g_dbus_connection_new_for_address_sync(bus_address,
+	                                              G_DBUS_CONNECTION_FLAGS_AUTHENTICATION_CLIENT |
+	                                              G_DBUS_CONNECTION_FLAGS_MESSAGE_BUS_CONNECTION,
+	                                              NULL, NULL, &error);
+
+	if (error != NULL) {
+		g_printerr("Unable to connect the host: %s\n", error->message);
+		g_error_free(error);
+		return FALSE;
+	}
+
+	host_subscription = g_dbus_connection_signal_subscribe(host,
+	                                                       INDICATOR_APPLICATION_DBUS_ADDR,
+	                                                       INDICATOR_APPLICATION_DBUS_IFACE,
+	                                                       NULL,
+	                                                       INDICATOR_APPLICATION_DBUS_OBJ,
+	                                                       NULL,
+	                                                       G_DBUS_SIGNAL_FLAGS_NONE,
+	                                                       host_signal,
+	                                                       NULL, NULL);
+
+	host_watches[0] = g_bus_watch_name_on_connection(host, INDICATOR_APPLICATION_DBUS_ADDR,
+	                                                 G_BUS_NAME_WATCHER_FLAGS_NONE,
+	                                                 service_name_appeared, service_name_vanished,
+	                                                 GUINT_TO_POINTER(0), NULL);
+	host_watches[1] = g_bus_watch_name_on_connection(host, NOTIFICATION_WATCHER_DBUS_ADDR,
+	                                                 G_BUS_NAME_WATCHER_FLAGS_NONE,
+	                                                 service_name_appeared, service_name_vanished,
+	                                                 GUINT_TO_POINTER(1), NULL);
+
+	return TRUE;
+}
+
+/* Tells the service which signals the host wants, like a panel
+   does once it sees the service */
+static gboolean
+host_set_protocol (void)
+{
+	if (protocol_version == 0) {
+		return TRUE;
+	}
+
+	GError * error = NULL;
+	GVariant * reply = g_dbus_connection_call_sync(host,
+	                                               INDICATOR_APPLICATION_DBUS_ADDR,
+	                                               INDICATOR_APPLICATION_DBUS_OBJ,
+	                                               INDICATOR_APPLICATION_DBUS_IFACE,
+	                                               "SetProtocolVersion",
+	                                               g_variant_new("(i)", protocol_version),
+	                                               G_VARIANT_TYPE("(i)"),
+	                                               G_DBUS_CALL_FLAGS_NONE,
+	                                               timeout * 1000,
+	                                               NULL,
+	                                               &error);
+
+	if (error != NULL) {
+		g_printerr("Unable to set the protocol version: %s\n", error->message);
+		g_error_free(error);
+		return FALSE;
+	}
+
+	g_variant_unref(reply);
+
+	return TRUE;
+}
+
+/* Subscribes the host to every other item, like a panel that only
+   shows some of them.  It keeps getting the broadcast signals the
+   scenarios wait on, the service has to work out its own list on
+   top of them. */
+static gboolean
+host_subscribe (void)
+{
+	GVariantBuilder allow;
+	GVariantBuilder options;
+	GError * error = NULL;
+	guint i;
+
+	g_variant_builder_init(&allow, G_VARIANT_TYPE("as"));
+	for (i = 0; i < items->len; i += 2) {
+		Item * item = g_ptr_array_index(items, i);
+		g_variant_builder_add(&allow, "s", item->id);
+	}
+
+	g_variant_builder_init(&options, G_VARIANT_TYPE("a{sv}"));
+	g_variant_builder_add(&options, "{sv}", "allow", g_variant_builder_end(&allow));
+
+	GVariant * reply = g_dbus_connection_call_sync(host,
+	                                               INDICATOR_APPLICATION_DBUS_ADDR,
+	                                               INDICATOR_APPLICATION_DBUS_OBJ,
+	                                               INDICATOR_APPLICATION_DBUS_IFACE,
+	                                               "Subscribe",
+	                                               g_variant_new("(a{sv})", &options),
+	                                               NULL,
+	                                               G_DBUS_CALL_FLAGS_NONE,
+	                                               timeout * 1000,
+	                                               NULL,
+	                                               &error);
+
+	if (error != NULL) {
+		g_printerr("Unable to subscribe: %s\n", error->message);
+		g_error_free(error);
+		return FALSE;
+	}
+
+	g_variant_unref(reply);
+
+	json_begin("subscription");
+	json_int("allowed", (items->len + 1) / 2);
+	json_end();
+
+	return TRUE;
+}
+
+static void
+host_disconnect (void)
+{
+	guint i;
+
+	for (i = 0; i < G_N_ELEMENTS(host_watches); i++) {
+		if (host_watches[i] != 0) {
+			g_bus_unwatch_name(host_watches[i]);
+			host_watches[i] = 0;
+		}
+	}
+
+	if (host_subscription != 0) {
+		g_dbus_connection_signal_unsubscribe(host, host_subscription);
+		host_subscription = 0;
+	}
+
+	g_dbus_connection_close_sync(host, NULL, NULL);
+	g_clear_object(&host);
+}
+
+/* Phases the scenarios are made of */
+
+static gboolean
+all_items_added (void)
+{
+	return items_added + register_errors >= items->len;
+}
+
+/* Registers all the items at once, like a session starting, and
+   waits for the host to see them */
+static gboolean
+run_registration (void)
+{
+	GArray * latency = g_array_new(FALSE, FALSE, sizeof(gint64));
+	gint64 started = g_get_monotonic_time();
+	gboolean done;
+	guint i;
+
+	for (i = 0; i < items->len; i++) {
+		register_item(g_ptr_array_index(items, i));
+	}
+
+	done = wait_for(all_items_added) && register_errors == 0;
+
+	json_begin("registration");
+	json_bool("complete", done);
+	json_int("total-usec", g_get_monotonic_time() - started);
+	json_int("errors", register_errors);
+
+	/* The latency is only known for the ones the host saw */
+	for (i = 0; i < items->len; i++) {
+		Item * item = g_ptr_array_index(items, i);
+		if (item->added) {
+			gint64 sample = item->added_at - item->registered_at;
+			g_array_append_val(latency, sample);
+		}
+	}
+
+	json_samples("latency-usec", latency);
+	json_end();
+
+	g_array_free(latency, TRUE);
+
+	return done;
+}
+
+static gboolean
+all_updates_seen (void)
+{
+	guint i;
+
+	for (i = 0; i < items->len; i++) {
+		Item * item = g_ptr_array_index(items, i);
+
+		if (item->sent < item->goal || item->seen != item->sent) {
+			return FALSE;
+		}
+	}
+
+	return TRUE;
+}
+
+/* Every item sends its updates, either one after the other as soon
+   as the host saw the last, or at the given rate.  The end to end
+   latency is from the item's signal to the host seeing the value,
+   the messages and bytes are those of the items and the host.  The
+   bytes include the replies of the items to the service fetching
+   what changed, and the calls it made for that are counted too. */
+static gboolean
+run_updates (const gchar * key, const gchar * kind)
+{
+	guint64 messages_before, bytes_before, messages_after, bytes_after;
+	guint64 host_before = host_messages;
+	gint64 get_before = service_counter("get-calls");
+	gint64 getall_before = service_counter("getall-calls");
+	gint64 cpu_before = service_cpu_usec();
+	gint64 started = g_get_monotonic_time();
+	guint64 sent = 0;
+	gboolean done;
+	guint i;
+
+	update_latency = g_array_new(FALSE, FALSE, sizeof(gint64));
+	traffic_get(&messages_before, &bytes_before);
+	updating_kind = kind;
+	updating = TRUE;
+
+	for (i = 0; i < items->len; i++) {
+		Item * item = g_ptr_array_index(items, i);
+
+		item->goal = item->sent + update_count;
+
+		if (update_rate > 0) {
+			item->timer = g_timeout_add(MAX(1000 / update_rate, 1), send_update_timer, item);
+		} else if (update_count > 0) {
+			send_update(item);
+		}
+	}
+
+	done = wait_for(all_updates_seen);
+	updating = FALSE;
+
+	gint64 elapsed = g_get_monotonic_time() - started;
+	gint64 cpu = service_cpu_usec() - cpu_before;
+	traffic_get(&messages_after, &bytes_after);
+
+	for (i = 0; i < items->len; i++) {
+		Item * item = g_ptr_array_index(items, i);
+		sent += item->sent - (item->goal - update_count);
+	}
+
+	json_begin(key);
+	json_bool("complete", done);
+	json_string("kind", kind);
+	json_int("sent", sent);
+	json_int("total-usec", elapsed);
+	json_samples("latency-usec", update_latency);
+	json_int("item-messages", messages_after - messages_before);
+	json_int("item-bytes", bytes_after - bytes_before);
+	json_int("host-messages", host_messages - host_before);
+	if (get_before >= 0) {
+		json_int("service-get-calls", service_counter("get-calls") - get_before);
+		json_int("service-getall-calls", service_counter("getall-calls") - getall_before);
+	}
+	json_int("service-cpu-usec", cpu);
+	if (sent > 0) {
+		json_double("messages-per-update", (gdouble)(messages_after - messages_before + host_messages - host_before) / sent);
+		json_double("item-bytes-per-update", (gdouble)(bytes_after - bytes_before) / sent);
+		json_double("service-cpu-usec-per-update", (gdouble)cpu / sent);
+	}
+	json_end();
+
+	g_array_free(update_latency, TRUE);
+	update_latency = NULL;
+
+	return done;
+}
+
+static guint removed_goal = 0;
+static Item * showing = NULL;
+
+static gboolean
+item_hidden (void)
+{
+	return items_removed >= removed_goal;
+}
+
+static gboolean
+item_shown (void)
+{
+	return showing->added;
+}
+
+/* Hides and shows the items one at a time, going round them, and
+   measures how long until the host sees them go and come back.
+   Each of those has the service work out the positions, so their
+   cost shows how that scales with the number of items. */
+static gboolean
+run_positions (void)
+{
+	GArray * hide_latency = g_array_new(FALSE, FALSE, sizeof(gint64));
+	GArray * show_latency = g_array_new(FALSE, FALSE, sizeof(gint64));
+	gint64 cpu_before = service_cpu_usec();
+	gint64 started = g_get_monotonic_time();
+	gboolean done = TRUE;
+	guint i;
+
+	for (i = 0; i < (guint)update_count && done; i++) {
+		Item * item = g_ptr_array_index(items, i % items->len);
+		gint64 sent_at = g_get_monotonic_time();
+		gint64 latency;
+
+		removed_goal = items_removed + 1;
+		send_status(item, "Passive");
+		done = wait_for(item_hidden);
+		latency = g_get_monotonic_time() - sent_at;
+		g_array_append_val(hide_latency, latency);
+
+		if (!done) {
+			break;
+		}
+
+		/* It's added again once the host sees it */
+		item->added = FALSE;
+		items_added--;
+		showing = item;
+
+		sent_at = g_get_monotonic_time();
+		send_status(item, "Active");
+		done = wait_for(item_shown);
+		latency = g_get_monotonic_time() - sent_at;
+		g_array_append_val(show_latency, latency);
+	}
+
+	gint64 cpu = service_cpu_usec() - cpu_before;
+
+	json_begin("positions");
+	json_bool("complete", done);
+	json_int("flips", i);
+	json_int("total-usec", g_get_monotonic_time() - started);
+	json_samples("hide-latency-usec", hide_latency);
+	json_samples("show-latency-usec", show_latency);
+	json_int("service-cpu-usec", cpu);
+	if (i > 0) {
+		json_double("service-cpu-usec-per-flip", (gdouble)cpu / i);
+	}
+	json_end();
+
+	g_array_free(hide_latency, TRUE);
+	g_array_free(show_latency, TRUE);
+
+	return done;
+}
+
+/* All the signals an item has, with what an unchanged item
+   would send with them */
+static const gchar * item_signals[] = {
+	"NewIcon",
+	"NewAttentionIcon",
+	"NewTitle",
+	"NewStatus",
+	"NewIconThemePath",
+	"XAyatanaNewLabel",
+	"NewToolTip"
+};
+
+static GVariant *
+item_signal_params (Item * item, const gchar * signal)
+{
+	if (g_strcmp0(signal, "NewStatus") == 0) {
+		return g_variant_new("(s)", item->status);
+	} else if (g_strcmp0(signal, "NewIconThemePath") == 0) {
+		return g_variant_new("(s)", "");
+	} else if (g_strcmp0(signal, "XAyatanaNewLabel") == 0) {
+		return g_variant_new("(ss)", item->label, "");
+	}
+
+	return NULL;
+}
+
+/* Every item sends --updates signals as fast as it can, going round
+   the given ones, and the service is timed until it got them all.
+   Nothing in them changes, so it's what receiving and dispatching
+   them costs, plus whatever the service fetches for them.  Each item
+   ends with a label update, which the service only gets to after the
+   signals before it, so the host seeing those is the end.  That
+   works with builds that don't count what they receive too. */
+static gboolean
+run_storm (const gchar * key, const gchar ** signals, guint signal_count)
+{
+	gint64 received_before = service_counter("signals-received");
+	gint64 throttled_before = service_counter("signals-throttled");
+	gint64 cpu_before = service_cpu_usec();
+	gint64 started = g_get_monotonic_time();
+	guint64 sent = 0;
+	gboolean done;
+	guint i, j;
+
+	for (j = 0; j < (guint)update_count; j++) {
+		for (i = 0; i < items->len; i++) {
+			Item * item = g_ptr_array_index(items, i);
+			const gchar * signal = signals[(i + j) % signal_count];
+
+			g_dbus_connection_emit_signal(item->owner->connection, NULL, item->path,
+			                              NOTIFICATION_ITEM_DBUS_IFACE, signal,
+			                              item_signal_params(item, signal), NULL);
+			sent++;
+		}
+	}
+
+	updating_kind = "label";
+	for (i = 0; i < items->len; i++) {
+		Item * item = g_ptr_array_index(items, i);
+
+		item->goal = item->sent + 1;
+		send_update(item);
+		sent++;
+	}
+
+	done = wait_for(all_updates_seen);
+
+	gint64 elapsed = g_get_monotonic_time() - started;
+	gint64 cpu = service_cpu_usec() - cpu_before;
+
+	json_begin(key);
+	json_bool("complete", done);
+	json_int("sent", sent);
+	if (received_before >= 0) {
+		json_int("received", service_counter("signals-received") - received_before);
+		json_int("throttled", service_counter("signals-throttled") - throttled_before);
+	}
+	json_int("total-usec", elapsed);
+	json_int("service-cpu-usec", cpu);
+	if (elapsed > 0) {
+		json_double("signals-per-second", (gdouble)sent * G_USEC_PER_SEC / elapsed);
+		json_double("service-cpu-usec-per-signal", (gdouble)cpu / sent);
+	}
+	json_end();
+
+	return done;
+}
+
+/* Writes the overrides of the user, with one for each item in the
+   order they were made and the first item where it's asked for */
+static gboolean
+write_overrides (guint first_item)
+{
+	GString * contents = g_string_new("[Ordering Index Overrides]\n");
+	GError * error = NULL;
+	guint i;
+
+	for (i = 0; i < (guint)override_count; i++) {
+		g_string_append_printf(contents, "benchmark-override-%u=%u\n", i, i + 1);
+	}
+
+	for (i = 0; i < (guint)item_count; i++) {
+		g_string_append_printf(contents, "benchmark-item-%u=%u\n", i, i == 0 ? first_item : ORDERING_FIRST + i);
+	}
+
+	gchar * dirname = g_build_filename(home, ".local", "share", "indicators", "application", NULL);
+	gchar * filename = g_build_filename(dirname, "ordering-override.keyfile", NULL);
+
+	g_mkdir_with_parents(dirname, 0700);
+	g_file_set_contents(filename, contents->str, contents->len, &error);
+
+	g_free(filename);
+	g_free(dirname);
+	g_string_free(contents, TRUE);
+
+	if (error != NULL) {
+		g_printerr("Unable to write the overrides: %s\n", error->message);
+		g_error_free(error);
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+/* Restarts the service a few times and takes how long it took to
+   get on the bus, which includes loading the overrides */
+static gboolean
+run_startups (const gchar * key, const gchar * const * env)
+{
+	GArray * startup = g_array_new(FALSE, FALSE, sizeof(gint64));
+	gboolean done = TRUE;
+	guint i;
+
+	for (i = 0; i < TIMED_RUNS && done; i++) {
+		stop_service();
+		done = start_service(env);
+
+		if (done) {
+			gint64 sample = service_up_at - service_started_at;
+			g_array_append_val(startup, sample);
+		}
+	}
+
+	json_begin(key);
+	json_bool("complete", done);
+	json_samples("startup-usec", startup);
+	json_int("rss-kib", service_status_kib("VmRSS:"));
+	json_int("sockets", service_sockets());
+	json_bool("dbus-glib", service_maps("libdbus-glib-1"));
+	json_bool("libdbus", service_maps("libdbus-1"));
+	json_end();
+
+	g_array_free(startup, TRUE);
+
+	return done;
+}
+
+static guint moved_goal = 0;
+
+static gboolean
+item_moved (void)
+{
+	return items_moved >= moved_goal;
+}
+
+/* Moves the first item to the end of the overrides and back, and
+   takes how long until the host sees it move.  That includes the
+   file monitor and the service waiting for the file to settle. */
+static gboolean
+run_reloads (void)
+{
+	GArray * latency = g_array_new(FALSE, FALSE, sizeof(gint64));
+	gint64 cpu_before = service_cpu_usec();
+	gboolean done = TRUE;
+	guint i;
+
+	for (i = 0; i < TIMED_RUNS && done; i++) {
+		gint64 written_at = g_get_monotonic_time();
+
+		moved_goal = items_moved + 1;
+		done = write_overrides(i % 2 == 0 ? ORDERING_LAST : ORDERING_FIRST) && wait_for(item_moved);
+
+		if (done) {
+			gint64 sample = g_get_monotonic_time() - written_at;
+			g_array_append_val(latency, sample);
+		}
+	}
+
+	json_begin("reloads");
+	json_bool("complete", done);
+	json_samples("latency-usec", latency);
+	json_int("service-cpu-usec", service_cpu_usec() - cpu_before);
+	json_end();
+
+	g_array_free(latency, TRUE);
+
+	return done;
+}
+
+/* Returns once the service handled what was sent to it before, as
+   the call is queued behind that */
+static gboolean
+service_sync (void)
+{
+	GError * error = NULL;
+	GVariant * reply = g_dbus_connection_call_sync(host, INDICATOR_APPLICATION_DBUS_ADDR,
+	                                               INDICATOR_APPLICATION_DBUS_OBJ,
+	                                               INDICATOR_APPLICATION_DBUS_IFACE,
+	                                               "GetApplications", NULL, NULL,
+	                                               G_DBUS_CALL_FLAGS_NONE, timeout * 1000,
+	                                               NULL, &error);
+
+	if (reply == NULL) {
+		g_printerr("Unable to get the applications: %s\n", error->message);
+		g_error_free(error);
+		return FALSE;
+	}
+
+	g_variant_unref(reply);
+
+	return TRUE;
+}
+
+/* Has the bus handle what the items sent so far, so that whatever
+   the service gets after this comes after that */
+static void
+items_sync (void)
+{
+	guint i;
+
+	for (i = 0; i < connections->len; i++) {
+		ItemConnection * connection = g_ptr_array_index(connections, i);
+		GVariant * reply = g_dbus_connection_call_sync(connection->connection, "org.freedesktop.DBus",
+		                                               "/org/freedesktop/DBus", "org.freedesktop.DBus",
+		                                               "GetId", NULL, NULL, G_DBUS_CALL_FLAGS_NONE,
+		                                               timeout * 1000, NULL, NULL);
+
+		if (reply != NULL) {
+			g_variant_unref(reply);
+		}
+	}
+}
+
+/* The bus daemon, which is the one that checks every message
+   against the match rules */
+static gint64
+bus_cpu_usec (void)
+{
+	guint32 pid = 0;
+	GVariant * reply = g_dbus_connection_call_sync(host, "org.freedesktop.DBus", "/org/freedesktop/DBus",
+	                                               "org.freedesktop.DBus", "GetConnectionUnixProcessID",
+	                                               g_variant_new("(s)", "org.freedesktop.DBus"),
+	                                               G_VARIANT_TYPE("(u)"), G_DBUS_CALL_FLAGS_NONE,
+	                                               timeout * 1000, NULL, NULL);
+
+	if (reply == NULL) {
+		return -1;
+	}
+
+	g_variant_get(reply, "(u)", &pid);
+	g_variant_unref(reply);
+
+	return process_cpu_usec((GPid)pid);
+}
+
+/* How many match rules the bus keeps for the service, each one has
+   the bus look at every message for it.  That comes from the
+   statistics of the bus, -1 when it doesn't keep those. */
+static gint64
+service_match_rules (void)
+{
+	GError * error = NULL;
+	gchar * owner = NULL;
+	gint64 count = -1;
+
+	GVariant * reply = g_dbus_connection_call_sync(host, "org.freedesktop.DBus", "/org/freedesktop/DBus",
+	                                               "org.freedesktop.DBus", "GetNameOwner",
+	                                               g_variant_new("(s)", INDICATOR_APPLICATION_DBUS_ADDR),
+	                                               G_VARIANT_TYPE("(s)"), G_DBUS_CALL_FLAGS_NONE,
+	                                               timeout * 1000, NULL, NULL);
+	if (reply == NULL) {
+		return -1;
+	}
+
+	g_variant_get(reply, "(s)", &owner);
+	g_variant_unref(reply);
+
+	reply = g_dbus_connection_call_sync(host, "org.freedesktop.DBus", "/org/freedesktop/DBus",
+	                                    "org.freedesktop.DBus.Debug.Stats", "GetAllMatchRules",
+	                                    NULL, G_VARIANT_TYPE("(a{sas})"), G_DBUS_CALL_FLAGS_NONE,
+	                                    timeout * 1000, NULL, &error);
+	if (reply == NULL) {
+		g_printerr("Unable to get the match rules from the bus: %s\n", error->message);
+		g_error_free(error);
+		g_free(owner);
+		return -1;
+	}
+
+	GVariant * all = g_variant_get_child_value(reply, 0);
+	GVariant * rules = g_variant_lookup_value(all, owner, G_VARIANT_TYPE_STRING_ARRAY);
+
+	count = rules != NULL ? (gint64)g_variant_n_children(rules) : 0;
+
+	if (rules != NULL) {
+		g_variant_unref(rules);
+	}
+	g_variant_unref(all);
+	g_variant_unref(reply);
+	g_free(owner);
+
+	return count;
+}
+
+static guint names_pending = 0;
+static guint names_failed = 0;
+
+static void
+name_call_done (GObject * object, GAsyncResult * res, gpointer user_data)
+{
+	GVariant * reply = g_dbus_connection_call_finish(G_DBUS_CONNECTION(object), res, NULL);
+
+	if (reply != NULL) {
+		g_variant_unref(reply);
+	} else {
+		names_failed++;
+	}
+
+	names_pending--;
+}
+
+static gboolean
+names_done (void)
+{
+	return names_pending == 0;
+}
+
+static void
+name_call (const gchar * method, GVariant * params)
+{
+	names_pending++;
+	g_dbus_connection_call(host, "org.freedesktop.DBus", "/org/freedesktop/DBus",
+	                       "org.freedesktop.DBus", method, params, NULL,
+	                       G_DBUS_CALL_FLAGS_NONE, timeout * 1000, NULL,
+	                       name_call_done, NULL);
+}
+
+/* First the names of other applications come and go, --updates of
+   them, which the service has no business with but may still get
+   woken up for.  Then all the items go at once, as when a session
+   ends, and the host is timed until it saw them all removed. */
+static gboolean
+run_names (void)
+{
+	gint64 rules = service_match_rules();
+	gint64 bus_before = bus_cpu_usec();
+	gint64 cpu_before = service_cpu_usec();
+	gint64 started = g_get_monotonic_time();
+	gboolean done;
+	guint i;
+
+	for (i = 0; i < (guint)update_count; i++) {
+		gchar * name = g_strdup_printf("org.ayatana.benchmark.Name%u", i);
+
+		/* Both of them have the bus send a NameOwnerChanged */
+		name_call("RequestName", g_variant_new("(su)", name, 0x4));
+		name_call("ReleaseName", g_variant_new("(s)", name));
+
+		g_free(name);
+	}
+
+	done = wait_for(names_done) && names_failed == 0 && service_sync();
+
+	gint64 elapsed = g_get_monotonic_time() - started;
+	gint64 cpu = service_cpu_usec() - cpu_before;
+	gint64 bus = bus_cpu_usec() - bus_before;
+	guint changes = update_count * 2;
+
+	json_begin("names");
+	json_bool("complete", done);
+	json_int("match-rules", rules);
+	json_int("owner-changes", changes);
+	json_int("total-usec", elapsed);
+	json_int("service-cpu-usec", cpu);
+	if (bus_before >= 0) {
+		json_int("bus-cpu-usec", bus);
+	}
+	if (changes > 0) {
+		json_double("service-cpu-usec-per-change", (gdouble)cpu / changes);
+		if (bus_before >= 0) {
+			json_double("bus-cpu-usec-per-change", (gdouble)bus / changes);
+		}
+	}
+	json_end();
+
+	if (!done) {
+		return FALSE;
+	}
+
+	removed_goal = items_removed + items->len;
+	cpu_before = service_cpu_usec();
+	started = g_get_monotonic_time();
+
+	for (i = 0; i < connections->len; i++) {
+		ItemConnection * connection = g_ptr_array_index(connections, i);
+		g_dbus_connection_close_sync(connection->connection, NULL, NULL);
+	}
+
+	done = wait_for(item_hidden);
+
+	json_begin("vanished");
+	json_bool("complete", done);
+	json_int("items", items->len);
+	json_int("total-usec", g_get_monotonic_time() - started);
+	json_int("service-cpu-usec", service_cpu_usec() - cpu_before);
+	json_end();
+
+	return done;
+}
+
+/* Maps the counters the service keeps, before it starts */
+static gboolean
+malloc_counters_map (const gchar * filename)
+{
+	int fd = open(filename, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+	void * map = MAP_FAILED;
+
+	if (fd >= 0) {
+		if (ftruncate(fd, sizeof(MallocCounters)) == 0) {
+			map = mmap(NULL, sizeof(MallocCounters), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+		}
+		close(fd);
+	}
+
+	if (map == MAP_FAILED) {
+		g_printerr("Unable to map the allocation counters in '%s'\n", filename);
+		return FALSE;
+	}
+
+	malloc_counters = (MallocCounters *)map;
+	memset(malloc_counters, 0, sizeof(MallocCounters));
+
+	return TRUE;
+}
+
+static void
+malloc_counters_get (MallocCounters * counters)
+{
+	counters->allocations = __atomic_load_n(&malloc_counters->allocations, __ATOMIC_RELAXED);
+	counters->frees = __atomic_load_n(&malloc_counters->frees, __ATOMIC_RELAXED);
+	counters->allocated_bytes = __atomic_load_n(&malloc_counters->allocated_bytes, __ATOMIC_RELAXED);
+	counters->live_bytes = __atomic_load_n(&malloc_counters->live_bytes, __ATOMIC_RELAXED);
+}
+
+static gboolean
+all_items_read (void)
+{
+	guint i;
+
+	for (i = 0; i < items->len; i++) {
+		Item * item = g_ptr_array_index(items, i);
+
+		if (item->reads != REFRESH_READ_ALL) {
+			return FALSE;
+		}
+	}
+
+	return TRUE;
+}
+
+/* What registering the items left allocated in the service, then
+   --updates rounds of every item sending the signals that have the
+   service fetch its icons, title and tooltip again, each round
+   waiting until they all were.  Nothing in them changes, so what
+   the service allocates for them is what a refresh costs. */
+static gboolean
+run_refresh (void)
+{
+	MallocCounters before, registered, after;
+	gboolean done = TRUE;
+	guint round, i, j;
+
+	malloc_counters_get(&before);
+
+	if (!run_registration() || !service_sync()) {
+		return FALSE;
+	}
+
+	malloc_counters_get(&registered);
+
+	json_begin("memory");
+	json_int("allocations", registered.allocations - before.allocations);
+	json_int("live-bytes", registered.live_bytes - before.live_bytes);
+	json_double("allocations-per-item", (gdouble)(registered.allocations - before.allocations) / items->len);
+	json_double("live-bytes-per-item", (gdouble)(registered.live_bytes - before.live_bytes) / items->len);
+	json_end();
+
+	guint64 fetches_before = fetches_get();
+	gint64 cpu_before = service_cpu_usec();
+	gint64 started = g_get_monotonic_time();
+
+	for (round = 0; round < (guint)update_count && done; round++) {
+		for (i = 0; i < items->len; i++) {
+			Item * item = g_ptr_array_index(items, i);
+
+			item->reads = 0;
+			for (j = 0; j < G_N_ELEMENTS(refresh_signals); j++) {
+				g_dbus_connection_emit_signal(item->owner->connection, NULL, item->path,
+				                              NOTIFICATION_ITEM_DBUS_IFACE, refresh_signals[j],
+				                              NULL, NULL);
+			}
+		}
+
+		done = wait_for(all_items_read);
+	}
+
+	/* Whatever the replies had the service do is done once it
+	   answers the host after them */
+	items_sync();
+	done = service_sync() && done;
+
+	gint64 elapsed = g_get_monotonic_time() - started;
+	gint64 cpu = service_cpu_usec() - cpu_before;
+	guint64 fetches = fetches_get() - fetches_before;
+	guint refreshes = round * items->len;
+
+	malloc_counters_get(&after);
+
+	json_begin("refresh");
+	json_bool("complete", done);
+	json_int("refreshes", refreshes);
+	json_int("fetches", fetches);
+	json_int("total-usec", elapsed);
+	json_int("service-cpu-usec", cpu);
+	json_int("allocations", after.allocations - registered.allocations);
+	json_int("allocated-bytes", after.allocated_bytes - registered.allocated_bytes);
+	json_int("live-bytes", after.live_bytes - registered.live_bytes);
+	if (refreshes > 0) {
+		json_double("allocations-per-refresh", (gdouble)(after.allocations - registered.allocations) / refreshes);
+		json_double("allocated-bytes-per-refresh", (gdouble)(after.allocated_bytes - registered.allocated_bytes) / refreshes);
+		json_double("fetches-per-refresh", (gdouble)fetches / refreshes);
+		json_double("service-cpu-usec-per-refresh", (gdouble)cpu / refreshes);
+	}
+	json_end();
+
+	return done;
+}
+
+static GPid replay_pid = 0;
+static gboolean replay_running = FALSE;
+static gint replay_status = 0;
+
+static void
+replay_exited (GPid pid, gint status, gpointer user_data)
+{
+	replay_running = FALSE;
+	replay_status = status;
+	g_spawn_close_pid(pid);
+}
+
+static gboolean
+replay_done (void)
+{
+	return !replay_running;
+}
+
+/* Plays a recording from a real session against the service, with
+   the replay tool, and takes what it cost the service.  The time
+   includes the second the tool waits at the end for the last
+   replies. */
+static gboolean
+run_replay (void)
+{
+	GPtrArray * argv = g_ptr_array_new();
+	gchar ** envp = g_environ_setenv(g_get_environ(), "DBUS_SESSION_BUS_ADDRESS", bus_address, TRUE);
+	gint64 received_before = service_counter("signals-received");
+	gint64 sent_before = service_counter("updates-sent");
+	guint64 host_before = host_messages;
+	gint64 cpu_before = service_cpu_usec();
+	gint64 started = g_get_monotonic_time();
+	GError * error = NULL;
+	gboolean done;
+
+	g_ptr_array_add(argv, REPLAY_PATH);
+	if (!real_time) {
+		g_ptr_array_add(argv, "--fast");
+	}
+	g_ptr_array_add(argv, recording);
+	g_ptr_array_add(argv, NULL);
+
+	if (!g_spawn_async(NULL, (gchar **)argv->pdata, envp, G_SPAWN_DO_NOT_REAP_CHILD | G_SPAWN_STDOUT_TO_DEV_NULL,
+	                   NULL, NULL, &replay_pid, &error)) {
+		g_printerr("Unable to start '%s': %s\n", REPLAY_PATH, error->message);
+		g_error_free(error);
+		g_ptr_array_unref(argv);
+		g_strfreev(envp);
+		return FALSE;
+	}
+
+	g_ptr_array_unref(argv);
+	g_strfreev(envp);
+
+	replay_running = TRUE;
+	g_child_watch_add(replay_pid, replay_exited, NULL);
+
+	done = wait_for(replay_done);
+	if (!done) {
+		kill(replay_pid, SIGKILL);
+	} else {
+		done = WIFEXITED(replay_status) && WEXITSTATUS(replay_status) == 0;
+	}
+
+	gint64 elapsed = g_get_monotonic_time() - started;
+	gint64 cpu = service_cpu_usec() - cpu_before;
+
+	json_begin("replay");
+	json_bool("complete", done);
+	json_string("recording", recording);
+	json_bool("fast", !real_time);
+	json_int("total-usec", elapsed);
+	json_int("host-messages", host_messages - host_before);
+	if (received_before >= 0) {
+		json_int("signals-received", service_counter("signals-received") - received_before);
+		json_int("updates-sent", service_counter("updates-sent") - sent_before);
+	}
+	json_int("service-cpu-usec", cpu);
+	json_int("peak-rss-kib", service_status_kib("VmHWM:"));
+	json_end();
+
+	return done;
+}
+
+/* Scenarios */
+
+static gboolean
+scenario_registration (void)
+{
+	return run_registration();
+}
+
+static gboolean
+scenario_updates (void)
+{
+	return run_registration() && run_updates("updates", update_kind);
+}
+
+/* The reply to the GetAll below */
+static GDBusMessage * getall_reply = NULL;
+static GError * getall_error = NULL;
+
+static void
+getall_replied (GObject * object, GAsyncResult * res, gpointer user_data)
+{
+	getall_reply = g_dbus_connection_send_message_with_reply_finish(G_DBUS_CONNECTION(object), res, &getall_error);
+}
+
+static gboolean
+getall_done (void)
+{
+	return getall_reply != NULL || getall_error != NULL;
+}
+
+/* What a GetAll of an item costs on the bus, the reply holds all
+   the properties and the tooltip pixmap.  The item answers from
+   this main loop, so the call can't block it. */
+static gint64
+getall_bytes (Item * item)
+{
+	GDBusMessage * call = g_dbus_message_new_method_call(g_dbus_connection_get_unique_name(item->owner->connection),
+	                                                     item->path,
+	                                                     "org.freedesktop.DBus.Properties",
+	                                                     "GetAll");
+	g_dbus_message_set_body(call, g_variant_new("(s)", NOTIFICATION_ITEM_DBUS_IFACE));
+
+	g_dbus_connection_send_message_with_reply(host, call,
+	                                          G_DBUS_SEND_MESSAGE_FLAGS_NONE,
+	                                          timeout * 1000,
+	                                          NULL, NULL,
+	                                          getall_replied, NULL);
+	g_object_unref(call);
+
+	wait_for(getall_done);
+
+	if (getall_reply != NULL && g_dbus_message_to_gerror(getall_reply, &getall_error)) {
+		g_clear_object(&getall_reply);
+	}
+
+	if (getall_reply == NULL) {
+		g_printerr("Unable to get the properties of an item: %s\n", getall_error != NULL ? getall_error->message : "no reply");
+		g_clear_error(&getall_error);
+		return -1;
+	}
+
+	gsize size = 0;
+	guchar * blob = g_dbus_message_to_blob(getall_reply, &size, G_DBUS_CAPABILITY_FLAGS_NONE, NULL);
+
+	g_free(blob);
+	g_clear_object(&getall_reply);
+
+	return (gint64)size;
+}
+
+/* Icon and tooltip updates, each only needs a property or two
+   fetched, compared with what fetching all of them costs */
+static gboolean
+scenario_fetch (void)
+{
+	if (!run_registration()) {
+		return FALSE;
+	}
+
+	json_int("getall-bytes", getall_bytes(g_ptr_array_index(items, 0)));
+
+	return run_updates("icon-updates", "icon") && run_updates("tooltip-updates", "tooltip");
+}
+
+static gboolean
+scenario_positions (void)
+{
+	return run_registration() && run_positions();
+}
+
+/* The same with the host subscribed to half the items */
+static gboolean
+scenario_subscribed (void)
+{
+	return run_registration() && host_subscribe() && run_positions();
+}
+
+/* All the kinds of signals at once, as a busy session sends them */
+static gboolean
+scenario_signals (void)
+{
+	return run_registration() && run_storm("signals", item_signals, G_N_ELEMENTS(item_signals));
+}
+
+/* Only NewStatus, with the status the item already has, which
+   comes down to looking the status up */
+static gboolean
+scenario_status (void)
+{
+	static const gchar * status_signals[] = { "NewStatus" };
+
+	return run_registration() && run_storm("status", status_signals, G_N_ELEMENTS(status_signals));
+}
+
+/* Startup with the overrides read from the keyfiles and from the
+   cache, then how long editing them takes to show */
+static gboolean
+scenario_overrides (void)
+{
+	static const gchar * cache_env[] = { "AYATANA_INDICATOR_APPLICATION_OVERRIDE_CACHE=1", NULL };
+
+	if (items->len < 2) {
+		g_printerr("Moving an item needs at least two of them\n");
+		return FALSE;
+	}
+
+	json_int("overrides", override_count + item_count);
+
+	if (!write_overrides(ORDERING_FIRST) || !run_startups("keyfiles", NULL)) {
+		return FALSE;
+	}
+
+	/* The first start writes the cache, the others read it */
+	stop_service();
+	if (!start_service(cache_env) || !run_startups("cache", cache_env)) {
+		return FALSE;
+	}
+
+	return host_set_protocol() && run_registration() && run_reloads();
+}
+
+static gboolean
+scenario_names (void)
+{
+	return run_registration() && run_names();
+}
+
+/* The service is started again with its allocations counted from
+   the start */
+static gboolean
+scenario_refresh (void)
+{
+	gchar * filename = g_build_filename(home, "malloc-counters", NULL);
+	gchar * preload = g_strdup_printf("LD_PRELOAD=%s", MALLOC_COUNTERS_PATH);
+	gchar * counters = g_strdup_printf(MALLOC_COUNTERS_ENV "=%s", filename);
+	const gchar * env[] = { preload, counters, NULL };
+	gboolean done;
+
+	stop_service();
+	done = malloc_counters_map(filename) && start_service(env) && host_set_protocol() && run_refresh();
+
+	g_free(counters);
+	g_free(preload);
+	g_free(filename);
+
+	return done;
+}
+
+/* A recording of a real session, such as a storm that stalled the
+   panel, played back as a repeatable workload */
+static gboolean
+scenario_replay (void)
+{
+	if (recording == NULL) {
+		g_printerr("Which recording should be played?  Give it with --recording\n");
+		return FALSE;
+	}
+
+	return run_replay();
+}
+
+/* What the service costs a session before any item shows up, and
+   again once they did: its startup time, memory, bus connections
+   and the D-Bus libraries it has loaded */
+static gboolean
+scenario_startup (void)
+{
+	if (!run_startups("startup", NULL) || !host_set_protocol() || !run_registration()) {
+		return FALSE;
+	}
+
+	json_begin("registered");
+	json_int("rss-kib", service_status_kib("VmRSS:"));
+	json_int("peak-rss-kib", service_status_kib("VmHWM:"));
+	json_int("sockets", service_sockets());
+	json_end();
+
+	return TRUE;
+}
+
+static const Scenario scenarios[] = {
+	{ "startup",      "Times starting the service and takes its memory, connections and libraries", scenario_startup },
+	{ "registration", "Registers the items and measures how long until the host sees them", scenario_registration },
+	{ "updates",      "Registers the items, then measures how their updates get to the host", scenario_updates },
+	{ "positions",    "Registers the items, then hides and shows them, --updates times in all", scenario_positions },
+	{ "subscribed",   "The same as positions, with the host subscribed to every other item", scenario_subscribed },
+	{ "fetch",        "Registers the items, then compares icon and tooltip updates with a GetAll", scenario_fetch },
+	{ "signals",      "Registers the items, then times a storm of all their signals", scenario_signals },
+	{ "status",       "Registers the items, then times a storm of unchanged NewStatus", scenario_status },
+	{ "overrides",    "Times startup with and without the override cache, then reloading them", scenario_overrides },
+	{ "names",        "Registers the items, then times unrelated names coming and going and the items vanishing", scenario_names },
+	{ "refresh",      "Registers the items, then counts what the service allocates to refresh them", scenario_refresh },
+	{ "replay",       "Plays the --recording against the service and takes what it cost", scenario_replay }
+};
+
+static const Scenario *
+find_scenario (const gchar * name)
+{
+	guint i;
+
+	for (i = 0; i < G_N_ELEMENTS(scenarios); i++) {
+		if (g_strcmp0(scenarios[i].name, name) == 0) {
+			return &scenarios[i];
+		}
+	}
+
+	return NULL;
+}
+
+static gboolean list = FALSE;
+
+static GOptionEntry list_options[] = {
+	{ "list", 'l', 0, G_OPTION_ARG_NONE, &list, "List the scenarios", NULL },
+	{ NULL }
+};
+
+/* Removes the temporary home with what the service left in it */
+static void
+remove_tree (const gchar * path)
+{
+	GDir * dir = g_dir_open(path, 0, NULL);
+
+	if (dir != NULL) {
+		const gchar * name;
+
+		while ((name = g_dir_read_name(dir)) != NULL) {
+			gchar * child = g_build_filename(path, name, NULL);
+			remove_tree(child);
+			g_free(child);
+		}
+
+		g_dir_close(dir);
+	}
+
+	g_remove(path);
+}
+
+static void
+write_results (void)
+{
+	g_string_append_c(json, '\n');
+
+	if (output == NULL) {
+		fputs(json->str, stdout);
+		fflush(stdout);
+		return;
+	}
+
+	FILE * file = g_fopen(output, "a");
+	if (file == NULL) {
+		g_printerr("Unable to write to '%s'\n", output);
+		fputs(json->str, stdout);
+		return;
+	}
+
+	fputs(json->str, file);
+	fclose(file);
+}
+
+int
+main (int argc, char ** argv)
+{
+	GError * error = NULL;
+	GOptionContext * context = g_option_context_new("- benchmark the application service on a private bus");
+	gboolean ok = FALSE;
+	guint i;
+
+	g_option_context_add_main_entries(context, options, NULL);
+	g_option_context_add_main_entries(context, list_options, NULL);
+
+	if (!g_option_context_parse(context, &argc, &argv, &error)) {
+		g_printerr("%s\n", error->message);
+		g_error_free(error);
+		g_option_context_free(context);
+		return 1;
+	}
+
+	g_option_context_free(context);
+
+	if (list) {
+		for (i = 0; i < G_N_ELEMENTS(scenarios); i++) {
+			g_print("%-14s %s\n", scenarios[i].name, scenarios[i].description);
+		}
+		return 0;
+	}
+
+	const Scenario * scenario = find_scenario(scenario_name != NULL ? scenario_name : "updates");
+	if (scenario == NULL) {
+		g_printerr("There's no scenario '%s', see --list\n", scenario_name);
+		return 1;
+	}
+
+	if (update_kind == NULL) {
+		update_kind = g_strdup("label");
+	}
+
+	if (service_path == NULL) {
+		service_path = g_strdup(SERVICE_PATH);
+	}
+
+	if (item_count < 1 || update_count < 0 || update_rate < 0 || timeout < 1) {
+		g_printerr("The counts, the rate and the timeout can't be negative\n");
+		return 1;
+	}
+
+	/* The service gets a home of its own, so that no overrides or
+	   caches of the user get in the way */
+	home = g_dir_make_tmp("ayatana-indicator-application-benchmark-XXXXXX", &error);
+	if (home == NULL) {
+		g_printerr("Unable to make a home for the service: %s\n", error->message);
+		g_error_free(error);
+		return 1;
+	}
+
+	GDBusNodeInfo * node = g_dbus_node_info_new_for_xml(item_xml, NULL);
+	item_info = g_dbus_interface_info_ref(node->interfaces[0]);
+	g_dbus_node_info_unref(node);
+	tooltip_pixmaps = build_tooltip_pixmaps();
+
+	bus = g_test_dbus_new(G_TEST_DBUS_NONE);
+	g_test_dbus_up(bus);
+	bus_address = g_test_dbus_get_bus_address(bus);
+
+	json = g_string_new(NULL);
+	json_begin(NULL);
+	json_string("scenario", scenario->name);
+	json_int("time", g_get_real_time() / G_USEC_PER_SEC);
+	json_int("items", item_count);
+	json_int("updates-per-item", update_count);
+	json_int("rate", update_rate);
+	json_int("protocol", protocol_version);
+
+	if (host_connect() && start_service(NULL) && host_set_protocol() && create_items()) {
+		json_int("connections", connections->len);
+		ok = scenario->run();
+		json_service();
+	}
+
+	json_bool("ok", ok);
+	json_end();
+	write_results();
+
+	stop_service();
+
+	if (items != NULL) {
+		g_hash_table_destroy(items_by_id);
+		g_ptr_array_unref(items);
+		g_ptr_array_unref(connections);
+	}
+
+	if (host != NULL) {
+		host_disconnect();
+	}
+
+	g_test_dbus_down(bus);
+	g_object_unref(bus);
+
+	remove_tree(home);
+	g_free(home);
+
+	g_variant_unref(tooltip_pixmaps);
+	g_dbus_interface_info_unref(item_info);
+	g_string_free(json, TRUE);
+
+	return ok ? 0 : 1;
+}
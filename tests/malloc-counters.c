@@ -0,0 +1,157 @@
+/*
+Counts the allocations of the process it's preloaded into, so the
+benchmark can tell what the service allocates.  It wraps the glibc
+allocator and keeps the counters in the file named by
+AYATANA_INDICATOR_APPLICATION_MALLOC_COUNTERS, mapped shared.
+
+This program is free software: you can redistribute it and/or modify it
+under the terms of the GNU General Public License version 3, as published
+by the Free Software Foundation.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranties of
+MERCHANTABILITY, SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR
+PURPOSE.  See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <errno.h>
+#include <fcntl.h>
+#include <malloc.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include "malloc-counters.h"
+
+extern void * __libc_malloc (size_t size);
+extern void * __libc_calloc (size_t count, size_t size);
+extern void * __libc_realloc (void * ptr, size_t size);
+extern void * __libc_memalign (size_t alignment, size_t size);
+extern void __libc_free (void * ptr);
+
+/* Nothing is counted until the file is mapped */
+static MallocCounters * counters = NULL;
+
+__attribute__((constructor))
+static void
+counters_init (void)
+{
+	const char * filename = getenv(MALLOC_COUNTERS_ENV);
+
+	if (filename == NULL) {
+		return;
+	}
+
+	int fd = open(filename, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+	if (fd < 0) {
+		return;
+	}
+
+	if (ftruncate(fd, sizeof(MallocCounters)) == 0) {
+		void * map = mmap(NULL, sizeof(MallocCounters), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+		if (map != MAP_FAILED) {
+			counters = (MallocCounters *)map;
+		}
+	}
+
+	close(fd);
+}
+
+static void *
+count_allocation (void * ptr)
+{
+	if (ptr != NULL && counters != NULL) {
+		size_t size = malloc_usable_size(ptr);
+
+		__atomic_add_fetch(&counters->allocations, 1, __ATOMIC_RELAXED);
+		__atomic_add_fetch(&counters->allocated_bytes, size, __ATOMIC_RELAXED);
+		__atomic_add_fetch(&counters->live_bytes, (long)size, __ATOMIC_RELAXED);
+	}
+
+	return ptr;
+}
+
+static void
+count_free (void * ptr)
+{
+	if (ptr != NULL && counters != NULL) {
+		__atomic_add_fetch(&counters->frees, 1, __ATOMIC_RELAXED);
+		__atomic_sub_fetch(&counters->live_bytes, (long)malloc_usable_size(ptr), __ATOMIC_RELAXED);
+	}
+}
+
+void *
+malloc (size_t size)
+{
+	return count_allocation(__libc_malloc(size));
+}
+
+void *
+calloc (size_t count, size_t size)
+{
+	return count_allocation(__libc_calloc(count, size));
+}
+
+/* Counted as a free of the old block and an allocation of the new
+   one, even when it stays in place */
+void *
+realloc (void * ptr, size_t size)
+{
+	if (ptr != NULL && counters != NULL) {
+		__atomic_sub_fetch(&counters->live_bytes, (long)malloc_usable_size(ptr), __ATOMIC_RELAXED);
+		__atomic_add_fetch(&counters->frees, 1, __ATOMIC_RELAXED);
+	}
+
+	void * result = __libc_realloc(ptr, size);
+
+	if (result == NULL && ptr != NULL && size != 0 && counters != NULL) {
+		/* It failed and the old block is still there */
+		__atomic_add_fetch(&counters->live_bytes, (long)malloc_usable_size(ptr), __ATOMIC_RELAXED);
+		__atomic_sub_fetch(&counters->frees, 1, __ATOMIC_RELAXED);
+		return NULL;
+	}
+
+	return count_allocation(result);
+}
+
+void *
+memalign (size_t alignment, size_t size)
+{
+	return count_allocation(__libc_memalign(alignment, size));
+}
+
+void *
+aligned_alloc (size_t alignment, size_t size)
+{
+	return count_allocation(__libc_memalign(alignment, size));
+}
+
+int
+posix_memalign (void ** ptr, size_t alignment, size_t size)
+{
+	if (alignment % sizeof(void *) != 0 || (alignment & (alignment - 1)) != 0) {
+		return EINVAL;
+	}
+
+	void * result = __libc_memalign(alignment, size);
+	if (result == NULL) {
+		return ENOMEM;
+	}
+
+	*ptr = count_allocation(result);
+
+	return 0;
+}
+
+void
+free (void * ptr)
+{
+	count_free(ptr);
+	__libc_free(ptr);
+}
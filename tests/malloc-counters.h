@@ -0,0 +1,34 @@
+/*
+Counters of what a process allocates, kept by malloc-counters.c when it
+is preloaded into the process and read by the benchmark.
+
+This program is free software: you can redistribute it and/or modify it
+under the terms of the GNU General Public License version 3, as published
+by the Free Software Foundation.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranties of
+MERCHANTABILITY, SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR
+PURPOSE.  See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __MALLOC_COUNTERS_H__
+#define __MALLOC_COUNTERS_H__
+
+/* The file the counters are shared through */
+#define MALLOC_COUNTERS_ENV "AYATANA_INDICATOR_APPLICATION_MALLOC_COUNTERS"
+
+/* Bytes are what malloc_usable_size() says, so they include what
+   malloc rounds up to */
+typedef struct _MallocCounters MallocCounters;
+struct _MallocCounters {
+	unsigned long allocations;
+	unsigned long frees;
+	unsigned long allocated_bytes;
+	long live_bytes;
+};
+
+#endif /* __MALLOC_COUNTERS_H__ */